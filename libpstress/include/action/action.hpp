@@ -1,6 +1,8 @@
 
 #pragma once
 
+#include <stdexcept>
+
 #include "metadata.hpp"
 #include "random.hpp"
 #include "sql_variant/generic.hpp"
@@ -10,8 +12,22 @@ namespace action {
 /* Actions are SQL statements. An action can result zero (in case of an error),
  * one (typical success) or more (in case of CASCADE operations) changes to the
  * metadata.
- * Actions are stateless, which should allow a retry-logic later.
+ * Actions are stateless, which should allow a retry-logic later. Workers build
+ * every action of the registry once, and execute the same instances repeatedly.
+ * Actions may cache things derived from table definitions (e.g. value
+ * generators), as an instance is only executed by the worker that built it.
+ * Actions whose statements don't change the metadata (DML) may execute them
+ * pipelined, in which case errors are reported through the pipeline callback
+ * of the connection instead of an exception.
+ * Actions which find nothing to do (e.g. no table matches their selection)
+ * throw ActionSkipped: workers count these separately, neither as successes
+ * nor as failures.
  * */
+class ActionSkipped : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
 class Action {
 public:
   virtual ~Action();
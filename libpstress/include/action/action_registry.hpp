@@ -3,7 +3,11 @@
 
 #include "action/all.hpp"
 
+#include <atomic>
+#include <limits>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 namespace action {
 
@@ -26,6 +30,53 @@ struct ActionFactory {
   std::size_t weight;
 };
 
+// Immutable snapshot of a registry, selects actions by weight in constant time
+// using Vose's alias method
+class ActionSelection {
+public:
+  explicit ActionSelection(std::vector<ActionFactory> factories);
+
+  static const constexpr std::size_t npos =
+      std::numeric_limits<std::size_t>::max();
+
+  // Returns nullptr if the total weight is 0
+  ActionFactory const *select(ps_random &rand) const;
+  // Index into factories(), npos if the total weight is 0
+  std::size_t selectIndex(ps_random &rand) const;
+
+  std::vector<ActionFactory> const &factories() const;
+  std::size_t totalWeight() const;
+
+private:
+  std::vector<ActionFactory> factories_;
+  std::size_t totalWeight_ = 0;
+  // bucket i selects factory i if a random number in [0, totalWeight) is
+  // below threshold[i], otherwise alias[i]
+  std::vector<std::size_t> threshold;
+  std::vector<std::size_t> alias;
+};
+
+using selection_cptr = std::shared_ptr<const ActionSelection>;
+
+class ActionRegistry;
+
+// Refers to an action of a registry by name, changes go through the registry
+class ActionReference {
+public:
+  ActionReference(ActionRegistry &registry, std::string const &name);
+
+  std::size_t weight() const;
+  void setWeight(std::size_t weight);
+
+private:
+  ActionRegistry &registry;
+  std::string name;
+};
+
+/* Modifications publish a new ActionSelection snapshot and increase the
+ * generation. Readers check the generation with a single atomic load, and only
+ * fetch the new snapshot (under the mutex) when it changed, which makes the
+ * selection lock free while the registry is unchanged. */
 class ActionRegistry {
 public:
   ActionRegistry();
@@ -41,7 +92,9 @@ public:
 
   ActionFactory operator[](std::string const &name) const;
 
-  ActionFactory &getReference(std::string const &name);
+  ActionReference getReference(std::string const &name);
+
+  void setWeight(std::string const &name, std::size_t weight);
 
   void makeCustomSqlAction(std::string const &name, std::string const &sql,
                            std::size_t weight);
@@ -55,11 +108,17 @@ public:
   std::size_t totalWeight() const;
   bool has(std::string name) const;
 
-  ActionFactory const &lookupByWeightOffset(std::size_t offset) const;
+  std::uint64_t generation() const;
+  selection_cptr snapshot() const;
 
 private:
   std::vector<ActionFactory> factories;
+  selection_cptr selection;
+  std::atomic<std::uint64_t> generation_ = 0;
   mutable std::mutex mutex;
+
+  // called with the mutex held
+  void publish();
 };
 
 ActionRegistry &default_registy();
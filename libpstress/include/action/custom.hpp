@@ -9,6 +9,9 @@ namespace action {
 
 struct CustomConfig {};
 
+// Executes a fixed statement. Placeholders of the inject parameters (e.g.
+// {table}) are replaced by a random table, {table:name} is replaced by the
+// tracked table with that name, and fails the action if there is none.
 class CustomSql : public Action {
 public:
   // Parameters stored as a string so we can implement dynamic dictionaries
@@ -25,9 +28,12 @@ private:
   // CustomConfig config;
   std::string sqlStatement;
   inject_t injectParameters;
+  mutable metadata::TableSetCache tables;
 
-  std::string doInject(metadata::Metadata &metaCtx, ps_random &rand,
-                       std::string const &injectionPoint) const;
+  metadata::table_cptr doInject(metadata::Metadata &metaCtx, ps_random &rand,
+                                std::string const &injectionPoint) const;
+  metadata::table_cptr namedTable(metadata::Metadata &metaCtx,
+                                  std::string_view name) const;
 };
 
 }; // namespace action
@@ -2,14 +2,34 @@
 #pragma once
 
 #include "action/action.hpp"
+#include "action/value_generator.hpp"
 
 namespace action {
 
 struct DmlConfig {
 	std::size_t deleteMin = 1;
 	std::size_t deleteMax = 100;
+	// DML uses the table with the most estimated rows out of this many random
+	// tables, 1 selects tables uniformly
+	std::size_t tableCandidates = 1;
+	// DELETE skips tables with fewer estimated rows, 0 disables
+	std::size_t deleteMinTableRows = 0;
+	// INSERT skips tables with at least this many estimated rows, 0 disables
+	std::size_t insertMaxTableRows = 0;
+	// distributions of the generated values, see value_generator.hpp
+	ValueConfig values;
 };
 
+// Selects a random table of the snapshot with at least minRows and less than
+// maxRows (0: no limit) estimated rows, the largest out of candidates tables.
+// Returns nullptr if it doesn't find a matching table in a few tries.
+// Snapshots can be reused for multiple selections, see
+// metadata::TableSetCache.
+metadata::table_cptr selectTable(metadata::TableSet const &tables,
+                                 ps_random &rand, std::size_t candidates,
+                                 std::size_t minRows = 0,
+                                 std::size_t maxRows = 0);
+
 class UpdateOneRow : public Action {
 public:
   UpdateOneRow(DmlConfig const &config);
@@ -20,6 +40,8 @@ public:
 private:
   DmlConfig config;
   std::size_t rows;
+  mutable metadata::TableSetCache tables;
+  mutable RowGeneratorCache generators{RowColumns::nonKey};
 };
 
 class DeleteData : public Action {
@@ -32,6 +54,26 @@ public:
 private:
   DmlConfig config;
   std::size_t rows;
+  mutable metadata::TableSetCache tables;
+};
+
+// Bulk loads rows into a table using COPY ... FROM STDIN, streaming the
+// generated rows without building the entire data in memory
+class CopyData : public Action {
+public:
+  CopyData(DmlConfig const &config, metadata::table_cptr table,
+           std::size_t rows);
+
+  void execute(metadata::Metadata &metaCtx, ps_random &rand,
+               sql_variant::LoggedSQL *connection) const override;
+
+  // Approximate size of a row of the table in the database, in bytes
+  static std::size_t estimatedRowSize(metadata::Table const &table);
+
+private:
+  DmlConfig config;
+  metadata::table_cptr table;
+  std::size_t rows;
 };
 
 class InsertData : public Action {
@@ -47,6 +89,8 @@ private:
   DmlConfig config;
   metadata::table_cptr table;
   std::size_t rows;
+  mutable metadata::TableSetCache tables;
+  mutable RowGeneratorCache generators;
 };
 
 }; // namespace action
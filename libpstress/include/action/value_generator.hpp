@@ -0,0 +1,183 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "metadata.hpp"
+#include "random.hpp"
+
+namespace action {
+
+/* Values of the DML statements are generated by a ColumnGenerator for every
+ * column, configured by a ValueSpec. Specs are set per column type, and can
+ * be overridden for specific columns (e.g. of adopted tables).
+ *
+ * distribution selects the numbers of INT, REAL and BOOL columns within
+ * [min, max]. Strings are random characters: for them, distribution only
+ * matters with a limited cardinality, and length_distribution selects the
+ * length within [min_length, max_length], both limited to the length of CHAR
+ * and VARCHAR columns.
+ *
+ * With a cardinality, values are selected from that many distinct values.
+ * The distinct values are the same for every worker and every run with the
+ * same seed, so e.g. zipfian with cardinality 1000 repeats the same few
+ * values most of the time.
+ * */
+
+enum class Distribution {
+  uniform,
+  // rank k is selected with probability proportional to 1 / k^skew, low
+  // values are the most frequent
+  zipfian,
+  // min, min + 1, ..., max, then again from min, separately in every worker
+  sequential,
+  // centered in the middle of the range, clamped to the range
+  normal
+};
+
+Distribution parse_distribution(std::string const &name);
+
+struct ValueSpec {
+  Distribution distribution = Distribution::uniform;
+  // range of numeric values, the defaults depend on the type
+  std::optional<double> min;
+  std::optional<double> max;
+  // zipfian exponent, larger is more skewed
+  double skew = 0.99;
+  // standard deviation of normal, relative to the range
+  double deviation = 1.0 / 6;
+
+  Distribution length_distribution = Distribution::uniform;
+  // range of string lengths, the defaults depend on the type
+  std::optional<std::size_t> min_length;
+  std::optional<std::size_t> max_length;
+
+  // number of distinct values, 0 is unlimited
+  std::size_t cardinality = 0;
+  // fraction of NULL values, only used for nullable columns
+  double null_fraction = 0;
+};
+
+struct ValueConfig {
+  // indexed by metadata::ColumnType
+  std::array<ValueSpec, 7> types{};
+  // overrides for "table.column" or "column" names
+  std::unordered_map<std::string, ValueSpec> columns;
+
+  ValueSpec &type(metadata::ColumnType type);
+  // By the name of the type (e.g. "text"), throws if it is unknown
+  ValueSpec &type(std::string const &name);
+
+  // The override of the column if there is one, otherwise the spec of its
+  // type
+  ValueSpec const &spec(metadata::Table const &table,
+                        metadata::Column const &column) const;
+};
+
+// Integers in [0, count) with a distribution
+class IndexSampler {
+public:
+  IndexSampler(Distribution distribution, std::uint64_t count, double skew,
+               double deviation);
+
+  std::uint64_t next(ps_random &rand);
+
+private:
+  Distribution distribution;
+  std::uint64_t count;
+  double deviation;
+  std::uint64_t sequence = 0;
+
+  // rejection inversion zipf sampling (Hormann, Derflinger), constant time
+  // setup and sampling independently of the count
+  double skew;
+  double hIntegralX1 = 0;
+  double hIntegralN = 0;
+  double s = 0;
+
+  double h(double x) const;
+  double hIntegral(double x) const;
+  double hIntegralInverse(double x) const;
+};
+
+class ColumnGenerator {
+public:
+  ColumnGenerator(metadata::Table const &table, metadata::Column const &column,
+                  ValueSpec const &spec);
+
+  // Appends the text representation of the next value, or
+  // sql_variant::null_parameter. Values never contain characters that need
+  // quoting or COPY escaping.
+  void append(std::string &out, ps_random &rand);
+
+private:
+  metadata::ColumnType type;
+  double min;
+  double max;
+  // absolute standard deviation of normal REAL values
+  double deviation;
+  std::size_t minLength;
+  std::size_t maxLength;
+  double nullFraction;
+  std::size_t cardinality;
+  Distribution distribution;
+  // values in [min, max], or the distinct values with a cardinality
+  IndexSampler values;
+  IndexSampler lengths;
+  // distinct value i is generated from the stream seeded by dictionarySeed
+  // and i
+  std::uint64_t dictionarySeed;
+
+  void appendValue(std::string &out, ps_random &rand);
+  void appendRandom(std::string &out, ps_random &rand);
+};
+
+// Columns generated by a RowGenerator
+enum class RowColumns {
+  // every column written by DML, for INSERT and COPY
+  all,
+  // without the primary key, which UPDATE leaves unchanged
+  nonKey
+};
+
+// Generators of the columns of a table definition which are written by DML,
+// all columns except auto increment and generated ones
+class RowGenerator {
+public:
+  RowGenerator(metadata::Table const &table, ValueConfig const &config,
+               RowColumns which = RowColumns::all);
+
+  std::uint64_t version() const { return version_; }
+
+  // Generates rows of values into the reused parameter buffer
+  std::vector<std::string> const &parameters(std::size_t rows,
+                                             ps_random &rand);
+
+  // Appends a COPY text format row, without the line end
+  void appendCopyRow(std::string &out, ps_random &rand);
+
+private:
+  std::uint64_t version_;
+  std::vector<ColumnGenerator> columns;
+  std::vector<std::string> buffer;
+};
+
+// Row generators of the recently used tables, rebuilt when the definition
+// changes. Not thread safe: every worker has its own actions, and caches.
+class RowGeneratorCache {
+public:
+  explicit RowGeneratorCache(RowColumns which = RowColumns::all)
+      : which(which) {}
+
+  RowGenerator &get(metadata::Table const &table, ValueConfig const &config);
+
+private:
+  RowColumns which;
+  std::unordered_map<std::string, RowGenerator> generators;
+};
+
+} // namespace action
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+#include "random.hpp"
+
+enum class Arrival {
+  // fixed interval between actions
+  uniform,
+  // exponentially distributed intervals with the same mean
+  poisson,
+};
+
+// Throws std::runtime_error for unknown names
+Arrival parse_arrival(std::string const &name);
+
+// Intended start times of an open loop workload.
+// The schedule doesn't depend on when actions complete: if the server is slow,
+// the worker falls behind, and latencies measured from the intended start
+// include the time the action had to wait (coordinated omission correction).
+class ArrivalSchedule {
+public:
+  using clock = std::chrono::steady_clock;
+
+  // rate is in actions per second, and has to be positive
+  ArrivalSchedule(double rate, Arrival arrival, clock::time_point start);
+
+  // Returns the intended start of the next action
+  clock::time_point next(ps_random &rand);
+
+private:
+  std::chrono::duration<double> meanInterval;
+  Arrival arrival;
+  // kept in double precision, rounding each interval would drift at high rates
+  std::chrono::duration<double> offset{0};
+  clock::time_point start;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <fmt/format.h>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace metadata {
+
+// Interned string, see 12. in the metadata design notes.
+//
+// Stores a 32 bit id into a process wide, reference counted string pool:
+// copying increments the count of the entry, and comparing two identifiers is
+// an integer compare. The entry is freed, and its id reused, when the last
+// Identifier referencing it is destroyed. Views returned by view() are valid
+// as long as an Identifier with the same value exists.
+class Identifier {
+public:
+  Identifier() = default;
+
+  explicit Identifier(std::string_view value);
+
+  Identifier(Identifier const &other);
+
+  Identifier(Identifier &&other) noexcept : id_(other.id_) { other.id_ = 0; }
+
+  ~Identifier();
+
+  Identifier &operator=(Identifier const &other);
+
+  Identifier &operator=(Identifier &&other) noexcept;
+
+  Identifier &operator=(std::string_view value);
+
+  std::string_view view() const;
+
+  operator std::string_view() const { return view(); }
+
+  std::string str() const { return std::string(view()); }
+
+  bool empty() const { return id_ == 0; }
+
+  std::uint32_t id() const { return id_; }
+
+  bool operator==(Identifier const &) const = default;
+
+  friend bool operator==(Identifier const &lhs, std::string_view rhs) {
+    return lhs.view() == rhs;
+  }
+
+private:
+  // 0 is the empty string
+  std::uint32_t id_ = 0;
+};
+
+std::ostream &operator<<(std::ostream &os, Identifier const &identifier);
+
+// Number of distinct strings currently in the pool, for statistics and tests
+std::size_t internedIdentifiers();
+
+} // namespace metadata
+
+template <>
+struct fmt::formatter<metadata::Identifier>
+    : fmt::formatter<std::string_view> {
+  auto format(metadata::Identifier const &identifier,
+              fmt::format_context &ctx) const {
+    return fmt::formatter<std::string_view>::format(identifier.view(), ctx);
+  }
+};
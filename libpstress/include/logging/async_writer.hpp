@@ -0,0 +1,150 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/*
+  Asynchronous logging
+  ====================
+
+  Statement logs can be written at a very high rate, and a single INSERT
+  statement can be hundreds of kilobytes. Formatting and writing them on the
+  worker threads would throttle the load generator.
+
+  Instead, every log stream (usually one per SQL connection) has a single
+  producer, single consumer ring buffer. The producer (worker) thread only
+  copies the raw message with a small binary header into the ring, without
+  any locking or formatting. A single I/O thread drains all rings, formats the
+  timestamps and writes the messages to the files in large batches.
+
+  If a ring is full, the producer wakes up the I/O thread and waits for free
+  space: statement logs are used to reproduce problems, silently dropping
+  messages would make them useless.
+
+  Remaining messages are flushed when the streams are closed, or at exit.
+
+  Binary streams use the same machinery, but their messages are written to the
+  file as is, without timestamps, levels or line breaks.
+*/
+
+namespace logging {
+
+enum class Level : std::uint8_t { info, warning, error };
+
+enum class Format { text, binary };
+
+// Single producer, single consumer byte ring buffer
+class RingBuffer {
+public:
+  // capacity is rounded up to a power of two
+  explicit RingBuffer(std::size_t capacity);
+
+  RingBuffer(RingBuffer const &) = delete;
+  RingBuffer &operator=(RingBuffer const &) = delete;
+
+  std::size_t capacity() const;
+
+  // producer side: writes all parts as a single contiguous record, or nothing
+  // if there isn't enough free space
+  bool tryWrite(std::span<std::string_view const> parts);
+
+  // consumer side: appends all available data to out, and frees it in the ring
+  std::size_t readAll(std::vector<char> &out);
+
+  bool empty() const;
+
+private:
+  std::size_t mask;
+  std::unique_ptr<char[]> data;
+  // both positions only grow, only the owner side writes them
+  alignas(64) std::atomic<std::uint64_t> writePos = 0;
+  alignas(64) std::atomic<std::uint64_t> readPos = 0;
+};
+
+class LogStream {
+public:
+  LogStream(std::string const &name, std::filesystem::path const &path,
+            std::size_t bufferSize, Format format = Format::text);
+  ~LogStream();
+
+  LogStream(LogStream const &) = delete;
+  LogStream &operator=(LogStream const &) = delete;
+
+  // Only one thread is allowed to log into a stream at the same time.
+  // The message is the concatenation of the parts, it is truncated if it
+  // doesn't fit into the ring buffer.
+  void log(Level level, std::initializer_list<std::string_view> parts);
+
+  static const constexpr std::size_t max_parts = 8;
+
+  std::string const &name() const;
+
+  // Longer messages are truncated
+  std::size_t maxMessageSize() const;
+
+private:
+  struct RecordHeader {
+    std::int64_t timestamp; // system_clock, nanoseconds since epoch
+    std::uint32_t length;
+    Level level;
+  };
+
+  std::string name_;
+  Format format;
+  int fd;
+  RingBuffer ring;
+
+  friend class AsyncWriter;
+};
+
+class AsyncWriter {
+public:
+  static AsyncWriter &instance();
+
+  ~AsyncWriter();
+
+  // Creates and registers a new stream, the file is opened in append mode
+  std::shared_ptr<LogStream> open(std::string const &name,
+                                  std::filesystem::path const &path,
+                                  std::size_t bufferSize,
+                                  Format format = Format::text);
+
+  void wakeup();
+
+  // Waits until everything logged before the call is written to the files
+  void flush();
+
+private:
+  AsyncWriter();
+
+  void run(std::stop_token stop);
+
+  // returns the number of bytes written
+  std::size_t drain(LogStream &stream);
+
+  std::mutex mutex;
+  std::condition_variable_any cv;
+  std::atomic<bool> wakeupRequested = false;
+  std::atomic<std::uint64_t> completedCycles = 0;
+  std::vector<std::shared_ptr<LogStream>> streams;
+
+  // only used by the I/O thread
+  std::vector<char> readBuffer;
+  std::string writeBuffer;
+  std::int64_t cachedSecond = 0;
+  std::string cachedSecondStr;
+
+  std::jthread thread;
+};
+
+} // namespace logging
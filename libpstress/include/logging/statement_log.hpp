@@ -0,0 +1,60 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "logging/async_writer.hpp"
+
+namespace logging {
+
+struct StatementLogPolicy {
+  enum class Mode {
+    full,      // every statement, before execution
+    truncated, // every statement, truncated to truncateLength bytes
+    errors,    // only failed statements, after execution
+    sampled,   // every sampleRate-th statement, and all failed statements
+  };
+
+  Mode mode = Mode::full;
+  std::size_t truncateLength = 1024;
+  std::size_t sampleRate = 100;
+  std::size_t bufferSize = 4 * 1024 * 1024;
+  // Also write a binary, replayable trace of every statement, see trace.hpp
+  bool binaryTrace = false;
+
+  // Throws std::runtime_error for unknown modes
+  static Mode parseMode(std::string const &mode);
+};
+
+// Statement logging of a single SQL connection, see LoggedSQL
+class StatementLog {
+public:
+  StatementLog(std::string const &name, StatementLogPolicy const &policy);
+
+  // Called before executing the statement. Returns true if the statement was
+  // logged.
+  bool statement(std::string_view sql) const;
+
+  // Same as statement(), for statements whose text is only rendered when
+  // needed: decides whether the statement is logged, and if it returns true,
+  // the text has to be passed to logStatement()
+  bool selectStatement() const;
+  void logStatement(std::string_view sql) const;
+
+  // Called after a failed execution. Also logs the statement if it wasn't
+  // logged before execution.
+  void error(std::string_view sql, bool statementLogged,
+             std::string_view errorCode, std::string_view errorMessage) const;
+
+  void message(Level level, std::string_view msg) const;
+
+private:
+  StatementLogPolicy policy;
+  std::shared_ptr<LogStream> stream;
+  mutable std::size_t statementCounter = 0;
+
+  std::string_view limited(std::string_view sql) const;
+};
+
+} // namespace logging
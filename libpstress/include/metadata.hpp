@@ -4,11 +4,16 @@
 #include <array>
 #include <atomic>
 #include <boost/container/small_vector.hpp>
+#include <chrono>
 #include <exception>
 #include <limits>
+#include <memory>
 #include <mutex>
 #include <shared_mutex>
 
+#include "identifier.hpp"
+#include "shared_vector.hpp"
+
 /*
   Metadata API
   ===============
@@ -49,9 +54,12 @@
   1. The Metadata class contains shared pointers to tables and a (write) mutex
   for each table
 
-  2. These are both stored in arrays, with enough sizes (200 by default) for
-  most usescases. And if more tables are needed, this can be increased with a
-  rebuild.
+  2. These are both stored in slots, which are allocated in fixed size
+  segments when a CREATE first needs them. Segments are never moved or freed
+  while the Metadata exists, so a slot (and its lock) stays at the same address
+  without any locking around the segment directory. The maximum number of
+  tables (200 by default) is a runtime option, only the segment directory is
+  sized by it up front.
 
   3. shared_ptr access/write is an atomic operation. SELECTS are done by threads
   getting a shared pointer, and holding the ref count as long as needed.
@@ -135,36 +143,107 @@
 
   6. Dynamic allocations (vectors) are limited by using non allocating
   boost containers. This helps with copy times, and locality also should result
-  in better performance.
+  in better performance. Columns and indexes of a Table are the exception, see
+  11.
 
-  7. Strings are kept as std::strings, because small string optimization
+  7. Table names are kept as std::strings, because small string optimization
   usually means it doesn't allocate up to 15 (22) characters, which should be
-  true for most things. And default values of long fields wouldn't fit in
-  static_strings anyway.
-
-  As 22 bytes is a significant improvement over 15, in case we have slighly
-  longer column names and functional indexes, it is strongly recommended to
-  build pstress with libc++.
+  true for most things. Column and index names are interned instead, see 12.
 
   8. While it is unlikely, it is possible for the [] operator to return a
   nullptr. Generally the completion code is very careful about this, and
   metadata[size()-1] != nullptr is always true, but since there is no locking
   during data retrieval, it is possible that the size changes between calling
-  size() and operator[].
+  size() and operator[]. Code selecting random tables should use a TableSet
+  instead, see 14.
+
+  9. Tables can be found by name without a linear search: Metadata also
+  keeps a name -> index hash map. Reservation::complete updates it together
+  with the table array (CREATE, DROP, the defragmenting move of DROP, and
+  ALTERs that rename the table), while still holding the table locks. The map
+  has its own shared_mutex, which is always acquired after the table locks.
+
+  Lookups can't hold the map lock while locking the table, as that would
+  invert the lock order. Instead they look up the index, read the table, and
+  retry if its name doesn't match: that only happens while a concurrent
+  DROP/ALTER is completing, which updates the map right after the array.
+
+  10. Every table has runtime statistics (estimated row count, statements,
+  failures, latency), updated by the DML actions when their results arrive.
+  These are atomic counters behind a shared_ptr: ALTER copies the Table, but
+  the copy shares the statistics with the previous definition, and updating
+  them doesn't need a Reservation. They are estimates, e.g. statements
+  executed outside of the actions aren't accounted for.
+
+  11. ALTER works on a copy of the Table, and the copy is made before the
+  statement is executed, even if it fails. To keep this cheap for wide tables,
+  columns and indexes are SharedVectors: the copy shares them with the
+  previous definition, and only the parts modified by the ALTER are copied.
+  Adding a column copies the column pointers (not the columns), changing a
+  column also copies that single column. Shared elements are immutable, so
+  readers of the old definition are never affected.
+
+  12. Column names, default values and index names/fields are Identifiers:
+  32 bit ids into a process wide string pool. This keeps a Column at 20 bytes
+  (instead of ~90 with two std::strings), independently of the name length,
+  and comparing names is an integer compare. Names are interned once, when a
+  column is created (or read from the catalog or a snapshot), and rendered
+  with view() or fmt without a copy. As every Column is a separate allocation
+  of its SharedVector (see 11.), iterating the columns still follows a pointer
+  per column: the size only keeps each of them, with the shared_ptr control
+  block, below the size of a cache line, and makes the copies of modified
+  columns cheap. Names are looked up in the pool when rendered.
+
+  The pool is process wide rather than per Metadata, as Columns are also
+  created without a Metadata (actions, the reconciler, tests). Entries are
+  reference counted: a name is freed, and its id reused, when the last
+  definition using it is released (see 11.). Random column names are unique,
+  so without this every ADD COLUMN would grow the pool until the process
+  exits. Only the release of the last reference takes the pool mutex, shared
+  columns are copied as pointers, so ALTERs rarely touch the counts.
+
+  13. Readers don't lock: every slot also publishes the raw pointer of its
+  table in an atomic, and replaced tables are reclaimed using epochs. A
+  ReadGuard pins the current epoch in a per thread, cache line sized record,
+  and only loads the published pointers, so readers never write memory that
+  other threads use (except the reference count, when they take ownership).
+  Writers still lock the slots between themselves as described above. When
+  they replace or remove a table, its shared_ptr is retired with the current
+  epoch, the epoch is advanced, and it is released once every pinned reader
+  started after that epoch.
+
+  operator[] is a short ReadGuard and shared_from_this, so returned tables
+  stay valid independently of the guard. Code reading many tables, e.g.
+  building a TableSet (see 14.), should use a ReadGuard directly.
+
+  14. tables() returns a TableSet: an immutable snapshot of every table,
+  without holes, tagged with the generation it was built at. The generation
+  is increased whenever a table is published (CREATE, ALTER, DROP), and
+  tables() only rebuilds the snapshot when it changed, otherwise every caller
+  gets the same shared snapshot. Random selection from a TableSet is a single
+  index into a vector, it can't hit a hole or run past the end, and callers
+  selecting many tables can keep using one snapshot.
+
+  The snapshot is consistent with the generation it is tagged with: it is
+  built after reading the generation, so it contains every change up to it,
+  and it might already contain some later changes. Those increased the
+  generation, so the next tables() call builds a new snapshot. A snapshot can
+  be outdated as soon as it is returned, like any table read from Metadata.
+
+  tables() itself isn't free: it loads the shared snapshot and increments its
+  reference count, a write to memory used by every worker. Actions executed
+  repeatedly keep a TableSetCache instead, which only compares the generation
+  (a plain atomic load) and keeps using its snapshot until DDL changes it.
 
   Possible further improvements
   -----------------------------
 
-  * Instead of a linear search, metadata could use and update a sorted lookup
-    array when needed, so it could use logarithmic search. While it couldn't
-    guarantee that this array is always 100% up to date, this could speed up
-    most of the name/property based searches.
   * As the stored metadata can diverge from what's actually in the database in
     case of internal logic errors, a "sanity check" periodic operation or thread
     could query the schema in the DB, and update Metadata when needed.
-  * Metadata currently has no internal statistics (row count, table data size,
-    previous query performance on the table, ...), but this could be an
-    interesting addition
+  * Table statistics only contain what DML actions can track cheaply (see
+    10.), the data size or the real row count could be queried from the
+    server periodically
   * Instead of a single mutex, Metadata could use one mutex for alters, and
     another level for CREATE/DROP - those would need to lock both. This could
     ensure that ALTERing the last table can happen in parallel with CREATE/DROP
@@ -178,6 +257,9 @@
 #include <boost/static_string/static_string.hpp>
 #include <cstdint>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 namespace metadata {
 
@@ -192,24 +274,37 @@ private:
 };
 
 namespace limits {
-const constexpr std::size_t maximum_table_count = 200;
+const constexpr std::size_t default_maximum_table_count = 200;
+// slots per segment, see 2. in the design notes
+const constexpr std::size_t table_segment_size = 64;
 const constexpr std::size_t optimized_column_count = 32;
 const constexpr std::size_t optimized_index_column_count = 10;
 const constexpr std::size_t optimized_index_count = 16;
 } // namespace limits
 
-enum class ColumnType { INT, CHAR, VARCHAR, REAL, BOOL, BYTEA, TEXT };
+enum class ColumnType : std::uint8_t {
+  INT,
+  CHAR,
+  VARCHAR,
+  REAL,
+  BOOL,
+  BYTEA,
+  TEXT
+};
 
-enum class Generated { notGenerated, stored, virt };
+enum class Generated : std::uint8_t { notGenerated, stored, virt };
 
+// Packed into 20 bytes, see 12. in the design notes
 struct Column {
-  std::string name; // TODO: fixed buffers for strings?
-  ColumnType type;
-
-  std::size_t length = 0;
+  Identifier name;
+  // interned as well, most columns have no (or the same) default
+  Identifier default_value;
 
-  std::string default_value;
+  // CHAR and VARCHAR: maximum number of characters. INT and REAL: largest
+  // value of a narrower type (e.g. smallint, numeric(5, 2)), 0 otherwise.
+  std::uint32_t length = 0;
 
+  ColumnType type;
   Generated generated = Generated::notGenerated;
 
   bool nullable = false;
@@ -217,7 +312,13 @@ struct Column {
   bool auto_increment = false;
   // Perona Server for MySQL specific
   bool compressed = false; // percona type compressed
+
+  // DML provides the values of all columns except serial and generated ones
+  bool written() const {
+    return !auto_increment && generated == Generated::notGenerated;
+  }
 };
+static_assert(sizeof(Column) <= 20);
 
 enum class IndexOrdering { default_, asc, desc };
 
@@ -230,14 +331,34 @@ struct IndexColumn {
 
 struct Index {
   // TODO: support postgres functional indexes?
-  std::string name;
+  Identifier name;
 
-  boost::container::small_vector<std::string,
+  boost::container::small_vector<Identifier,
                                  limits::optimized_index_column_count>
       fields;
 };
 
-struct Table {
+// See 10. in the design notes. Any thread can update these, without locking.
+struct TableStatistics {
+  // inserted - deleted rows, as reported by the server
+  std::atomic<std::int64_t> rowEstimate = 0;
+  std::atomic<std::uint64_t> statements = 0;
+  std::atomic<std::uint64_t> failures = 0;
+  // total latency of the statements in microseconds
+  std::atomic<std::uint64_t> latencySum = 0;
+
+  // Estimated number of rows, never negative
+  std::uint64_t rows() const;
+
+  // rowsChanged is positive for inserts, negative for deletes
+  void recordSuccess(std::chrono::nanoseconds latency,
+                     std::int64_t rowsChanged);
+  void recordFailure(std::chrono::nanoseconds latency);
+};
+
+// Published tables are shared through shared_from_this, see 13. in the design
+// notes
+struct Table : std::enable_shared_from_this<Table> {
 
   enum class Type { normal, partitioned, temporary };
 
@@ -254,18 +375,53 @@ struct Table {
   bool mysql_compression; // mysql specific
   bool encryption;
 
-  boost::container::small_vector<Column, limits::optimized_column_count>
-      columns;
-  boost::container::small_vector<Index, limits::optimized_index_count> indexes;
+  // Shared with the previous definition until modified, see 11. in the
+  // design notes
+  SharedVector<Column, limits::optimized_column_count> columns;
+  SharedVector<Index, limits::optimized_index_count> indexes;
+
+  // Assigned by Metadata when a CREATE or ALTER completes, unique for every
+  // table definition. Caches derived from the definition (e.g. prepared
+  // statements) compare it to detect changes.
+  std::uint64_t version = 0;
+
+  // Shared by every version of the definition
+  std::shared_ptr<TableStatistics> statistics =
+      std::make_shared<TableStatistics>();
 };
 
 using table_ptr = std::shared_ptr<Table>;
 using table_cptr = std::shared_ptr<const Table>;
 
+// Immutable snapshot of the tables of a Metadata, see 14. in the design notes
+class TableSet {
+public:
+  using tables_t = std::vector<table_cptr>;
+  using const_iterator = tables_t::const_iterator;
+
+  TableSet(std::uint64_t generation, tables_t tables);
+
+  std::uint64_t generation() const { return generation_; }
+
+  std::size_t size() const { return tables_.size(); }
+  bool empty() const { return tables_.empty(); }
+
+  // Never nullptr
+  table_cptr const &operator[](std::size_t idx) const { return tables_[idx]; }
+
+  const_iterator begin() const { return tables_.begin(); }
+  const_iterator end() const { return tables_.end(); }
+
+private:
+  std::uint64_t generation_;
+  tables_t tables_;
+};
+
+using table_set_cptr = std::shared_ptr<const TableSet>;
+
 class Metadata {
 public:
   using table_t = table_ptr;
-  using container_t = std::array<table_t, limits::maximum_table_count>;
   using index_t = std::size_t;
 
   static const constexpr index_t npos = std::numeric_limits<index_t>::max();
@@ -309,7 +465,9 @@ public:
     friend class Metadata;
   };
 
-  Metadata();
+  explicit Metadata(
+      index_t maximumTableCount = limits::default_maximum_table_count);
+  ~Metadata();
 
   // If no slots are left, returns an invalid (non open) Reservation
   Reservation createTable();
@@ -337,18 +495,110 @@ public:
 
   index_t size() const;
 
+  index_t maximumTableCount() const;
+
   // Might return nullptr. It is very unlikely, but still needs to be checked
   table_cptr operator[](index_t idx) const;
 
+  // Snapshot of the current tables, only rebuilt after DDL changed them
+  table_set_cptr tables() const;
+
+  // Increased by every CREATE, ALTER and DROP
+  std::uint64_t generation() const;
+
+  // Lock free reads without taking ownership, see 13. in the design notes.
+  // Tables read through the guard stay valid until the guard is destroyed.
+  // Keep guards short lived: definitions replaced while any guard exists
+  // can't be freed until it is destroyed. Guards can be nested.
+  class ReadGuard {
+  public:
+    explicit ReadGuard(Metadata const &meta);
+    ~ReadGuard();
+
+    ReadGuard(ReadGuard const &) = delete;
+    ReadGuard &operator=(ReadGuard const &) = delete;
+
+    // Might return nullptr, like Metadata::operator[]
+    Table const *operator[](index_t idx) const;
+
+    // Shared ownership of a table read through this guard
+    table_cptr share(Table const *table) const;
+
+  private:
+    Metadata const &meta_;
+  };
+
+  // Returns npos if there is no table with this name. Like with any index,
+  // the table might be moved or dropped by the time it is used.
+  index_t findByName(std::string_view name) const;
+  // Returns nullptr if there is no table with this name
+  table_cptr tableByName(std::string_view name) const;
+
 private:
+  struct NameHash {
+    using is_transparent = void;
+    std::size_t operator()(std::string_view name) const {
+      return std::hash<std::string_view>{}(name);
+    }
+  };
+
+  // Removes the removed name if it still points to idx, and adds the added
+  // name pointing to idx. Empty names are skipped.
+  void updateNameIndex(std::string const &removed, std::string const &added,
+                       index_t idx);
+
+  struct Slot {
+    // only accessed while holding the lock
+    table_t table;
+    // table.get(), for the lock free readers
+    std::atomic<Table const *> published = nullptr;
+    std::shared_mutex lock;
+    // where the last table was moved from here, see 5. in the design notes
+    index_t movedTo = npos;
+  };
+
+  using Segment = std::array<Slot, limits::table_segment_size>;
+
+  // The slot has to be allocated: below reservedSize, or locked
+  Slot &slot(index_t idx) const;
+  // Returns nullptr if the slot isn't allocated
+  Slot *findSlot(index_t idx) const;
+  // Replaces the table of a locked slot, the previous table is freed once no
+  // reader can see it anymore
+  void publish(Slot &target, table_t table);
+  // Allocates the segments for the first count slots
+  void allocateSlots(index_t count);
+
   struct InternalData {
-    container_t tables;
-    mutable std::array<std::shared_mutex, limits::maximum_table_count>
-        tableLocks;
-    std::array<index_t, limits::maximum_table_count> movedToMap;
+    index_t maximumTableCount;
+    // one entry for every possible segment, nullptr until allocated
+    std::unique_ptr<std::atomic<Segment *>[]> segments;
+    std::mutex allocationLock;
     std::atomic<std::size_t> tableCount;
     std::atomic<std::size_t> reservedSize;
+    std::atomic<std::uint64_t> lastVersion = 0;
+    // see 14. in the design notes
+    std::atomic<std::uint64_t> generation = 0;
+    mutable std::mutex tableSetLock;
+    mutable std::atomic<table_set_cptr> tableSet;
+    // see 9. in the design notes
+    mutable std::shared_mutex namesLock;
+    std::unordered_map<std::string, index_t, NameHash, std::equal_to<>> names;
   } data_;
 };
 
+// The last snapshot of a Metadata, only loaded again when the generation
+// changed. Loading the shared snapshot updates its reference count: DML
+// selecting tables on every action keeps its own cache, see 14. in the design
+// notes. Not thread safe.
+class TableSetCache {
+public:
+  // Valid until the next call
+  TableSet const &get(Metadata const &meta);
+
+private:
+  Metadata const *source = nullptr;
+  table_set_cptr snapshot;
+};
+
 } // namespace metadata
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "metadata.hpp"
+
+/*
+  Metadata snapshots
+  ==================
+
+  The tracked table definitions can be saved to a file, and restored later
+  when the same database is reused (e.g. when a soak run is restarted), so
+  the tables don't have to be created and loaded again.
+
+  Snapshots are written to a temporary file, flushed to disk and renamed, a
+  crash (or power loss) never leaves a partially written snapshot behind. Restoring uses metadata::adopt, tables
+  which are already tracked are skipped. The database can differ from the
+  snapshot, e.g. if the server crashed during DDL, the restored tables should
+  be reconciled with the catalog (see schema_reconciler.hpp).
+
+  Format (native byte order), strings are a u32 length followed by the bytes:
+
+    file header:  "PSMETA\0\0"  magic
+                  u32         format version
+                  u32         table count
+    tables:       string      name
+                  string      engine
+                  string      tablespace
+                  i64         estimated rows
+                  u32         column count
+                  columns     string name
+                              u8     type (ColumnType)
+                              u64    length
+                              string default value
+                              u8     generated (Generated)
+                              u8     flags: nullable, primary key,
+                                     auto increment, compressed
+                  u32         index count
+                  indexes     string name
+                              u32    field count
+                              string fields...
+
+  Versions and the other statistics aren't saved, they belong to the run.
+*/
+
+namespace metadata {
+
+const constexpr std::array<char, 8> snapshot_magic = {'P', 'S', 'M', 'E',
+                                                      'T', 'A', '\0', '\0'};
+const constexpr std::uint32_t snapshot_version = 1;
+
+// Throws MetadataException if the file can't be written
+void writeSnapshot(Metadata const &meta, std::filesystem::path const &path);
+
+// Throws MetadataException if the file can't be read, or isn't a valid
+// snapshot
+std::vector<Table> readSnapshot(std::filesystem::path const &path);
+
+} // namespace metadata
@@ -1,21 +1,105 @@
+#pragma once
 
-#include <random>
+#include <array>
+#include <cstdint>
+#include <limits>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
-// TODO: add constructor with fixed seed
+// xoshiro256** 1.0 by David Blackman and Sebastiano Vigna, a 32 byte state
+// UniformRandomBitGenerator, much faster than std::mt19937_64 (2.5KB state)
+class xoshiro256ss {
+public:
+  using result_type = std::uint64_t;
+
+  // The state is filled by splitmix64 from the seed, as recommended by the
+  // authors, so any seed (including 0) is fine
+  explicit xoshiro256ss(std::uint64_t seed);
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  result_type operator()() {
+    const auto result = rotl(state[1] * 5, 7) * 9;
+    const auto t = state[1] << 17;
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = rotl(state[3], 45);
+    return result;
+  }
+
+private:
+  std::array<std::uint64_t, 4> state;
+
+  static constexpr std::uint64_t rotl(std::uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+  }
+};
+
+// Random numbers and strings for the actions, one instance per thread.
+//
+// Every instance is a stream derived from the run seed: instances with the
+// same stream name generate the same sequence in runs with the same seed, so
+// a run can be repeated by setting the seed it logged at startup. (As far as
+// the order of the actions is repeatable: concurrent workers still interleave
+// differently.)
 class ps_random {
 public:
+  using engine_t = xoshiro256ss;
+
+  // Unnamed stream, numbered in creation order. Only repeatable if instances
+  // are created in the same order, use a named stream for threads.
   ps_random();
 
+  // Stream of a worker or thread, e.g. its name
+  explicit ps_random(std::string_view stream);
+
+  // Independent of the run seed, e.g. for tests
+  static ps_random from_seed(std::uint64_t seed);
+
+  // The run seed is random unless set, it should be set before creating the
+  // workers
+  static std::uint64_t run_seed();
+  static void set_run_seed(std::uint64_t seed);
+
+  // Strings of letters, digits, '_' and '-': 64 symbols, so a single 64 bit
+  // draw gives 10 characters. Never needs quoting or escaping.
   std::string random_string(std::size_t min_length, std::size_t max_length);
 
+  // Appends a random string, without a temporary string
+  void append_string(std::string &out, std::size_t min_length,
+                     std::size_t max_length);
+
+  // Fills the buffer with random characters, like random_string
+  void fill_string(char *out, std::size_t length);
+
+  // Fills the buffer with random_number(min, max) values
+  template <typename T>
+  void fill_numbers(T *out, std::size_t count, T min, T max) {
+    for (std::size_t idx = 0; idx < count; ++idx) {
+      out[idx] = random_number(min, max);
+    }
+  }
+
+  // Uniform in [min, max] for integers, [min, max) for floating point types
   template <typename T> T random_number(T min, T max) {
     if constexpr (std::is_floating_point_v<T>) {
-      std::uniform_real_distribution<> len_dist(min, max);
-      return len_dist(rng);
+      // 53 random bits, the precision of a double
+      const auto unit = static_cast<double>(rng() >> 11) * 0x1.0p-53;
+      return static_cast<T>(min + (max - min) * unit);
     } else {
-      std::uniform_int_distribution<> len_dist(min, max);
-      return len_dist(rng);
+      static_assert(std::is_integral_v<T> && sizeof(T) <= 8);
+      using unsigned_t = std::make_unsigned_t<T>;
+      const std::uint64_t range = static_cast<std::uint64_t>(
+          static_cast<unsigned_t>(max) - static_cast<unsigned_t>(min));
+      return static_cast<T>(static_cast<unsigned_t>(min) +
+                            static_cast<unsigned_t>(bounded(range)));
     }
   }
 
@@ -24,7 +108,30 @@ public:
                             std::numeric_limits<T>::max());
   }
 
+  std::uint64_t stream_seed() const { return seed; }
+
 private:
+  struct seeded_t {};
+  ps_random(std::uint64_t seed, seeded_t);
+
   std::uint64_t seed;
-  std::mt19937_64 rng;
+  engine_t rng;
+
+  // Uniform in [0, range], Lemire's multiply and reject method
+  std::uint64_t bounded(std::uint64_t range) {
+    if (range == std::numeric_limits<std::uint64_t>::max()) {
+      return rng();
+    }
+    const std::uint64_t bound = range + 1;
+    auto product = static_cast<unsigned __int128>(rng()) * bound;
+    auto low = static_cast<std::uint64_t>(product);
+    if (low < bound) {
+      const std::uint64_t threshold = -bound % bound;
+      while (low < threshold) {
+        product = static_cast<unsigned __int128>(rng()) * bound;
+        low = static_cast<std::uint64_t>(product);
+      }
+    }
+    return static_cast<std::uint64_t>(product >> 64);
+  }
 };
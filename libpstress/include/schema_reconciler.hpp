@@ -0,0 +1,107 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "metadata.hpp"
+#include "sql_variant/generic.hpp"
+
+/*
+  Schema reconciliation
+  =====================
+
+  Metadata can drift from the database (see the Metadata design notes), e.g.
+  when a DDL statement fails after the definition was already modified. The
+  reconciler reads the definitions of all tables of the current schema with a
+  single catalog query, and corrects the tracked tables through the usual
+  Reservation API:
+
+  * tables which don't exist in the database are removed
+  * tables with different columns (name, type, length, primary key, serial,
+    generated),
+    access method or indexes are replaced by the definition in the catalog
+
+  The catalog query can race with concurrent DDL. To never overwrite a newer
+  definition with an older catalog state, table versions are captured before
+  the query, and a table is only corrected if it still has the same version
+  while its Reservation is held. Skipped tables are checked again in the next
+  pass.
+
+  Tables which exist in the database but aren't tracked are only counted, they
+  might not be created by pstress.
+
+  Adopting an existing schema uses the same catalog query: tables which aren't
+  tracked yet are added to Metadata, so the DML actions can run on existing
+  data without generating it first. Column types are mapped to the nearest
+  ColumnType (e.g. bigint to INT, numeric to REAL). Narrower types keep their
+  range as the length of the column (see Column::length), which limits the
+  generated values. Columns of other types are left out if they are nullable,
+  have a default or are generated, as pstress never has to provide a value for
+  them. Otherwise the whole table is skipped. Tables without a single column
+  primary key are skipped as well, DELETE and UPDATE select their rows by the
+  key. Table and column names are quoted with quote_ident, and tables outside
+  the current schema are schema qualified, so the names can be used in
+  statements as they are. Generated columns are tracked as such, DML never
+  writes them.
+*/
+
+namespace metadata {
+
+struct ReconcileReport {
+  // tables replaced by their catalog definition
+  std::size_t correctedTables = 0;
+  // individual differences in the corrected tables, e.g. one per column
+  std::size_t differences = 0;
+  // tracked tables which don't exist in the database
+  std::size_t removedTables = 0;
+  // tables in the database which aren't tracked
+  std::size_t untrackedTables = 0;
+
+  bool drift() const;
+};
+
+// table name -> version
+using version_map_t = std::unordered_map<std::string, std::uint64_t>;
+
+// Versions of the tracked tables, has to be captured before reading the
+// catalog
+version_map_t trackedVersions(Metadata const &meta);
+
+struct CatalogFilter {
+  // empty reads the current schema
+  std::string schema;
+  // POSIX regular expression the table names have to match, empty matches
+  // every table
+  std::string include;
+  // tables with these (quoted, possibly schema qualified) names are also
+  // read, regardless of the filters above
+  std::vector<std::string> names;
+};
+
+// Definitions of the tables matching the filter. Only name, engine, columns,
+// indexes and the row estimate of the statistics are filled. Tables with
+// required columns of unsupported types are returned without columns: they
+// are neither removed, corrected nor adopted. Throws SqlException if the query
+// fails.
+std::vector<Table> readCatalog(sql_variant::LoggedSQL &connection,
+                               CatalogFilter const &filter = {});
+
+// Corrects the tables which still have the captured version
+ReconcileReport reconcile(Metadata &meta, version_map_t const &versions,
+                          std::vector<Table> const &catalog);
+
+// Captures the versions, reads the catalog (the current schema and the
+// tracked tables), and reconciles
+ReconcileReport reconcileSchema(Metadata &meta,
+                                sql_variant::LoggedSQL &connection);
+
+// Adds the tables which aren't tracked yet, returns the number of tables
+// added. Stops when Metadata is full.
+std::size_t adopt(Metadata &meta, std::vector<Table> const &catalog);
+
+// Reads the catalog with the filter, and adopts the tables
+std::size_t adoptSchema(Metadata &meta, sql_variant::LoggedSQL &connection,
+                        CatalogFilter const &filter);
+
+} // namespace metadata
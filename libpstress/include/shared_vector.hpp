@@ -0,0 +1,94 @@
+#pragma once
+
+#include <boost/container/small_vector.hpp>
+#include <boost/iterator/indirect_iterator.hpp>
+#include <memory>
+
+namespace metadata {
+
+// Copy on write vector of immutable elements, see 11. in the metadata design
+// notes.
+//
+// Copying the vector only copies a pointer. The first modification of a copy
+// clones the element pointers, but not the elements, and modifying an element
+// only clones that element. Elements are never modified in place, so a
+// reference returned by a const accessor stays valid as long as the vector it
+// was taken from (or any copy of it) exists.
+//
+// Like the Table that contains it, a SharedVector can be read from multiple
+// threads, but only the owner of the Reservation may modify it.
+template <typename T, std::size_t N> class SharedVector {
+  using element_ptr = std::shared_ptr<const T>;
+  using items_t = boost::container::small_vector<element_ptr, N>;
+
+public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using const_iterator =
+      boost::indirect_iterator<typename items_t::const_iterator, const T>;
+  using iterator = const_iterator;
+
+  SharedVector() = default;
+
+  SharedVector(std::initializer_list<T> values) {
+    for (auto const &value : values) {
+      push_back(value);
+    }
+  }
+
+  size_type size() const { return items ? items->size() : 0; }
+  bool empty() const { return size() == 0; }
+
+  T const &operator[](size_type idx) const { return *(*items)[idx]; }
+  T const &front() const { return *items->front(); }
+  T const &back() const { return *items->back(); }
+
+  const_iterator begin() const { return const_iterator(all().begin()); }
+  const_iterator end() const { return const_iterator(all().end()); }
+
+  void push_back(T value) {
+    mutableItems().push_back(std::make_shared<const T>(std::move(value)));
+  }
+
+  void pop_back() { mutableItems().pop_back(); }
+
+  void erase(const_iterator pos) {
+    const auto idx = pos.base() - all().begin();
+    auto &owned = mutableItems();
+    owned.erase(owned.begin() + idx);
+  }
+
+  void clear() { items.reset(); }
+
+  // Replaces the element with a modifiable copy. The reference is invalidated
+  // by the next modification of this vector.
+  T &modify(size_type idx) {
+    auto &owned = mutableItems();
+    auto copy = std::make_shared<T>(*owned[idx]);
+    T &result = *copy;
+    owned[idx] = std::move(copy);
+    return result;
+  }
+
+  // Number of vectors sharing the same elements, for tests
+  long shareCount() const { return items.use_count(); }
+
+private:
+  std::shared_ptr<items_t> items;
+
+  items_t const &all() const {
+    static const items_t none;
+    return items ? *items : none;
+  }
+
+  items_t &mutableItems() {
+    if (!items) {
+      items = std::make_shared<items_t>();
+    } else if (items.use_count() > 1) {
+      items = std::make_shared<items_t>(*items);
+    }
+    return *items;
+  }
+};
+
+} // namespace metadata
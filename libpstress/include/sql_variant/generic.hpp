@@ -4,13 +4,19 @@
 #include <chrono>
 #include <cstdint>
 #include <exception>
+#include <functional>
 #include <memory>
 #include <optional>
+#include <span>
 #include <spdlog/spdlog.h>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <vector>
 
+#include "logging/statement_log.hpp"
+#include "trace/trace.hpp"
+
 namespace sql_variant {
 
 enum class flavor { ANY_MYSQL, ANY_PG, ps, pxc, mysql, postgres, ppg };
@@ -72,14 +78,27 @@ struct ServerParams {
 
 struct QueryResult;
 
+// Fills the buffer (which is cleared before every call) with the next part of
+// the COPY data, and returns false when there is no more data
+using copy_producer_t = std::function<bool(std::string &buffer)>;
+
+// Prepared statement parameters equal to this are sent as NULL. It is also the
+// NULL of the COPY text format, so generated values can be used for both.
+const constexpr std::string_view null_parameter = "\\N";
+
 class SqlException : public std::exception {
 public:
-  SqlException(std::string const &message) : message(message) {}
+  SqlException(std::string const &message, std::string const &errorCode = {})
+      : message(message), code(errorCode) {}
 
   const char *what() const noexcept override { return message.c_str(); }
 
+  // SQLSTATE of the failed statement, empty for client side errors
+  std::string const &errorCode() const noexcept { return code; }
+
 private:
   std::string message;
+  std::string code;
 };
 
 enum class SqlStatus { success, error, serverGone };
@@ -109,7 +128,7 @@ struct QuerySpecificResult {
 struct QueryResult {
   std::string query;
   std::chrono::high_resolution_clock::time_point executedAt;
-  std::chrono::nanoseconds executionTime;
+  std::chrono::nanoseconds executionTime{0};
   ErrorInfo errorInfo;
   std::uint64_t affectedRows = 0;
 
@@ -123,7 +142,8 @@ struct QueryResult {
     if (!success()) {
       throw SqlException(fmt::format("Error while executing query: {} {}",
                                      errorInfo.errorCode,
-                                     errorInfo.errorMessage));
+                                     errorInfo.errorMessage),
+                         errorInfo.errorCode);
     }
   }
 };
@@ -151,6 +171,33 @@ public:
 
   virtual void reconnect() = 0;
 
+  // Server side prepared statements, parameters are passed as text
+  virtual QueryResult prepare(std::string const &name,
+                              std::string const &query) const;
+  virtual QueryResult
+  executePrepared(std::string const &name,
+                  std::span<std::string const> params) const;
+
+  // Executes a COPY ... FROM STDIN statement, streaming the data from the
+  // producer
+  virtual QueryResult copyFrom(std::string const &query,
+                               copy_producer_t const &producer) const;
+
+  // Pipelined execution: statements are sent without waiting for the result
+  // of the previous ones, and results are received in the same order.
+  // Every statement runs in its own implicit transaction, an error only fails
+  // the statement that caused it.
+  virtual bool pipelineSupported() const;
+
+  // Throws SqlException if the statement couldn't be sent
+  virtual void pipelineSend(std::string const &query);
+  virtual void pipelineSendPrepared(std::string const &name,
+                                    std::span<std::string const> params);
+
+  // Waits for the result of the oldest statement sent. Connection errors are
+  // reported in the result, not as an exception.
+  virtual QueryResult pipelineReceive();
+
 protected:
   ServerInfo serverInfo_;
 };
@@ -159,18 +206,168 @@ class LoggedSQL {
 public:
   ServerInfo serverInfo() const;
 
-  LoggedSQL(std::unique_ptr<GenericSQL> sql, std::string const &logName);
+  LoggedSQL(std::unique_ptr<GenericSQL> sql, std::string const &logName,
+            logging::StatementLogPolicy const &logPolicy = {});
+
+  using completion_t = std::function<void(QueryResult const &)>;
 
+  // Waits for the results of all pipelined statements first
   [[nodiscard]] QueryResult executeQuery(std::string const &query) const;
 
+  // For statements whose result isn't needed by the caller, e.g. DML.
+  // With a pipeline depth of 2 or more the statement is only sent, and the
+  // pipeline callback active at this point receives its result later, during
+  // a subsequent call on this connection. Otherwise it is executed
+  // synchronously, and SqlException is thrown if it fails.
+  // onComplete receives the result of this statement in both cases, before
+  // the pipeline callback, e.g. for per-table statistics. It has to own what
+  // it uses, the statement can outlive the caller's objects (e.g. a dropped
+  // table).
+  void executeQueryPipelined(std::string const &query,
+                             completion_t onComplete = nullptr) const;
+
+  // Returns the name of the server side prepared statement cached under key
+  // (e.g. action and table name). If there is none, or it was prepared for a
+  // different version of the key, the statement returned by build() is
+  // prepared first. Throws SqlException if preparing fails.
+  // At most preparedLimit statements are kept, the least recently used one is
+  // deallocated first, e.g. the statements of dropped tables.
+  template <typename build_t>
+  std::string const &prepared(std::initializer_list<std::string_view> key,
+                              std::uint64_t version, build_t &&build) {
+    if (auto const *name = findPrepared(key, version)) {
+      return *name;
+    }
+    return prepare(version, build());
+  }
+
+  [[nodiscard]] QueryResult
+  executePrepared(std::string const &name,
+                  std::span<std::string const> params) const;
+
+  // Same as executeQueryPipelined, for prepared statements
+  void executePreparedPipelined(std::string const &name,
+                                std::span<std::string const> params,
+                                completion_t onComplete = nullptr) const;
+
+  // COPY ... FROM STDIN, only the statement is logged, and it isn't traced as
+  // it can't be replayed without the data
+  [[nodiscard]] QueryResult copyFrom(std::string const &query,
+                                     copy_producer_t const &producer) const;
+
+  // Maximum number of cached prepared statements, at least 1
+  void setPreparedLimit(std::size_t limit);
+
+  // Maximum number of statements in flight, 0 or 1 disables pipelining
+  void setPipelineDepth(std::size_t depth);
+  void setPipelineCallback(completion_t callback);
+
+  // Receives all pending results
+  void flushPipeline() const;
+
+  // Number of statements sent in pipeline mode since the connection was
+  // created
+  std::size_t pipelinedStatements() const;
+
   [[nodiscard]] std::optional<std::string_view>
   querySingleValue(const std::string &sql) const;
 
   void reconnect();
 
+  // Server round trip time of all statements executed since the last reset
+  std::chrono::nanoseconds serverTime() const;
+  void resetServerTime();
+
+  // Scratch buffer of the worker using this connection, for building its
+  // statements with SqlBuilder. The content is only valid until the next
+  // statement is built into it.
+  std::string &sqlBuffer();
+
+  // Identifies the source of the statements in the binary trace
+  void setTraceWorker(std::uint32_t worker);
+  void setTraceAction(std::string_view action);
+
 private:
+  struct PendingQuery {
+    // The text of prepared statements is only rendered if it is logged or
+    // traced. Otherwise name and params are kept, and it's rendered when the
+    // statement fails.
+    std::string query;
+    std::string name;
+    std::vector<std::string> params;
+    bool logged;
+    std::chrono::steady_clock::time_point start;
+    std::string traceAction;
+    completion_t onStatement;
+    completion_t onComplete;
+  };
+
   std::unique_ptr<GenericSQL> sql;
-  std::shared_ptr<spdlog::logger> logger;
+  logging::StatementLog log;
+  mutable std::chrono::nanoseconds accumulatedServerTime{0};
+
+  std::unique_ptr<trace::TraceWriter> trace;
+  std::uint32_t traceWorker = 0;
+  std::string traceAction;
+
+  struct PreparedStatement {
+    std::string name;
+    std::uint64_t version;
+    // preparedUses at the last lookup
+    std::uint64_t lastUsed;
+  };
+
+  struct StringHash {
+    using is_transparent = void;
+    std::size_t operator()(std::string_view str) const {
+      return std::hash<std::string_view>{}(str);
+    }
+  };
+
+  // key parts separated by \0
+  std::unordered_map<std::string, PreparedStatement, StringHash,
+                     std::equal_to<>>
+      preparedStatements;
+  std::string preparedKey;
+  std::size_t preparedCount = 0;
+  std::uint64_t preparedUses = 0;
+  std::size_t preparedLimit = 1024;
+
+  std::size_t pipelineDepth = 0;
+  completion_t pipelineCallback;
+  // ring of the statements in flight, the slots (and their strings) are
+  // reused for the next statements
+  mutable std::vector<PendingQuery> pending;
+  mutable std::size_t pendingFirst = 0;
+  mutable std::size_t pendingCount = 0;
+  mutable std::size_t pipelinedCount = 0;
+
+  std::string statementBuffer;
+  // text of the executed prepared statements for the log and the trace, see
+  // renderPrepared()
+  mutable std::string logText;
+
+  std::string const *findPrepared(std::initializer_list<std::string_view> key,
+                                  std::uint64_t version);
+  std::string const &prepare(std::uint64_t version, std::string const &query);
+  // Deallocates the least recently used statement
+  void evictPrepared();
+  // Renders the EXECUTE text of the prepared statement into text if it is
+  // logged or traced, returns if it is logged. Rendering all statements would
+  // cost as much as building them without prepared statements.
+  bool renderPrepared(std::string &text, std::string const &name,
+                      std::span<std::string const> params) const;
+
+  bool pipelined() const;
+  // Free slot at the end of the ring, its query is cleared
+  PendingQuery &nextPending() const;
+  void queuePipelined(PendingQuery &slot, bool logged,
+                      std::chrono::steady_clock::time_point start,
+                      completion_t onStatement) const;
+  void receivePipelined() const;
+  void completed(std::string_view query, bool logged,
+                 std::chrono::steady_clock::time_point start,
+                 std::string_view action, QueryResult const &res) const;
 };
 
 } // namespace sql_variant
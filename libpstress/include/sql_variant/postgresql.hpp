@@ -1,9 +1,14 @@
 
 #pragma once
 
+#include <chrono>
+#include <deque>
+
 #include "sql_variant/generic.hpp"
 
 struct PostgreSQL;
+struct pg_conn;
+struct pg_result;
 
 namespace pqxx {
 class connection;
@@ -31,10 +36,43 @@ public:
 
   void reconnect() override;
 
+  QueryResult prepare(std::string const &name,
+                      std::string const &query) const override;
+
+  QueryResult
+  executePrepared(std::string const &name,
+                  std::span<std::string const> params) const override;
+
+  QueryResult copyFrom(std::string const &query,
+                       copy_producer_t const &producer) const override;
+
+  bool pipelineSupported() const override;
+
+  void pipelineSend(std::string const &query) override;
+
+  void pipelineSendPrepared(std::string const &name,
+                            std::span<std::string const> params) override;
+
+  QueryResult pipelineReceive() override;
+
 private:
   ServerParams params;
   std::unique_ptr<pqxx::connection> connection;
+  // libpq handle of the connection, owned by pqxx, used for pipeline mode
+  pg_conn *raw = nullptr;
+  // send times of the statements in the pipeline
+  std::deque<std::chrono::high_resolution_clock::time_point> inFlight;
+  // parameter pointers of the last prepared statement execution
+  mutable std::vector<char const *> paramBuffer;
 
   ServerInfo calculateServerInfo() const;
+
+  void connect();
+  // Pipeline mode has to be left before pqxx can use the connection again
+  void exitPipeline() const;
+  // Takes ownership of the libpq result
+  QueryResult
+  makeResult(pg_result *res,
+             std::chrono::high_resolution_clock::time_point executedAt) const;
 };
 } // namespace sql_variant
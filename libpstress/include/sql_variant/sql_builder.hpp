@@ -0,0 +1,72 @@
+#pragma once
+
+#include <charconv>
+#include <concepts>
+#include <string>
+#include <string_view>
+
+namespace sql_variant {
+
+/* Appends SQL text to a buffer owned by the caller. The buffer keeps its
+ * capacity between statements, so once it grew to the size of the largest
+ * statement, building one doesn't allocate. Workers build their statements
+ * into the buffer of their connection, see LoggedSQL::sqlBuffer().
+ * */
+class SqlBuilder {
+public:
+  // Clears the buffer, keeping its capacity
+  explicit SqlBuilder(std::string &buffer) : buffer(buffer) { buffer.clear(); }
+
+  SqlBuilder &operator<<(std::string_view text) {
+    buffer += text;
+    return *this;
+  }
+
+  SqlBuilder &operator<<(char c) {
+    buffer += c;
+    return *this;
+  }
+
+  template <std::integral T>
+    requires(!std::same_as<T, bool> && !std::same_as<T, char>)
+  SqlBuilder &operator<<(T value) {
+    char digits[24];
+    const auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+    buffer.append(digits, end);
+    return *this;
+  }
+
+  // Names of the metadata are stored the way they are written in SQL (quoted
+  // by the server when adopted), they are appended as they are
+  SqlBuilder &identifier(std::string_view name) { return *this << name; }
+
+  // Single quoted string literal
+  SqlBuilder &literal(std::string_view value);
+
+  // Placeholder of a prepared statement parameter, numbered from 1
+  SqlBuilder &parameter(std::size_t number) { return *this << '$' << number; }
+
+  // Appends every item with append(*this, item), separated by separator
+  template <typename range_t, typename append_t>
+  SqlBuilder &list(range_t const &items, std::string_view separator,
+                   append_t &&append) {
+    bool first = true;
+    for (auto const &item : items) {
+      if (!first) {
+        buffer += separator;
+      }
+      append(*this, item);
+      first = false;
+    }
+    return *this;
+  }
+
+  std::string const &str() const { return buffer; }
+
+  std::string_view view() const { return buffer; }
+
+private:
+  std::string &buffer;
+};
+
+} // namespace sql_variant
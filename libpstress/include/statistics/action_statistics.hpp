@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "statistics/histogram.hpp"
+
+namespace statistics {
+
+// Statistics of a single action type, recorded by a single worker
+struct ActionStatistics {
+  // End-to-end time of successful actions, as measured by the worker
+  Histogram actionTime;
+  // Time spent waiting for the server during successful actions
+  Histogram serverTime;
+
+  std::atomic<std::uint64_t> successes = 0;
+  std::atomic<std::uint64_t> failures = 0;
+  // actions which found nothing to do, see action::ActionSkipped
+  std::atomic<std::uint64_t> skips = 0;
+
+  void recordSuccess(std::chrono::nanoseconds action,
+                     std::chrono::nanoseconds server);
+  // errorCode is the SQLSTATE of the failure, empty if it wasn't an SQL error
+  void recordFailure(std::string_view errorCode = {});
+  void recordSkip();
+
+  void reset();
+
+  // Failures per error code, can be called from any thread
+  void mergeErrorsInto(std::map<std::string, std::uint64_t> &snapshot) const;
+
+private:
+  // Same single writer scheme as WorkerStatistics::actions
+  mutable std::mutex errorsMutex;
+  std::map<std::string, std::unique_ptr<std::atomic<std::uint64_t>>,
+           std::less<>>
+      errors;
+};
+
+struct ActionSnapshot {
+  HistogramSnapshot actionTime;
+  HistogramSnapshot serverTime;
+  std::uint64_t successes = 0;
+  std::uint64_t failures = 0;
+  std::uint64_t skips = 0;
+  // error code -> failures
+  std::map<std::string, std::uint64_t> errors;
+
+  void merge(ActionStatistics const &stats);
+  void merge(ActionSnapshot const &other);
+  void subtract(ActionSnapshot const &earlier);
+};
+
+// action name -> statistics
+using snapshot_t = std::map<std::string, ActionSnapshot>;
+
+// Per worker collection of action statistics.
+// Only the owning worker thread records, but snapshots can be taken from any
+// thread at any time, without stopping the worker.
+class WorkerStatistics {
+public:
+  // Only the owning worker thread is allowed to call this
+  ActionStatistics &action(std::string const &name);
+
+  // Merges the current state into the snapshot, can be called from any thread
+  void mergeInto(snapshot_t &snapshot) const;
+
+  void reset();
+
+private:
+  // Protects insertion into the map. The owning thread can do lookups without
+  // holding it, as it is the only thread that modifies the map.
+  mutable std::mutex mutex;
+  std::map<std::string, std::unique_ptr<ActionStatistics>> actions;
+};
+
+// Removes the earlier snapshot from the current, leaving only the statistics
+// of the interval between the two
+void subtract(snapshot_t &current, snapshot_t const &earlier);
+
+void logReport(std::string const &title, snapshot_t const &snapshot,
+               std::chrono::duration<double> interval);
+
+} // namespace statistics
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+/*
+  Latency histograms
+  ==================
+
+  A log-linear (HDR style) histogram: values below 128 are counted exactly,
+  above that every power of two range is split into 64 equal buckets. This
+  keeps the relative error under 1.6% for the entire range, while the whole
+  histogram is a fixed size array of counters.
+
+  Values are recorded in microseconds, up to ~71 minutes. Larger values are
+  counted in the last bucket.
+
+  Histogram is written by a single thread (the worker owning it), and can be
+  read concurrently by any number of reporter threads. Recording doesn't use
+  read-modify-write atomic operations, only relaxed loads and stores, so it
+  is as cheap as incrementing a plain counter.
+
+  Readers take a HistogramSnapshot, which is a plain copy of the counters.
+  Snapshots from multiple workers can be merged, and subtracted from each
+  other to get statistics for a time interval.
+*/
+
+namespace statistics {
+
+namespace limits {
+const constexpr unsigned histogram_sub_bucket_bits = 6;
+const constexpr unsigned histogram_max_value_bits = 32;
+const constexpr std::size_t histogram_bucket_count =
+    (histogram_max_value_bits - histogram_sub_bucket_bits + 1)
+    << histogram_sub_bucket_bits;
+} // namespace limits
+
+class HistogramSnapshot;
+
+class Histogram {
+public:
+  Histogram();
+
+  Histogram(Histogram const &) = delete;
+  Histogram &operator=(Histogram const &) = delete;
+
+  // Only one thread is allowed to call record
+  void record(std::uint64_t microseconds);
+
+  template <typename Rep, typename Period>
+  void record(std::chrono::duration<Rep, Period> duration) {
+    const auto us =
+        std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    record(static_cast<std::uint64_t>(us > 0 ? us : 0));
+  }
+
+  // Not safe to call concurrently with record
+  void reset();
+
+  static std::size_t bucketIndex(std::uint64_t value);
+  // Lowest value counted in the specified bucket
+  static std::uint64_t bucketLowestValue(std::size_t index);
+  // Highest value counted in the specified bucket
+  static std::uint64_t bucketHighestValue(std::size_t index);
+
+private:
+  std::array<std::atomic<std::uint64_t>, limits::histogram_bucket_count>
+      counts;
+  std::atomic<std::uint64_t> totalCount;
+  std::atomic<std::uint64_t> totalSum;
+  std::atomic<std::uint64_t> maxValue;
+
+  friend class HistogramSnapshot;
+};
+
+class HistogramSnapshot {
+public:
+  HistogramSnapshot();
+
+  // Adds the current state of the histogram to this snapshot
+  void merge(Histogram const &histogram);
+  void merge(HistogramSnapshot const &other);
+
+  // Removes an earlier snapshot of the same histogram(s), the result contains
+  // only the values recorded since then
+  void subtract(HistogramSnapshot const &earlier);
+
+  std::uint64_t count() const;
+  std::uint64_t sum() const;
+  std::uint64_t max() const;
+  double mean() const;
+
+  // percentile in the [0, 100] range, returns the highest equivalent value of
+  // the bucket containing it
+  std::uint64_t percentile(double percentile) const;
+
+private:
+  std::vector<std::uint64_t> counts;
+  std::uint64_t totalCount = 0;
+  std::uint64_t totalSum = 0;
+  std::uint64_t maxValue = 0;
+};
+
+} // namespace statistics
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+#include "statistics/action_statistics.hpp"
+
+namespace statistics {
+
+enum class TimeSeriesFormat { csv, json };
+
+// Writes the statistics of consecutive intervals of a run, one line per
+// action and interval, flushed after every interval so the file can be
+// followed while the run is going.
+// Failures are broken down by SQLSTATE, failures without one (e.g. client side
+// errors) are listed as "other".
+class TimeSeriesWriter {
+public:
+  // Files ending in .csv are written as CSV with a header line, everything
+  // else as JSON lines. Throws std::runtime_error if the file can't be opened.
+  explicit TimeSeriesWriter(std::filesystem::path const &path);
+
+  // interval contains only the statistics of the interval, which ended at
+  // timestamp, elapsed after the start of the run
+  void write(std::chrono::system_clock::time_point timestamp,
+             std::chrono::duration<double> elapsed,
+             snapshot_t const &interval);
+
+private:
+  std::ofstream stream;
+  TimeSeriesFormat format;
+};
+
+} // namespace statistics
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sql_variant/generic.hpp"
+
+namespace trace {
+
+struct ReplayParams {
+  std::vector<std::filesystem::path> traces;
+  // 1 is the original timing, 2 is twice as fast, ...
+  // 0 executes statements as fast as possible, only keeping the per connection
+  // order
+  double speed = 1.0;
+};
+
+struct ReplayResult {
+  std::size_t statements = 0;
+  std::size_t errors = 0;
+  // statements where the outcome (sqlstate) differs from the original
+  std::size_t mismatches = 0;
+};
+
+using replay_connect_t = std::function<std::unique_ptr<sql_variant::LoggedSQL>(
+    std::string const &connectionName)>;
+
+// Replays every trace on a separate connection and thread, keeping the
+// original relative timing between all connections (scaled by speed)
+ReplayResult replay(ReplayParams const &params, replay_connect_t connect);
+
+} // namespace trace
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "logging/async_writer.hpp"
+
+/*
+  Statement traces
+  ================
+
+  A binary, replayable record of every statement executed on a connection.
+  Each connection writes its own file (logs/trace-conn-<name>.bin), through the
+  asynchronous log writer.
+
+  Format (native byte order):
+
+    file header:  "PSTRACE\\0"  magic
+                  u32         format version
+                  u32         connection name length
+                  bytes       connection name
+    records:      u32         record size, including this field
+                  i64         start timestamp, nanoseconds since the trace epoch
+                  i64         duration in nanoseconds
+                  u32         worker id (0 for non workload connections)
+                  char[5]     sqlstate, zeroes on success
+                  u8          status (sql_variant::SqlStatus)
+                  u16         action name length
+                  u32         statement length
+                  bytes       action name
+                  bytes       statement
+
+  The trace epoch is shared by every connection of the process, so traces of
+  different connections can be replayed with the original relative timing.
+
+  Files are opened for appending: a rerun with the same logs directory, or a
+  second connection with the same name, continues the file with its own
+  header. The reader skips these embedded headers and reads the file as one
+  trace, the timestamps of every part are relative to its own process.
+*/
+
+namespace trace {
+
+class TraceException : public std::exception {
+public:
+  TraceException(std::string const &message) : message(message) {}
+
+  const char *what() const noexcept override { return message.c_str(); }
+
+private:
+  std::string message;
+};
+
+const constexpr std::array<char, 8> trace_magic = {'P', 'S', 'T', 'R',
+                                                   'A', 'C', 'E', '\0'};
+const constexpr std::uint32_t trace_version = 1;
+
+// Process wide start point of trace timestamps
+std::chrono::steady_clock::time_point epoch();
+
+struct Record {
+  std::chrono::nanoseconds timestamp{0};
+  std::chrono::nanoseconds duration{0};
+  std::uint32_t worker = 0;
+  std::array<char, 5> sqlstate{};
+  std::uint8_t status = 0;
+  std::string_view action;
+  std::string_view statement;
+
+  std::string_view sqlstateView() const;
+};
+
+class TraceWriter {
+public:
+  explicit TraceWriter(std::string const &connectionName);
+
+  // Only one thread is allowed to write at the same time
+  void write(Record const &record);
+
+private:
+  std::shared_ptr<logging::LogStream> stream;
+};
+
+// Reads a trace file using a read only memory mapping
+class TraceReader {
+public:
+  explicit TraceReader(std::filesystem::path const &path);
+  ~TraceReader();
+
+  TraceReader(TraceReader const &) = delete;
+  TraceReader &operator=(TraceReader const &) = delete;
+
+  std::string const &connectionName() const;
+
+  // The record references the mapped file, and is valid while the reader
+  // exists. Returns false at the end of the trace.
+  bool next(Record &record);
+
+  // Timestamp of the first record, without consuming it
+  std::optional<std::chrono::nanoseconds> firstTimestamp() const;
+
+private:
+  std::filesystem::path path;
+  char const *data = nullptr;
+  std::size_t size = 0;
+  std::size_t position = 0;
+  std::size_t firstRecord = 0;
+  std::string connectionName_;
+
+  // Position after the file headers at pos, if there are any
+  std::size_t skipHeaders(std::size_t pos) const;
+};
+
+} // namespace trace
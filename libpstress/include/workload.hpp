@@ -1,34 +1,80 @@
 
 #pragma once
 
+#include <chrono>
+#include <filesystem>
+#include <functional>
 #include <thread>
 
 #include "action/action_registry.hpp"
+#include "arrival_schedule.hpp"
 #include "metadata.hpp"
+#include "schema_reconciler.hpp"
 #include "sql_variant/generic.hpp"
+#include "statistics/action_statistics.hpp"
+#include "statistics/time_series.hpp"
 
 using logged_sql_ptr = std::unique_ptr<sql_variant::LoggedSQL>;
 
 using metadata_ptr = std::shared_ptr<metadata::Metadata>;
 
+// Opens additional connections, e.g. for parallel initialization. Only called
+// on the thread owning the Lua state, as it can run Lua callbacks.
+using connection_factory_t =
+    std::function<logged_sql_ptr(std::string const &connection_name)>;
+
 struct WorkloadParams {
   std::size_t duration_in_seconds;
   std::size_t repeat_times;
   std::size_t number_of_workers;
+  // 0 disables periodic reports, the end of run report is always logged
+  std::size_t report_interval_in_seconds = 0;
+  // maximum number of DML statements in flight per worker, 0 or 1 disables
+  // pipelining
+  std::size_t pipeline_depth = 0;
+  // actions per second of the whole workload, split evenly between the
+  // workers. 0 runs closed loop workers, which start the next action as soon
+  // as the previous one returns.
+  double target_rate = 0;
+  Arrival arrival = Arrival::uniform;
+  // per second statistics of every action are written to this file during
+  // the run, see statistics::TimeSeriesWriter. Empty disables it.
+  std::string time_series_file;
+  // compares the tracked tables with the database catalog every N seconds
+  // during the run, and corrects the drift, see metadata::reconcileSchema. 0
+  // disables it.
+  std::size_t reconcile_interval_in_seconds = 0;
+};
+
+struct InitialDataParams {
+  // rows per table
+  std::size_t rows = 1000;
+  // approximate size of the data per table in bytes, overrides rows if set
+  std::size_t size = 0;
+  // number of parallel connections, each with its own thread
+  std::size_t threads = 1;
+  // tables are split into chunks of this many rows, threads take the next
+  // unprocessed chunk when they finish one
+  std::size_t chunk_rows = 100000;
+  // 0 disables progress reports
+  std::size_t progress_interval_in_seconds = 5;
 };
 
+
 class Worker {
 public:
   Worker(std::string const &name, logged_sql_ptr sql_conn,
-         action::AllConfig config, metadata_ptr metadata);
+         action::AllConfig config, metadata_ptr metadata,
+         connection_factory_t connection_factory = nullptr);
 
   Worker(Worker &&) = default;
 
   virtual ~Worker();
 
-  void create_random_tables(std::size_t count);
+  // threads > 1 creates the tables using multiple connections in parallel
+  void create_random_tables(std::size_t count, std::size_t threads = 1);
 
-  void generate_initial_data();
+  void generate_initial_data(InitialDataParams const &params = {});
 
   sql_variant::LoggedSQL *sql_connection() const;
 
@@ -39,15 +85,25 @@ protected:
   logged_sql_ptr sql_conn;
   action::AllConfig config;
   metadata_ptr metadata;
+  // stream named after the worker, see ps_random
   ps_random rand;
   std::shared_ptr<spdlog::logger> logger;
+  connection_factory_t connection_factory;
+
+  // Executes job on this worker's connection in the calling thread, and on
+  // threads - 1 additional connections, each in its own thread. The
+  // additional connections are opened by the calling thread.
+  void parallel(std::size_t threads,
+                std::function<void(sql_variant::LoggedSQL *, ps_random &)> const
+                    &job);
 };
 
 class RandomWorker : public Worker {
 public:
   RandomWorker(std::string const &name, logged_sql_ptr sql_conn,
                action::AllConfig const &config, metadata_ptr metadata,
-               action::ActionRegistry const &actions);
+               action::ActionRegistry const &actions,
+               connection_factory_t connection_factory = nullptr);
 
   RandomWorker(RandomWorker &&) = default;
 
@@ -57,13 +113,31 @@ public:
 
   void join();
 
+  // Switches the worker to open loop mode with the given rate in actions per
+  // second, 0 switches back to closed loop. Takes effect at the next run.
+  void setTargetRate(double rate, Arrival arrival);
+
   action::ActionRegistry &possibleActions();
 
+  statistics::WorkerStatistics const &actionStatistics() const;
+
 protected:
   action::ActionRegistry actions;
   std::thread thread;
   std::size_t successfulActions = 0;
   std::size_t failedActions = 0;
+  std::size_t skippedActions = 0;
+  double targetRate = 0;
+  Arrival arrival = Arrival::uniform;
+  // pointer, as workers are movable, and statistics are read by the reporter
+  std::unique_ptr<statistics::WorkerStatistics> stats;
+
+private:
+  // Accounts the result of a pipelined action, latency is measured by the
+  // caller
+  void recordPipelined(statistics::ActionStatistics &actionStats,
+                       sql_variant::QueryResult const &res,
+                       std::chrono::nanoseconds latency);
 };
 
 class SqlFactory {
@@ -71,17 +145,22 @@ public:
   using on_connect_t = std::function<void(sql_variant::LoggedSQL const &)>;
 
   SqlFactory(sql_variant::ServerParams const &sql_params,
-             on_connect_t connection_callback);
+             on_connect_t connection_callback,
+             logging::StatementLogPolicy const &log_policy = {});
 
   std::unique_ptr<sql_variant::LoggedSQL>
   connect(std::string const &connection_name) const;
 
+  // Returns a factory using a copy of this
+  connection_factory_t connectionFactory() const;
+
   sql_variant::ServerParams const &params() const;
 
 private:
   // postgres / mysql selector
   sql_variant::ServerParams sql_params;
   on_connect_t connection_callback;
+  logging::StatementLogPolicy log_policy;
 };
 
 class Workload {
@@ -101,16 +180,34 @@ public:
 
   void reconnect_workers();
 
+  // Merged statistics of all workers, since the start of the current run
+  statistics::snapshot_t actionStatistics() const;
+
 private:
   std::size_t duration_in_seconds;
   std::size_t repeat_times;
+  std::size_t report_interval_in_seconds;
   std::vector<RandomWorker> workers;
   action::ActionRegistry actions;
+  std::chrono::steady_clock::time_point runStarted;
+  std::jthread reporter;
+  std::unique_ptr<statistics::TimeSeriesWriter> timeSeries;
+  std::jthread timeSeriesRecorder;
+  metadata_ptr metadata;
+  std::size_t reconcile_interval_in_seconds;
+  logged_sql_ptr reconciler_conn;
+  std::jthread reconciler;
+
+  void report_periodically(std::stop_token stop);
+  void record_time_series(std::stop_token stop);
+  void reconcile_periodically(std::stop_token stop);
 };
 
 class Node {
 public:
-  Node(SqlFactory const &sql_factory);
+  Node(SqlFactory const &sql_factory,
+       std::size_t maximum_table_count =
+           metadata::limits::default_maximum_table_count);
 
   std::shared_ptr<Workload> init_random_workload(WorkloadParams const &wp);
 
@@ -118,6 +215,22 @@ public:
 
   action::ActionRegistry &possibleActions();
 
+  // Copied by init_random_workload, later changes only affect new workloads
+  action::AllConfig &defaultConfig();
+
+  metadata::Metadata const &tables() const;
+
+  // Adds the existing tables matching the filter to the metadata, see
+  // metadata::adoptSchema. Returns the number of tables added.
+  std::size_t adopt_schema(metadata::CatalogFilter const &filter);
+
+  // Saves the tracked tables, see metadata_snapshot.hpp
+  void save_metadata(std::filesystem::path const &path) const;
+
+  // Restores the tables saved by save_metadata, and reconciles them with the
+  // database. Returns false if the snapshot doesn't exist.
+  bool load_metadata(std::filesystem::path const &path);
+
   sql_variant::ServerParams const &sql_params() const;
 
 private:
@@ -1,6 +1,4 @@
 
-#include <numeric>
-
 #include "action/action_registry.hpp"
 #include "action/dml.hpp"
 
@@ -66,29 +64,129 @@ ActionRegistry defaultRegistryInstance = initializeDefaultRegisty();
 
 namespace action {
 
-ActionRegistry::ActionRegistry() {};
+ActionSelection::ActionSelection(std::vector<ActionFactory> factories)
+    : factories_(std::move(factories)) {
+  const auto count = factories_.size();
+  for (auto const &f : factories_) {
+    totalWeight_ += f.weight;
+  }
+  if (totalWeight_ == 0) {
+    return;
+  }
+
+  // Every bucket has a capacity of totalWeight, weights are scaled by count
+  threshold.resize(count);
+  alias.resize(count);
+  std::vector<std::size_t> scaled(count);
+  std::vector<std::size_t> small;
+  std::vector<std::size_t> large;
+  for (std::size_t idx = 0; idx < count; ++idx) {
+    scaled[idx] = factories_[idx].weight * count;
+    (scaled[idx] < totalWeight_ ? small : large).push_back(idx);
+  }
+
+  while (!small.empty() && !large.empty()) {
+    const auto less = small.back();
+    small.pop_back();
+    const auto more = large.back();
+    large.pop_back();
+
+    threshold[less] = scaled[less];
+    alias[less] = more;
+
+    scaled[more] = scaled[more] + scaled[less] - totalWeight_;
+    (scaled[more] < totalWeight_ ? small : large).push_back(more);
+  }
+
+  // what remains is a full bucket
+  for (auto idx : small) {
+    threshold[idx] = totalWeight_;
+    alias[idx] = idx;
+  }
+  for (auto idx : large) {
+    threshold[idx] = totalWeight_;
+    alias[idx] = idx;
+  }
+}
+
+ActionFactory const *ActionSelection::select(ps_random &rand) const {
+  const auto idx = selectIndex(rand);
+  return idx == npos ? nullptr : &factories_[idx];
+}
+
+std::size_t ActionSelection::selectIndex(ps_random &rand) const {
+  if (totalWeight_ == 0) {
+    return npos;
+  }
+
+  const auto bucket =
+      rand.random_number(std::size_t(0), factories_.size() - 1);
+  const auto offset = rand.random_number(std::size_t(0), totalWeight_ - 1);
+
+  return offset < threshold[bucket] ? bucket : alias[bucket];
+}
+
+std::vector<ActionFactory> const &ActionSelection::factories() const {
+  return factories_;
+}
+
+std::size_t ActionSelection::totalWeight() const { return totalWeight_; }
+
+ActionReference::ActionReference(ActionRegistry &registry,
+                                 std::string const &name)
+    : registry(registry), name(name) {}
+
+std::size_t ActionReference::weight() const { return registry[name].weight; }
+
+void ActionReference::setWeight(std::size_t weight) {
+  registry.setWeight(name, weight);
+}
+
+ActionRegistry::ActionRegistry() { publish(); };
 
 ActionRegistry::ActionRegistry(ActionRegistry const &o) {
   std::unique_lock<std::mutex> lk(o.mutex);
   factories = o.factories;
+  selection = o.selection;
 };
 
 ActionRegistry::ActionRegistry(ActionRegistry &&o) {
   std::unique_lock<std::mutex> lk(o.mutex);
   factories = std::move(o.factories);
+  selection = o.selection;
+  o.publish();
 };
 
 ActionRegistry &ActionRegistry::operator=(ActionRegistry const &o) {
+  if (this == &o) {
+    return *this;
+  }
+  std::scoped_lock lk(mutex, o.mutex);
   factories = o.factories;
+  // snapshots are immutable, they can be shared
+  selection = o.selection;
+  generation_++;
   return *this;
 }
 
 ActionRegistry &ActionRegistry::operator=(ActionRegistry &&o) {
-  std::unique_lock<std::mutex> lk(o.mutex);
+  if (this == &o) {
+    return *this;
+  }
+  std::scoped_lock lk(mutex, o.mutex);
   factories = std::move(o.factories);
+  selection = o.selection;
+  generation_++;
+  o.factories.clear();
+  o.publish();
   return *this;
 }
 
+void ActionRegistry::publish() {
+  selection = std::make_shared<const ActionSelection>(factories);
+  generation_++;
+}
+
 std::size_t ActionRegistry::insert(ActionFactory const &action) {
 
   std::unique_lock<std::mutex> lk(mutex);
@@ -102,6 +200,7 @@ std::size_t ActionRegistry::insert(ActionFactory const &action) {
   }
 
   factories.push_back(action);
+  publish();
   return factories.size() - 1;
 }
 
@@ -116,6 +215,7 @@ void ActionRegistry::remove(std::string const &name) {
   }
 
   factories.erase(it);
+  publish();
 }
 
 ActionFactory ActionRegistry::operator[](std::string const &name) const {
@@ -130,7 +230,15 @@ ActionFactory ActionRegistry::operator[](std::string const &name) const {
   return *it;
 }
 
-ActionFactory &ActionRegistry::getReference(std::string const &name) {
+ActionReference ActionRegistry::getReference(std::string const &name) {
+  if (!has(name)) {
+    throw ActionException(
+        fmt::format("Action {} does not exists in this registy", name));
+  }
+  return ActionReference(*this, name);
+}
+
+void ActionRegistry::setWeight(std::string const &name, std::size_t weight) {
   std::unique_lock<std::mutex> lk(mutex);
 
   auto it = std::find_if(factories.begin(), factories.end(),
@@ -139,8 +247,9 @@ ActionFactory &ActionRegistry::getReference(std::string const &name) {
     throw ActionException(
         fmt::format("Action {} does not exists in this registy", name));
   }
-  // TODO issue: lock no longer held after return, detected by tsan
-  return *it;
+
+  it->weight = weight;
+  publish();
 }
 
 std::size_t ActionRegistry::size() const {
@@ -150,12 +259,7 @@ std::size_t ActionRegistry::size() const {
 }
 
 std::size_t ActionRegistry::totalWeight() const {
-  std::unique_lock<std::mutex> lk(mutex);
-
-  return std::accumulate(
-      factories.begin(), factories.end(), 0,
-      [](int const &a, ActionFactory const &b) { return a + b.weight; });
-  ;
+  return snapshot()->totalWeight();
 }
 
 bool ActionRegistry::has(std::string name) const {
@@ -166,23 +270,12 @@ bool ActionRegistry::has(std::string name) const {
   return it != factories.end();
 }
 
-ActionFactory const &
-ActionRegistry::lookupByWeightOffset(std::size_t offset) const {
-  std::unique_lock<std::mutex> lk(mutex);
-
-  std::size_t accum = 0;
-  auto it =
-      std::find_if(factories.begin(), factories.end(), [&](auto const &f) {
-        accum += f.weight;
-        return accum >= offset;
-      });
+std::uint64_t ActionRegistry::generation() const { return generation_; }
 
-  if (it == factories.end()) {
-    throw ActionException(
-        fmt::format("Weight offset {} is outside of this registy", offset));
-  }
+selection_cptr ActionRegistry::snapshot() const {
+  std::unique_lock<std::mutex> lk(mutex);
 
-  return *it;
+  return selection;
 }
 
 void ActionRegistry::makeCustomSqlAction(std::string const &name,
@@ -1,10 +1,16 @@
 
 #include "action/custom.hpp"
 
-#include <boost/algorithm/string.hpp>
+#include <boost/container/small_vector.hpp>
+
+#include "sql_variant/sql_builder.hpp"
 
 namespace action {
 
+namespace {
+const constexpr std::string_view named_table_prefix = "{table:";
+} // namespace
+
 CustomSql::CustomSql(CustomConfig const &, std::string const &sqlStatement,
                      inject_t injectParameters)
     : sqlStatement(sqlStatement), injectParameters(injectParameters) {
@@ -19,28 +25,75 @@ CustomSql::CustomSql(CustomConfig const &, std::string const &sqlStatement,
 
 void CustomSql::execute(metadata::Metadata &metaCtx, ps_random &rand,
                         sql_variant::LoggedSQL *connection) const {
-  std::string statementCopy = sqlStatement;
-
+  // every occurrence of a parameter gets the same table, kept alive until the
+  // statement is built, even if DDL drops it meanwhile
+  boost::container::small_vector<metadata::table_cptr, 4> values;
   for (auto const &inject : injectParameters) {
-    // TODO: fmt::format doesn't support dynamic parameters, should switch to
-    // fmt
-    boost::replace_all(statementCopy, "{" + inject + "}",
-                       doInject(metaCtx, rand, inject));
+    values.push_back(doInject(metaCtx, rand, inject));
+  }
+
+  // tables addressed by name, {table:name}
+  boost::container::small_vector<metadata::table_cptr, 4> named;
+
+  sql_variant::SqlBuilder sql(connection->sqlBuffer());
+  std::string_view rest = sqlStatement;
+  while (!rest.empty()) {
+    const auto open = rest.find('{');
+    sql << rest.substr(0, open);
+    if (open == std::string_view::npos) {
+      break;
+    }
+    rest.remove_prefix(open);
+
+    std::size_t matched = 0;
+    for (std::size_t idx = 0; idx < values.size() && matched == 0; ++idx) {
+      auto const &inject = *injectParameters.nth(idx);
+      if (rest.size() > inject.size() + 1 &&
+          rest.substr(1, inject.size()) == inject &&
+          rest[inject.size() + 1] == '}') {
+        sql << values[idx]->name;
+        matched = inject.size() + 2;
+      }
+    }
+    if (matched == 0 && rest.starts_with(named_table_prefix)) {
+      const auto close = rest.find('}');
+      if (close != std::string_view::npos) {
+        const auto name = rest.substr(named_table_prefix.size(),
+                                      close - named_table_prefix.size());
+        named.push_back(namedTable(metaCtx, name));
+        sql << named.back()->name;
+        matched = close + 1;
+      }
+    }
+    if (matched == 0) {
+      sql << '{';
+      matched = 1;
+    }
+    rest.remove_prefix(matched);
   }
 
-  connection->executeQuery(statementCopy).maybeThrow();
+  connection->executeQuery(sql.str()).maybeThrow();
+}
+
+metadata::table_cptr CustomSql::namedTable(metadata::Metadata &metaCtx,
+                                          std::string_view name) const {
+  auto table = metaCtx.tableByName(name);
+  if (table == nullptr) {
+    throw std::runtime_error(
+        fmt::format("Table '{}' of custom query is not tracked", name));
+  }
+  return table;
 }
 
-std::string CustomSql::doInject(metadata::Metadata &metaCtx, ps_random &rand,
-                                std::string const &injectionPoint) const {
+metadata::table_cptr
+CustomSql::doInject(metadata::Metadata &metaCtx, ps_random &rand,
+                    std::string const &injectionPoint) const {
   if (injectionPoint == "table") {
-    metadata::table_cptr table;
-    while (table == NULL) {
-      // select a random table from metadata
-      std::size_t idx = rand.random_number<std::size_t>(0, metaCtx.size() - 1);
-      table = metaCtx[idx];
+    auto const &tables = this->tables.get(metaCtx);
+    if (tables.empty()) {
+      throw std::runtime_error("No table to inject into custom query");
     }
-    return table->name;
+    return tables[rand.random_number<std::size_t>(0, tables.size() - 1)];
   }
 
   throw std::runtime_error(
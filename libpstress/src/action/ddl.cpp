@@ -1,10 +1,11 @@
 
 #include "action/ddl.hpp"
 
-#include <boost/algorithm/string/join.hpp>
 #include <fmt/format.h>
 #include <rfl.hpp>
 
+#include "sql_variant/sql_builder.hpp"
+
 using namespace metadata;
 using namespace action;
 
@@ -14,7 +15,7 @@ ColumnType randomColumnType(ps_random &rand) {
   return arr[rand.random_number(std::size_t(0), arr.size() - 1)].second;
 }
 
-std::size_t randomColumnLength(ps_random &rand, ColumnType type) {
+std::uint32_t randomColumnLength(ps_random &rand, ColumnType type) {
   switch (type) {
   case ColumnType::BYTEA:
   case ColumnType::TEXT:
@@ -46,17 +47,16 @@ Column randomColumn(ps_random &rand, bool forceSerial = false) {
   return col;
 }
 
-std::string columnDefinition(Column const &col) {
+void appendColumnDefinition(sql_variant::SqlBuilder &sql, Column const &col) {
+  sql.identifier(col.name) << " ";
   if (col.auto_increment) {
     // assert that this is an int type
-    return fmt::format("{} {}", col.name, "SERIAL");
+    sql << "SERIAL";
   } else {
-    std::string def =
-        fmt::format("{} {}", col.name, rfl::enum_to_string(col.type));
+    sql << rfl::enum_to_string(col.type);
     if (col.length > 0) {
-      def += fmt::format("({})", col.length);
+      sql << "(" << col.length << ")";
     }
-    return def;
   }
 }
 
@@ -68,8 +68,7 @@ CreateTable::CreateTable(DdlConfig const &config, Table::Type type)
 void CreateTable::execute(Metadata &metaCtx, ps_random &rand,
                           sql_variant::LoggedSQL *connection) const {
   if (metaCtx.size() >= config.max_table_count) {
-    // log error and skip
-    return;
+    throw ActionSkipped("Maximum table count reached");
   }
 
   metaCtx.createTable([&](Metadata::Reservation &res) {
@@ -92,25 +91,25 @@ void CreateTable::execute(Metadata &metaCtx, ps_random &rand,
 
     // 2: build & execute SQL statement
 
-    std::vector<std::string> defs;
-    std::vector<std::string> pk_columns;
+    sql_variant::SqlBuilder sql(connection->sqlBuffer());
+    sql << "CREATE TABLE ";
+    sql.identifier(table->name) << " (";
+    sql.list(table->columns, ",\n", appendColumnDefinition);
 
+    bool hasPk = false;
     for (auto const &col : table->columns) {
       if (col.primary_key) {
-        pk_columns.push_back(col.name);
+        sql << (hasPk ? ", " : ",\nPRIMARY KEY (");
+        sql.identifier(col.name);
+        hasPk = true;
       }
-      defs.push_back(columnDefinition(col));
     }
-
-    if (!pk_columns.empty()) {
-      defs.push_back(fmt::format("PRIMARY KEY ({})",
-                                 boost::algorithm::join(pk_columns, ", ")));
+    if (hasPk) {
+      sql << ")";
     }
+    sql << ");";
 
-    connection
-        ->executeQuery(fmt::format("CREATE TABLE {} ({});", table->name,
-                                   boost::algorithm::join(defs, ",\n")))
-        .maybeThrow();
+    connection->executeQuery(sql.str()).maybeThrow();
 
     res.complete();
   });
@@ -121,8 +120,7 @@ DropTable::DropTable(DdlConfig const &config) : config(config) {}
 void DropTable::execute(Metadata &metaCtx, ps_random &rand,
                         sql_variant::LoggedSQL *connection) const {
   if (metaCtx.size() <= config.min_table_count) {
-    // log error and skip
-    return;
+    throw ActionSkipped("Minimum table count reached");
   }
 
   auto idx = rand.random_number(std::size_t(0), metaCtx.size() - 1);
@@ -132,8 +130,10 @@ void DropTable::execute(Metadata &metaCtx, ps_random &rand,
   metaCtx.dropTable(idx, [&](Metadata::Reservation &res) {
     if (!res.open())
       return;
-    connection->executeQuery(fmt::format("DROP TABLE {};", res.table()->name))
-        .maybeThrow();
+    sql_variant::SqlBuilder sql(connection->sqlBuffer());
+    sql << "DROP TABLE ";
+    sql.identifier(res.table()->name) << ";";
+    connection->executeQuery(sql.str()).maybeThrow();
 
     res.complete();
   });
@@ -158,7 +158,16 @@ void AlterTable::execute(Metadata &metaCtx, ps_random &rand,
     const auto howManySubcommands =
         rand.random_number(std::size_t(1), config.max_alter_clauses);
 
-    std::vector<std::string> alterSubcommands;
+    sql_variant::SqlBuilder sql(connection->sqlBuffer());
+    sql << "ALTER TABLE ";
+    sql.identifier(table->name) << " \n ";
+    bool first = true;
+    auto nextSubcommand = [&]() -> sql_variant::SqlBuilder & {
+      if (!first)
+        sql << ",\n";
+      first = false;
+      return sql;
+    };
 
     std::vector<Column> newColumns;
 
@@ -171,8 +180,7 @@ void AlterTable::execute(Metadata &metaCtx, ps_random &rand,
       switch (commands[cmdIndex]) {
       case AlterSubcommand::addColumn: {
         const auto column = randomColumn(rand);
-        alterSubcommands.emplace_back(
-            fmt::format("ADD COLUMN {}", columnDefinition(column)));
+        appendColumnDefinition(nextSubcommand() << "ADD COLUMN ", column);
         // we can't accidentally modify / drop new columns in the same statement
         newColumns.push_back(column);
         break;
@@ -182,8 +190,8 @@ void AlterTable::execute(Metadata &metaCtx, ps_random &rand,
           continue;
         const auto columnIndex =
             rand.random_number(std::size_t(1), table->columns.size() - 1);
-        alterSubcommands.emplace_back(
-            fmt::format("DROP COLUMN {}", table->columns[columnIndex].name));
+        nextSubcommand() << "DROP COLUMN ";
+        sql.identifier(table->columns[columnIndex].name);
         table->columns.erase(table->columns.begin() + columnIndex);
         break;
       }
@@ -192,8 +200,8 @@ void AlterTable::execute(Metadata &metaCtx, ps_random &rand,
         for (auto const &col : table->columns) {
           if (col.type == metadata::ColumnType::INT ||
               col.type == metadata::ColumnType::REAL) {
-            alterSubcommands.emplace_back(
-                fmt::format("ALTER COLUMN {} TYPE VARCHAR(32)", col.name));
+            nextSubcommand() << "ALTER COLUMN ";
+            sql.identifier(col.name) << " TYPE VARCHAR(32)";
             break;
           }
         }
@@ -204,21 +212,19 @@ void AlterTable::execute(Metadata &metaCtx, ps_random &rand,
           break;
         const auto amIndex = rand.random_number(
             std::size_t(0), config.access_methods.size() - 1);
-        alterSubcommands.emplace_back(fmt::format(
-            "SET ACCESS METHOD {}", config.access_methods[amIndex]));
+        nextSubcommand() << "SET ACCESS METHOD "
+                         << config.access_methods[amIndex];
         changingAm = true;
       }
       }
     }
 
-    table->columns.insert(table->columns.end(), newColumns.begin(),
-                          newColumns.end());
+    for (auto &column : newColumns) {
+      table->columns.push_back(std::move(column));
+    }
 
-    connection
-        ->executeQuery(
-            fmt::format("ALTER TABLE {} \n {};", res.table()->name,
-                        boost::algorithm::join(alterSubcommands, ",\n")))
-        .maybeThrow();
+    sql << ";";
+    connection->executeQuery(sql.str()).maybeThrow();
 
     res.complete();
   });
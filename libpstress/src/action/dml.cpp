@@ -1,35 +1,142 @@
 
 #include "action/dml.hpp"
 
-#include <boost/algorithm/string/join.hpp>
+#include <algorithm>
+#include <array>
+#include <charconv>
 #include <fmt/format.h>
 #include <rfl.hpp>
 
+#include "sql_variant/sql_builder.hpp"
+
 using namespace metadata;
 using namespace action;
 
 namespace {
 
-std::string generate_value(metadata::Column const &col, ps_random &rand) {
-  switch (col.type) {
-  case metadata::ColumnType::INT:
-    return std::to_string(rand.random_number(1, 1000000));
-  case metadata::ColumnType::REAL:
-    return std::to_string(rand.random_number(1.0, 1000000.0));
-  case metadata::ColumnType::VARCHAR:
-    return std::string("'") + rand.random_string(0, col.length) + "'";
-  case metadata::ColumnType::BYTEA:
-  case metadata::ColumnType::TEXT:
-    return std::string("'") + rand.random_string(50, 1000) + "'";
-  case metadata::ColumnType::BOOL:
-    return rand.random_number(0, 1) == 1 ? "true" : "false";
-  case metadata::ColumnType::CHAR:
-    return std::string("'") + rand.random_string(0, col.length) + "'";
+const constexpr std::size_t copy_chunk_size = 64 * 1024;
+
+// random picks per candidate in selectTable, before giving up
+const constexpr std::size_t table_selection_attempts = 8;
+
+// Updates the statistics of the table when the result of the statement
+// arrives, affected rows are added with rowSign. Keeps the statistics alive,
+// the table can be dropped while the statement is pipelined.
+template <std::int64_t rowSign>
+sql_variant::LoggedSQL::completion_t
+record_statistics(metadata::Table const &table) {
+  return [stats = table.statistics](sql_variant::QueryResult const &res) {
+    if (res.success()) {
+      stats->recordSuccess(res.executionTime,
+                           rowSign *
+                               static_cast<std::int64_t>(res.affectedRows));
+    } else {
+      stats->recordFailure(res.executionTime);
+    }
+  };
+}
+
+// The columns written by DML, all except auto increment and generated ones
+void appendColumnNames(sql_variant::SqlBuilder &sql,
+                       metadata::Table const &table) {
+  bool first = true;
+  for (auto const &f : table.columns) {
+    if (f.written()) {
+      if (!first)
+        sql << ", ";
+      sql.identifier(f.name);
+      first = false;
+    }
   }
-  return "";
 }
 }; // namespace
 
+table_cptr action::selectTable(metadata::TableSet const &tables,
+                               ps_random &rand, std::size_t candidates,
+                               std::size_t minRows, std::size_t maxRows) {
+  if (tables.empty()) {
+    return nullptr;
+  }
+  candidates = std::max<std::size_t>(candidates, 1);
+
+  metadata::table_cptr const *selected = nullptr;
+  std::uint64_t selectedRows = 0;
+  std::size_t found = 0;
+  for (std::size_t attempt = 0;
+       attempt < candidates * table_selection_attempts && found < candidates;
+       ++attempt) {
+    auto const &table =
+        tables[rand.random_number<std::size_t>(0, tables.size() - 1)];
+    const auto rows = table->statistics->rows();
+    if (rows < minRows || (maxRows > 0 && rows >= maxRows)) {
+      continue;
+    }
+    found++;
+    if (selected == nullptr || rows > selectedRows) {
+      selected = &table;
+      selectedRows = rows;
+    }
+  }
+
+  return selected == nullptr ? nullptr : *selected;
+}
+
+CopyData::CopyData(DmlConfig const &config, metadata::table_cptr table,
+                   std::size_t rows)
+    : config(config), table(table), rows(rows) {}
+
+void CopyData::execute(Metadata &, ps_random &rand,
+                       sql_variant::LoggedSQL *connection) const {
+  sql_variant::SqlBuilder sql(connection->sqlBuffer());
+  sql << "COPY ";
+  sql.identifier(table->name) << " (";
+  appendColumnNames(sql, *table);
+  sql << ") FROM STDIN;";
+
+  // generated values never need COPY escaping
+  RowGenerator generator(*table, config.values);
+  std::size_t remaining = rows;
+  auto produce = [&](std::string &buffer) {
+    while (remaining > 0 && buffer.size() < copy_chunk_size) {
+      generator.appendCopyRow(buffer, rand);
+      buffer += '\n';
+      remaining--;
+    }
+    return remaining > 0;
+  };
+
+  const auto res = connection->copyFrom(sql.str(), produce);
+  record_statistics<1>(*table)(res);
+  res.maybeThrow();
+}
+
+std::size_t CopyData::estimatedRowSize(metadata::Table const &table) {
+  // tuple header and line pointer
+  std::size_t size = 28;
+  for (auto const &f : table.columns) {
+    switch (f.type) {
+    case metadata::ColumnType::INT:
+    case metadata::ColumnType::REAL:
+      size += 4;
+      break;
+    case metadata::ColumnType::BOOL:
+      size += 1;
+      break;
+    case metadata::ColumnType::CHAR:
+      size += f.length + 1;
+      break;
+    case metadata::ColumnType::VARCHAR:
+      size += f.length / 2 + 1;
+      break;
+    case metadata::ColumnType::BYTEA:
+    case metadata::ColumnType::TEXT:
+      size += 529;
+      break;
+    }
+  }
+  return size;
+}
+
 InsertData::InsertData(DmlConfig const &config, std::size_t rows)
     : config(config), table(nullptr), rows(rows) {}
 
@@ -42,51 +149,54 @@ void InsertData::execute(Metadata &metaCtx, ps_random &rand,
 
   auto table = this->table;
 
-  if (metaCtx.size() == 0)
-    return; // TODO: log
-  while (table == nullptr) {
-    // select a random table from metadata
-    std::size_t idx = rand.random_number<std::size_t>(0, metaCtx.size() - 1);
-    table = metaCtx[idx];
+  if (table == nullptr) {
+    table = selectTable(tables.get(metaCtx), rand, config.tableCandidates, 0,
+                        config.insertMaxTableRows);
   }
-
-  std::stringstream sql;
-  sql << "INSERT INTO ";
-  sql << table->name;
-  sql << " (";
-
-  bool first = true;
-  for (auto const &f : table->columns) {
-    if (!f.auto_increment) {
-      if (!first)
-        sql << ", ";
-      sql << f.name;
-      first = false;
-    }
-  }
-
-  sql << " ) VALUES ";
-  for (std::size_t idx = 0; idx < rows; ++idx) {
-    if (idx != 0)
-      sql << ", ";
-    sql << "(";
-
-    first = true;
-    for (auto const &f : table->columns) {
-      if (!f.auto_increment) {
-        if (!first)
-          sql << ", ";
-        sql << generate_value(f, rand);
-        first = false;
-      }
-    }
-
-    sql << ")";
-  }
-
-  sql << ";";
-
-  connection->executeQuery(sql.str()).maybeThrow();
+  if (table == nullptr)
+    throw ActionSkipped("No table to insert into");
+
+  std::array<char, 20> rowsBuffer;
+  const auto rowsEnd =
+      std::to_chars(rowsBuffer.begin(), rowsBuffer.end(), rows).ptr;
+
+  auto const &statement = connection->prepared(
+      {"insert", table->name, std::string_view(rowsBuffer.begin(), rowsEnd)},
+      table->version, [&]() -> std::string const & {
+        sql_variant::SqlBuilder sql(connection->sqlBuffer());
+        sql << "INSERT INTO ";
+        sql.identifier(table->name) << " (";
+        appendColumnNames(sql, *table);
+        sql << ") VALUES ";
+
+        std::size_t param = 1;
+        for (std::size_t idx = 0; idx < rows; ++idx) {
+          if (idx != 0)
+            sql << ", ";
+          sql << "(";
+
+          bool first = true;
+          for (auto const &f : table->columns) {
+            if (f.written()) {
+              if (!first)
+                sql << ", ";
+              sql.parameter(param++);
+              first = false;
+            }
+          }
+
+          sql << ")";
+        }
+
+        sql << ";";
+        return sql.str();
+      });
+
+  auto const &values =
+      generators.get(*table, config.values).parameters(rows, rand);
+
+  connection->executePreparedPipelined(statement, values,
+                                       record_statistics<1>(*table));
 }
 
 DeleteData::DeleteData(DmlConfig const &config)
@@ -96,24 +206,35 @@ DeleteData::DeleteData(DmlConfig const &config)
 void DeleteData::execute(Metadata &metaCtx, ps_random &rand,
                          sql_variant::LoggedSQL *connection) const {
 
-  if (metaCtx.size() == 0)
-    return; // TODO: log
-	    
-  table_cptr table = nullptr;
-
-  while (table == nullptr) {
-    // select a random table from metadata
-    std::size_t idx = rand.random_number<std::size_t>(0, metaCtx.size() - 1);
-    table = metaCtx[idx];
-  }
+  const auto table = selectTable(tables.get(metaCtx), rand,
+                                 config.tableCandidates,
+                                 config.deleteMinTableRows);
+  if (table == nullptr)
+    throw ActionSkipped("No table to delete from");
 
   auto const& tableName = table->name;
-  // TODO: assumes we have a single column primary key as the first column. Currently always true.
+  // tables have a single column primary key as the first column: created
+  // tables have a serial key, adopt() skips tables without such a key
   auto const& pkName = table->columns[0].name;
   // TODO: add other types of deletes, e.g. not based on primary key
   auto const rows = rand.random_number(config.deleteMin, config.deleteMax);
 
-  connection->executeQuery(fmt::format("DELETE FROM {} WHERE {} IN (SELECT {} FROM {} ORDER BY random() LIMIT {});", tableName, pkName, pkName, tableName, rows)).maybeThrow();
+  auto const &statement =
+      connection->prepared(
+          {"delete", tableName}, table->version, [&]() -> std::string const & {
+            sql_variant::SqlBuilder sql(connection->sqlBuffer());
+            sql << "DELETE FROM ";
+            sql.identifier(tableName) << " WHERE ";
+            sql.identifier(pkName) << " IN (SELECT ";
+            sql.identifier(pkName) << " FROM ";
+            sql.identifier(tableName) << " ORDER BY random() LIMIT ";
+            sql.parameter(1) << ");";
+            return sql.str();
+          });
+
+  const std::array<std::string, 1> values{std::to_string(rows)};
+  connection->executePreparedPipelined(statement, values,
+                                       record_statistics<-1>(*table));
 }
 
 UpdateOneRow::UpdateOneRow(DmlConfig const &config)
@@ -123,41 +244,50 @@ UpdateOneRow::UpdateOneRow(DmlConfig const &config)
 void UpdateOneRow::execute(Metadata &metaCtx, ps_random &rand,
                          sql_variant::LoggedSQL *connection) const {
 
-  if (metaCtx.size() == 0)
-    return; // TODO: log
-	    
-  table_cptr table = nullptr;
-
-  while (table == nullptr) {
-    // select a random table from metadata
-    std::size_t idx = rand.random_number<std::size_t>(0, metaCtx.size() - 1);
-    table = metaCtx[idx];
-  }
+  const auto table =
+      selectTable(tables.get(metaCtx), rand, config.tableCandidates);
+  if (table == nullptr)
+    throw ActionSkipped("No table to update");
 
   auto const& tableName = table->name;
-  // TODO: assumes we have a single column primary key as the first column. Currently always true.
+  // single column primary key as the first column, see DeleteData
   auto const& pkName = table->columns[0].name;
-
-  std::stringstream sql;
-  sql << "UPDATE ";
-  sql << tableName;
-  sql << " SET ";
-
-  bool first = true;
-  for (auto const &f : table->columns) {
-    if (!f.auto_increment) {
-      if (!first)
-        sql << ", ";
-      sql << f.name;
-      sql << " = ";
-      sql << generate_value(f, rand);
-      first = false;
-    }
-  }
-
-  sql << fmt::format(" WHERE {} IN (SELECT {} FROM {} ORDER BY random() LIMIT 1)", pkName, pkName, tableName);
-  sql << ";";
-
-  connection->executeQuery(sql.str()).maybeThrow();
+  // the key is left unchanged
+  const auto updated = [](metadata::Column const &f) {
+    return f.written() && !f.primary_key;
+  };
+  if (std::none_of(table->columns.begin(), table->columns.end(), updated))
+    throw ActionSkipped("No column to update");
+
+  auto const &statement =
+      connection->prepared(
+          {"update", tableName}, table->version, [&]() -> std::string const & {
+            sql_variant::SqlBuilder sql(connection->sqlBuffer());
+            sql << "UPDATE ";
+            sql.identifier(tableName) << " SET ";
+
+            bool first = true;
+            std::size_t param = 1;
+            for (auto const &f : table->columns) {
+              if (updated(f)) {
+                if (!first)
+                  sql << ", ";
+                sql.identifier(f.name) << " = ";
+                sql.parameter(param++);
+                first = false;
+              }
+            }
+
+            sql << " WHERE ";
+            sql.identifier(pkName) << " IN (SELECT ";
+            sql.identifier(pkName) << " FROM ";
+            sql.identifier(tableName) << " ORDER BY random() LIMIT 1);";
+            return sql.str();
+          });
+
+  auto const &values =
+      generators.get(*table, config.values).parameters(1, rand);
+
+  connection->executePreparedPipelined(statement, values,
+                                       record_statistics<0>(*table));
 }
-
@@ -0,0 +1,390 @@
+
+#include "action/value_generator.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cctype>
+#include <cmath>
+#include <fmt/format.h>
+#include <numbers>
+#include <stdexcept>
+
+#include "sql_variant/generic.hpp"
+
+namespace action {
+
+namespace {
+
+// Generated rows are small, but dropped tables shouldn't accumulate
+const constexpr std::size_t max_cached_generators = 1024;
+
+// BOOL values are 0 (false) or 1 (true)
+double default_min(metadata::ColumnType type) {
+  return type == metadata::ColumnType::BOOL ? 0 : 1;
+}
+
+// Limited by the range of the column, e.g. smallint
+double default_max(metadata::Column const &column) {
+  if (column.type == metadata::ColumnType::BOOL) {
+    return 1;
+  }
+  return column.length > 0 ? std::min<double>(column.length, 1000000)
+                           : 1000000;
+}
+
+std::size_t default_min_length(metadata::ColumnType type) {
+  switch (type) {
+  case metadata::ColumnType::BYTEA:
+  case metadata::ColumnType::TEXT:
+    return 50;
+  default:
+    return 0;
+  }
+}
+
+std::size_t default_max_length(metadata::Column const &column) {
+  switch (column.type) {
+  case metadata::ColumnType::BYTEA:
+  case metadata::ColumnType::TEXT:
+    return 1000;
+  case metadata::ColumnType::CHAR:
+  case metadata::ColumnType::VARCHAR:
+    return column.length;
+  default:
+    return 0;
+  }
+}
+
+// Configured lengths are per type (or adopted column), they can exceed the
+// length of a CHAR or VARCHAR column
+std::size_t fit_length(metadata::Column const &column, std::size_t length) {
+  switch (column.type) {
+  case metadata::ColumnType::CHAR:
+  case metadata::ColumnType::VARCHAR:
+    return column.length > 0 ? std::min<std::size_t>(length, column.length)
+                             : length;
+  default:
+    return length;
+  }
+}
+
+bool is_string(metadata::ColumnType type) {
+  switch (type) {
+  case metadata::ColumnType::CHAR:
+  case metadata::ColumnType::VARCHAR:
+  case metadata::ColumnType::BYTEA:
+  case metadata::ColumnType::TEXT:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Number of integers in [min, max]
+std::uint64_t range_count(double min, double max) {
+  return max >= min ? static_cast<std::uint64_t>(std::floor(max - min)) + 1
+                    : 1;
+}
+
+double unit(ps_random &rand) { return rand.random_number(0.0, 1.0); }
+
+// Box-Muller, a single standard normal value
+double standard_normal(ps_random &rand) {
+  const auto u1 = 1.0 - unit(rand);
+  const auto u2 = unit(rand);
+  return std::sqrt(-2.0 * std::log(u1)) *
+         std::cos(2.0 * std::numbers::pi * u2);
+}
+
+// log1p(x) / x and expm1(x) / x, with series around 0
+double helper1(double x) {
+  return std::abs(x) > 1e-8 ? std::log1p(x) / x
+                            : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+}
+
+double helper2(double x) {
+  return std::abs(x) > 1e-8
+             ? std::expm1(x) / x
+             : 1.0 + x * 0.5 * (1.0 + x * 1.0 / 3.0 * (1.0 + 0.25 * x));
+}
+
+template <typename T> void append_number(std::string &out, T value) {
+  std::array<char, 32> buffer;
+  std::to_chars_result result;
+  if constexpr (std::is_floating_point_v<T>) {
+    result = std::to_chars(buffer.begin(), buffer.end(), value,
+                           std::chars_format::fixed, 6);
+  } else {
+    result = std::to_chars(buffer.begin(), buffer.end(), value);
+  }
+  out.append(buffer.begin(), result.ptr);
+}
+
+} // namespace
+
+Distribution parse_distribution(std::string const &name) {
+  if (name == "uniform") {
+    return Distribution::uniform;
+  }
+  if (name == "zipfian") {
+    return Distribution::zipfian;
+  }
+  if (name == "sequential") {
+    return Distribution::sequential;
+  }
+  if (name == "normal") {
+    return Distribution::normal;
+  }
+  throw std::runtime_error(
+      fmt::format("Unknown distribution '{}', expected 'uniform', 'zipfian', "
+                  "'sequential' or 'normal'",
+                  name));
+}
+
+ValueSpec &ValueConfig::type(metadata::ColumnType type) {
+  return types[static_cast<std::size_t>(type)];
+}
+
+ValueSpec &ValueConfig::type(std::string const &name) {
+  static const std::array<std::pair<std::string_view, metadata::ColumnType>, 7>
+      names{{{"int", metadata::ColumnType::INT},
+             {"char", metadata::ColumnType::CHAR},
+             {"varchar", metadata::ColumnType::VARCHAR},
+             {"real", metadata::ColumnType::REAL},
+             {"bool", metadata::ColumnType::BOOL},
+             {"bytea", metadata::ColumnType::BYTEA},
+             {"text", metadata::ColumnType::TEXT}}};
+  std::string lower = name;
+  std::transform(lower.begin(), lower.end(), lower.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  for (auto const &[typeName, columnType] : names) {
+    if (typeName == lower) {
+      return type(columnType);
+    }
+  }
+  throw std::runtime_error(fmt::format("Unknown column type '{}'", name));
+}
+
+ValueSpec const &ValueConfig::spec(metadata::Table const &table,
+                                   metadata::Column const &column) const {
+  if (!columns.empty()) {
+    if (auto it = columns.find(fmt::format("{}.{}", table.name, column.name));
+        it != columns.end()) {
+      return it->second;
+    }
+    if (auto it = columns.find(column.name.str()); it != columns.end()) {
+      return it->second;
+    }
+  }
+  return types[static_cast<std::size_t>(column.type)];
+}
+
+IndexSampler::IndexSampler(Distribution distribution, std::uint64_t count,
+                           double skew, double deviation)
+    : distribution(distribution), count(std::max<std::uint64_t>(count, 1)),
+      deviation(deviation), skew(skew) {
+  if (distribution == Distribution::zipfian) {
+    if (!(skew > 0)) {
+      throw std::runtime_error(
+          fmt::format("Zipfian skew has to be positive, got {}", skew));
+    }
+    hIntegralX1 = hIntegral(1.5) - 1.0;
+    hIntegralN = hIntegral(static_cast<double>(this->count) + 0.5);
+    s = 2.0 - hIntegralInverse(hIntegral(2.5) - h(2.0));
+  }
+}
+
+double IndexSampler::h(double x) const {
+  return std::exp(-skew * std::log(x));
+}
+
+double IndexSampler::hIntegral(double x) const {
+  const auto logX = std::log(x);
+  return helper2((1.0 - skew) * logX) * logX;
+}
+
+double IndexSampler::hIntegralInverse(double x) const {
+  auto t = x * (1.0 - skew);
+  if (t < -1.0) {
+    t = -1.0;
+  }
+  return std::exp(helper1(t) * x);
+}
+
+std::uint64_t IndexSampler::next(ps_random &rand) {
+  switch (distribution) {
+  case Distribution::uniform:
+    return rand.random_number<std::uint64_t>(0, count - 1);
+  case Distribution::sequential:
+    return sequence++ % count;
+  case Distribution::normal: {
+    const auto last = static_cast<double>(count - 1);
+    const auto value = last / 2 + standard_normal(rand) * deviation *
+                                      static_cast<double>(count);
+    return static_cast<std::uint64_t>(
+        std::llround(std::clamp(value, 0.0, last)));
+  }
+  case Distribution::zipfian:
+    while (true) {
+      const auto u = hIntegralN + unit(rand) * (hIntegralX1 - hIntegralN);
+      const auto x = hIntegralInverse(u);
+      const auto k = std::clamp<double>(std::floor(x + 0.5), 1.0,
+                                        static_cast<double>(count));
+      if (k - x <= s || u >= hIntegral(k + 0.5) - h(k)) {
+        return static_cast<std::uint64_t>(k) - 1;
+      }
+    }
+  }
+  return 0;
+}
+
+ColumnGenerator::ColumnGenerator(metadata::Table const &table,
+                                 metadata::Column const &column,
+                                 ValueSpec const &spec)
+    : type(column.type), min(spec.min.value_or(default_min(column.type))),
+      max(spec.max.value_or(default_max(column))),
+      deviation(spec.deviation * (max - min)),
+      minLength(fit_length(
+          column, spec.min_length.value_or(default_min_length(column.type)))),
+      maxLength(fit_length(
+          column, spec.max_length.value_or(default_max_length(column)))),
+      nullFraction(column.nullable && !column.primary_key ? spec.null_fraction
+                                                          : 0),
+      cardinality(spec.cardinality), distribution(spec.distribution),
+      values(spec.distribution,
+             cardinality > 0 ? cardinality : range_count(min, max),
+             spec.skew, spec.deviation),
+      lengths(spec.length_distribution,
+              maxLength >= minLength ? maxLength - minLength + 1 : 1,
+              spec.skew, spec.deviation),
+      dictionarySeed(
+          ps_random(fmt::format("{}.{}", table.name, column.name))
+              .stream_seed()) {
+  if (max < min) {
+    throw std::runtime_error(
+        fmt::format("Invalid value range [{}, {}] for {}.{}", min, max,
+                    table.name, column.name));
+  }
+  if (maxLength < minLength) {
+    throw std::runtime_error(
+        fmt::format("Invalid length range [{}, {}] for {}.{}", minLength,
+                    maxLength, table.name, column.name));
+  }
+}
+
+void ColumnGenerator::append(std::string &out, ps_random &rand) {
+  if (nullFraction > 0 && unit(rand) < nullFraction) {
+    out += sql_variant::null_parameter;
+    return;
+  }
+  if (cardinality > 0) {
+    // the same index always generates the same value
+    auto dictionary = ps_random::from_seed(dictionarySeed + values.next(rand));
+    appendRandom(out, dictionary);
+    return;
+  }
+  appendValue(out, rand);
+}
+
+// Values selected by the distribution
+void ColumnGenerator::appendValue(std::string &out, ps_random &rand) {
+  if (is_string(type)) {
+    appendRandom(out, rand);
+    return;
+  }
+  if (type == metadata::ColumnType::REAL) {
+    if (distribution == Distribution::uniform) {
+      append_number(out, rand.random_number(min, max));
+    } else if (distribution == Distribution::normal) {
+      append_number(out, std::clamp((min + max) / 2 +
+                                        standard_normal(rand) * deviation,
+                                    min, max));
+    } else {
+      append_number(out, min + static_cast<double>(values.next(rand)));
+    }
+    return;
+  }
+  const auto value = static_cast<std::int64_t>(min) +
+                     static_cast<std::int64_t>(values.next(rand));
+  if (type == metadata::ColumnType::BOOL) {
+    out += value != 0 ? "true" : "false";
+  } else {
+    append_number(out, value);
+  }
+}
+
+// Uniform values, lengths selected by the length distribution
+void ColumnGenerator::appendRandom(std::string &out, ps_random &rand) {
+  switch (type) {
+  case metadata::ColumnType::INT:
+    append_number(out, rand.random_number(static_cast<std::int64_t>(min),
+                                          static_cast<std::int64_t>(max)));
+    return;
+  case metadata::ColumnType::REAL:
+    append_number(out, rand.random_number(min, max));
+    return;
+  case metadata::ColumnType::BOOL:
+    out += rand.random_number(0, 1) == 1 ? "true" : "false";
+    return;
+  default: {
+    const auto length = minLength + lengths.next(rand);
+    const auto offset = out.size();
+    out.resize(offset + length);
+    rand.fill_string(out.data() + offset, length);
+    return;
+  }
+  }
+}
+
+RowGenerator::RowGenerator(metadata::Table const &table,
+                           ValueConfig const &config, RowColumns which)
+    : version_(table.version) {
+  for (auto const &column : table.columns) {
+    if (column.written() &&
+        (which == RowColumns::all || !column.primary_key)) {
+      columns.emplace_back(table, column, config.spec(table, column));
+    }
+  }
+}
+
+std::vector<std::string> const &RowGenerator::parameters(std::size_t rows,
+                                                         ps_random &rand) {
+  // the strings keep their capacity between statements
+  buffer.resize(rows * columns.size());
+  auto value = buffer.begin();
+  for (std::size_t row = 0; row < rows; ++row) {
+    for (auto &column : columns) {
+      value->clear();
+      column.append(*value++, rand);
+    }
+  }
+  return buffer;
+}
+
+void RowGenerator::appendCopyRow(std::string &out, ps_random &rand) {
+  bool first = true;
+  for (auto &column : columns) {
+    if (!first) {
+      out += '\t';
+    }
+    column.append(out, rand);
+    first = false;
+  }
+}
+
+RowGenerator &RowGeneratorCache::get(metadata::Table const &table,
+                                     ValueConfig const &config) {
+  auto it = generators.find(table.name);
+  if (it != generators.end() && it->second.version() == table.version) {
+    return it->second;
+  }
+  if (it != generators.end()) {
+    generators.erase(it);
+  } else if (generators.size() >= max_cached_generators) {
+    generators.clear();
+  }
+  return generators.try_emplace(table.name, table, config, which)
+      .first->second;
+}
+
+} // namespace action
@@ -0,0 +1,41 @@
+#include "arrival_schedule.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+#include <fmt/format.h>
+
+Arrival parse_arrival(std::string const &name) {
+  if (name == "uniform") {
+    return Arrival::uniform;
+  }
+  if (name == "poisson") {
+    return Arrival::poisson;
+  }
+  throw std::runtime_error(fmt::format(
+      "Unknown arrival '{}', expected 'uniform' or 'poisson'", name));
+}
+
+ArrivalSchedule::ArrivalSchedule(double rate, Arrival arrival,
+                                 clock::time_point start)
+    : meanInterval(1.0 / rate), arrival(arrival), start(start) {
+  if (!(rate > 0)) {
+    throw std::runtime_error(
+        fmt::format("Arrival rate has to be positive, got {}", rate));
+  }
+}
+
+ArrivalSchedule::clock::time_point ArrivalSchedule::next(ps_random &rand) {
+  const auto current =
+      start + std::chrono::duration_cast<clock::duration>(offset);
+
+  if (arrival == Arrival::poisson) {
+    // inverse transform sampling, 1 - u is never 0
+    const auto u = rand.random_number<double>(0.0, 1.0);
+    offset += meanInterval * -std::log(1.0 - u);
+  } else {
+    offset += meanInterval;
+  }
+
+  return current;
+}
@@ -0,0 +1,176 @@
+#include "identifier.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace metadata {
+
+namespace {
+
+const constexpr std::size_t segment_bits = 12;
+const constexpr std::size_t segment_size = std::size_t(1) << segment_bits;
+// 2^28 identifiers alive at the same time
+const constexpr std::size_t max_segments = 1 << 16;
+
+struct Entry {
+  std::string_view value;
+  std::atomic<std::uint32_t> references = 0;
+  // owns the characters of value, only accessed with the mutex held
+  std::unique_ptr<char[]> data;
+};
+
+using Segment = std::array<Entry, segment_size>;
+
+// Lookups only read the segments: an id is only known to a thread holding an
+// Identifier with it, which happened after the intern() call returning it,
+// which already published the segment and the entry. The entry can't be freed
+// or reused until that Identifier is destroyed.
+//
+// Only the release of the last reference takes the mutex. The count can reach
+// zero and be incremented again by intern() before the releasing thread gets
+// the mutex, or the entry can already be freed (and reused) by another
+// release, so the count is checked again with the mutex held.
+class Pool {
+public:
+  Pool() {
+    segments[0].store(new Segment(), std::memory_order_release);
+    count = 1;
+  }
+
+  std::string_view lookup(std::uint32_t id) const { return entry(id).value; }
+
+  void retain(std::uint32_t id) {
+    if (id != 0) {
+      entry(id).references.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void release(std::uint32_t id) {
+    if (id == 0) {
+      return;
+    }
+    auto &e = entry(id);
+    if (e.references.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (e.data == nullptr ||
+        e.references.load(std::memory_order_acquire) != 0) {
+      return;
+    }
+    ids.erase(e.value);
+    e.value = {};
+    e.data.reset();
+    freeIds.push_back(id);
+  }
+
+  std::uint32_t intern(std::string_view value) {
+    if (value.empty()) {
+      return 0;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (auto it = ids.find(value); it != ids.end()) {
+      entry(it->second).references.fetch_add(1, std::memory_order_relaxed);
+      return it->second;
+    }
+
+    std::uint32_t id = 0;
+    if (!freeIds.empty()) {
+      id = freeIds.back();
+      freeIds.pop_back();
+    } else if (count < max_segments * segment_size) {
+      id = static_cast<std::uint32_t>(count++);
+      auto &segment = segments[id >> segment_bits];
+      if (segment.load(std::memory_order_relaxed) == nullptr) {
+        segment.store(new Segment(), std::memory_order_release);
+      }
+    } else {
+      throw std::length_error("Identifier pool is full");
+    }
+
+    auto &e = entry(id);
+    e.data.reset(new char[value.size()]);
+    std::copy(value.begin(), value.end(), e.data.get());
+    e.value = std::string_view(e.data.get(), value.size());
+    e.references.store(1, std::memory_order_relaxed);
+    ids.emplace(e.value, id);
+    return id;
+  }
+
+  std::size_t size() const {
+    std::unique_lock<std::mutex> lock(mutex);
+    return count - 1 - freeIds.size();
+  }
+
+private:
+  std::array<std::atomic<Segment *>, max_segments> segments{};
+  mutable std::mutex mutex;
+  std::size_t count = 0;
+  std::unordered_map<std::string_view, std::uint32_t> ids;
+  // released ids, reused before growing the pool
+  std::vector<std::uint32_t> freeIds;
+
+  Entry &entry(std::uint32_t id) const {
+    return (*segments[id >> segment_bits].load(
+        std::memory_order_acquire))[id & (segment_size - 1)];
+  }
+};
+
+// Never destroyed, identifiers can be used during static destruction
+Pool &pool() {
+  static Pool *instance = new Pool();
+  return *instance;
+}
+
+} // namespace
+
+Identifier::Identifier(std::string_view value) : id_(pool().intern(value)) {}
+
+Identifier::Identifier(Identifier const &other) : id_(other.id_) {
+  pool().retain(id_);
+}
+
+Identifier::~Identifier() { pool().release(id_); }
+
+Identifier &Identifier::operator=(Identifier const &other) {
+  // retain first, other can be *this
+  pool().retain(other.id_);
+  pool().release(id_);
+  id_ = other.id_;
+  return *this;
+}
+
+Identifier &Identifier::operator=(Identifier &&other) noexcept {
+  if (this != &other) {
+    pool().release(id_);
+    id_ = other.id_;
+    other.id_ = 0;
+  }
+  return *this;
+}
+
+Identifier &Identifier::operator=(std::string_view value) {
+  // interning first, value can be a view of this identifier
+  const auto id = pool().intern(value);
+  pool().release(id_);
+  id_ = id;
+  return *this;
+}
+
+std::string_view Identifier::view() const { return pool().lookup(id_); }
+
+std::ostream &operator<<(std::ostream &os, Identifier const &identifier) {
+  return os << identifier.view();
+}
+
+std::size_t internedIdentifiers() { return pool().size(); }
+
+} // namespace metadata
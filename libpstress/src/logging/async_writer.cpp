@@ -0,0 +1,276 @@
+#include "logging/async_writer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/chrono.h>
+#include <fmt/format.h>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace logging {
+
+namespace {
+const constexpr auto idle_wait = std::chrono::milliseconds(10);
+
+std::string_view levelName(Level level) {
+  switch (level) {
+  case Level::info:
+    return "info";
+  case Level::warning:
+    return "warning";
+  case Level::error:
+    return "error";
+  }
+  return "unknown";
+}
+} // namespace
+
+RingBuffer::RingBuffer(std::size_t capacity)
+    : mask(std::bit_ceil(std::max<std::size_t>(capacity, 1024)) - 1),
+      data(new char[mask + 1]) {}
+
+std::size_t RingBuffer::capacity() const { return mask + 1; }
+
+bool RingBuffer::tryWrite(std::span<std::string_view const> parts) {
+  std::size_t total = 0;
+  for (auto const &part : parts) {
+    total += part.size();
+  }
+
+  const auto write = writePos.load(std::memory_order_relaxed);
+  const auto read = readPos.load(std::memory_order_acquire);
+
+  if (total > capacity() - (write - read)) {
+    return false;
+  }
+
+  auto pos = write;
+  for (auto const &part : parts) {
+    // empty views can have a null data pointer, invalid for memcpy
+    if (part.empty()) {
+      continue;
+    }
+    const auto offset = pos & mask;
+    const auto first = std::min(part.size(), capacity() - offset);
+    std::memcpy(data.get() + offset, part.data(), first);
+    std::memcpy(data.get(), part.data() + first, part.size() - first);
+    pos += part.size();
+  }
+
+  writePos.store(pos, std::memory_order_release);
+  return true;
+}
+
+std::size_t RingBuffer::readAll(std::vector<char> &out) {
+  const auto read = readPos.load(std::memory_order_relaxed);
+  const auto write = writePos.load(std::memory_order_acquire);
+  const auto size = write - read;
+
+  const auto offset = read & mask;
+  const auto first = std::min<std::size_t>(size, capacity() - offset);
+  out.insert(out.end(), data.get() + offset, data.get() + offset + first);
+  out.insert(out.end(), data.get(), data.get() + (size - first));
+
+  readPos.store(write, std::memory_order_release);
+  return size;
+}
+
+bool RingBuffer::empty() const {
+  return readPos.load(std::memory_order_acquire) ==
+         writePos.load(std::memory_order_acquire);
+}
+
+LogStream::LogStream(std::string const &name,
+                     std::filesystem::path const &path, std::size_t bufferSize,
+                     Format format)
+    : name_(name), format(format), fd(-1), ring(bufferSize) {
+  if (path.has_parent_path()) {
+    std::filesystem::create_directories(path.parent_path());
+  }
+  fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error(fmt::format("Failed opening log file '{}': {}",
+                                         path.string(), std::strerror(errno)));
+  }
+}
+
+LogStream::~LogStream() {
+  if (fd >= 0) {
+    ::close(fd);
+  }
+}
+
+std::string const &LogStream::name() const { return name_; }
+
+std::size_t LogStream::maxMessageSize() const {
+  return ring.capacity() - sizeof(RecordHeader);
+}
+
+void LogStream::log(Level level,
+                    std::initializer_list<std::string_view> parts) {
+  std::array<std::string_view, max_parts + 1> record;
+  std::size_t partCount = 1;
+
+  // Truncate the message if it wouldn't fit into the ring even when empty
+  std::size_t remaining = maxMessageSize();
+  for (auto const &part : parts) {
+    if (partCount > max_parts || remaining == 0) {
+      break;
+    }
+    record[partCount] = part.substr(0, remaining);
+    remaining -= record[partCount].size();
+    partCount++;
+  }
+
+  RecordHeader header;
+  header.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::system_clock::now().time_since_epoch())
+                         .count();
+  header.length = static_cast<std::uint32_t>(maxMessageSize() - remaining);
+  header.level = level;
+  record[0] =
+      std::string_view(reinterpret_cast<char const *>(&header), sizeof(header));
+
+  const std::span<std::string_view const> recordParts(record.data(),
+                                                      partCount);
+  while (!ring.tryWrite(recordParts)) {
+    AsyncWriter::instance().wakeup();
+    std::this_thread::yield();
+  }
+}
+
+AsyncWriter &AsyncWriter::instance() {
+  static AsyncWriter writer;
+  return writer;
+}
+
+AsyncWriter::AsyncWriter()
+    : thread([this](std::stop_token stop) { run(stop); }) {}
+
+AsyncWriter::~AsyncWriter() {
+  thread.request_stop();
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+std::shared_ptr<LogStream> AsyncWriter::open(std::string const &name,
+                                             std::filesystem::path const &path,
+                                             std::size_t bufferSize,
+                                             Format format) {
+  auto stream = std::make_shared<LogStream>(name, path, bufferSize, format);
+
+  std::unique_lock<std::mutex> lk(mutex);
+  streams.push_back(stream);
+
+  return stream;
+}
+
+void AsyncWriter::wakeup() {
+  wakeupRequested = true;
+  cv.notify_one();
+}
+
+void AsyncWriter::flush() {
+  // A full cycle started after this call drains everything logged before it
+  const auto target = completedCycles.load() + 2;
+  while (completedCycles.load() < target && thread.joinable()) {
+    wakeup();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void AsyncWriter::run(std::stop_token stop) {
+  std::vector<std::shared_ptr<LogStream>> current;
+
+  while (!stop.stop_requested()) {
+    {
+      std::unique_lock<std::mutex> lk(mutex);
+      current = streams;
+    }
+
+    std::size_t written = 0;
+    for (auto &stream : current) {
+      written += drain(*stream);
+    }
+    current.clear();
+    completedCycles++;
+
+    std::unique_lock<std::mutex> lk(mutex);
+    // Streams only referenced by the writer have no producer anymore
+    std::erase_if(streams, [](auto const &stream) {
+      return stream.use_count() == 1 && stream->ring.empty();
+    });
+
+    if (written == 0) {
+      cv.wait_for(lk, stop, idle_wait,
+                  [this] { return wakeupRequested.exchange(false); });
+    }
+  }
+
+  // Final flush at shutdown
+  std::unique_lock<std::mutex> lk(mutex);
+  for (auto &stream : streams) {
+    drain(*stream);
+  }
+  streams.clear();
+}
+
+std::size_t AsyncWriter::drain(LogStream &stream) {
+  readBuffer.clear();
+  if (stream.ring.readAll(readBuffer) == 0) {
+    return 0;
+  }
+
+  writeBuffer.clear();
+
+  std::size_t pos = 0;
+  while (pos + sizeof(LogStream::RecordHeader) <= readBuffer.size()) {
+    LogStream::RecordHeader header;
+    std::memcpy(&header, readBuffer.data() + pos, sizeof(header));
+    pos += sizeof(header);
+
+    if (stream.format == Format::binary) {
+      writeBuffer.append(readBuffer.data() + pos, header.length);
+      pos += header.length;
+      continue;
+    }
+
+    const auto seconds = header.timestamp / 1000000000;
+    const auto millis = (header.timestamp / 1000000) % 1000;
+    if (seconds != cachedSecond || cachedSecondStr.empty()) {
+      cachedSecond = seconds;
+      cachedSecondStr =
+          fmt::format("{:%Y-%m-%d %H:%M:%S}",
+                      fmt::localtime(static_cast<std::time_t>(seconds)));
+    }
+
+    fmt::format_to(std::back_inserter(writeBuffer), "[{}.{:03}] [{}] [{}] ",
+                   cachedSecondStr, millis, stream.name(),
+                   levelName(header.level));
+    writeBuffer.append(readBuffer.data() + pos, header.length);
+    writeBuffer.push_back('\n');
+    pos += header.length;
+  }
+
+  std::size_t offset = 0;
+  while (offset < writeBuffer.size()) {
+    const auto res = ::write(stream.fd, writeBuffer.data() + offset,
+                             writeBuffer.size() - offset);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // Nowhere to report this, logging is best effort from this point
+      break;
+    }
+    offset += static_cast<std::size_t>(res);
+  }
+
+  return writeBuffer.size();
+}
+
+} // namespace logging
@@ -0,0 +1,86 @@
+#include "logging/statement_log.hpp"
+
+#include <fmt/format.h>
+#include <stdexcept>
+
+namespace logging {
+
+StatementLogPolicy::Mode
+StatementLogPolicy::parseMode(std::string const &mode) {
+  if (mode == "full")
+    return Mode::full;
+  if (mode == "truncated")
+    return Mode::truncated;
+  if (mode == "errors")
+    return Mode::errors;
+  if (mode == "sampled")
+    return Mode::sampled;
+  throw std::runtime_error(fmt::format(
+      "Unknown statement log mode '{}', expected one of full, truncated, "
+      "errors, sampled",
+      mode));
+}
+
+StatementLog::StatementLog(std::string const &name,
+                           StatementLogPolicy const &policy)
+    : policy(policy),
+      stream(AsyncWriter::instance().open(
+          fmt::format("sql-conn-{}", name),
+          fmt::format("logs/sql-conn-{}.log", name), policy.bufferSize)) {
+  if (this->policy.sampleRate == 0) {
+    this->policy.sampleRate = 1;
+  }
+}
+
+std::string_view StatementLog::limited(std::string_view sql) const {
+  if (policy.mode == StatementLogPolicy::Mode::truncated) {
+    return sql.substr(0, policy.truncateLength);
+  }
+  return sql;
+}
+
+bool StatementLog::statement(std::string_view sql) const {
+  if (!selectStatement()) {
+    return false;
+  }
+  logStatement(sql);
+  return true;
+}
+
+bool StatementLog::selectStatement() const {
+  switch (policy.mode) {
+  case StatementLogPolicy::Mode::errors:
+    return false;
+  case StatementLogPolicy::Mode::sampled:
+    if (statementCounter++ % policy.sampleRate != 0) {
+      return false;
+    }
+    break;
+  case StatementLogPolicy::Mode::full:
+  case StatementLogPolicy::Mode::truncated:
+    break;
+  }
+  return true;
+}
+
+void StatementLog::logStatement(std::string_view sql) const {
+  const auto logged = limited(sql);
+  stream->log(Level::info, {"Statement: ", logged,
+                            logged.size() < sql.size() ? " [...]" : ""});
+}
+
+void StatementLog::error(std::string_view sql, bool statementLogged,
+                         std::string_view errorCode,
+                         std::string_view errorMessage) const {
+  if (!statementLogged) {
+    stream->log(Level::info, {"Statement: ", limited(sql)});
+  }
+  stream->log(Level::error, {"Error while executing SQL statement: ",
+                             errorCode, " ", errorMessage});
+}
+
+void StatementLog::message(Level level, std::string_view msg) const {
+  stream->log(level, {msg});
+}
+
+} // namespace logging
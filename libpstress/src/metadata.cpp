@@ -1,10 +1,145 @@
 
 #include "metadata.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace metadata {
 
+namespace {
+
+// Threads reading metadata at the same time
+const constexpr std::size_t max_readers = 1024;
+
+// See 13. in the design notes
+class EpochDomain {
+public:
+  void pin() {
+    auto &reader = registration();
+    if (reader.depth++ > 0) {
+      return;
+    }
+    // A retire could advance the epoch between reading and publishing it, and
+    // miss the pin. Published again with the newer epoch, the retired table is
+    // no longer visible to this reader.
+    auto epoch = current.load(std::memory_order_seq_cst);
+    while (true) {
+      reader.record->pinned.store(epoch, std::memory_order_seq_cst);
+      const auto recheck = current.load(std::memory_order_seq_cst);
+      if (recheck == epoch) {
+        break;
+      }
+      epoch = recheck;
+    }
+  }
+
+  void unpin() {
+    auto &reader = registration();
+    if (--reader.depth == 0) {
+      reader.record->pinned.store(0, std::memory_order_release);
+    }
+  }
+
+  // Called after the table was unpublished
+  void retire(std::shared_ptr<const Table> table) {
+    std::unique_lock<std::mutex> lk(retiredLock);
+    retired.emplace_back(current.fetch_add(1, std::memory_order_seq_cst),
+                         std::move(table));
+
+    // tables retired before the oldest pinned epoch are no longer visible
+    std::uint64_t oldest = std::numeric_limits<std::uint64_t>::max();
+    const auto readers = registered.load(std::memory_order_seq_cst);
+    for (std::size_t idx = 0; idx < readers; ++idx) {
+      const auto pinned = records[idx].pinned.load(std::memory_order_seq_cst);
+      if (pinned != 0) {
+        oldest = std::min(oldest, pinned);
+      }
+    }
+    std::erase_if(retired,
+                  [oldest](auto const &entry) { return entry.first < oldest; });
+  }
+
+private:
+  struct alignas(64) Record {
+    // 0 if the thread isn't reading
+    std::atomic<std::uint64_t> pinned = 0;
+    std::atomic<bool> used = false;
+  };
+
+  struct Registration {
+    Record *record = nullptr;
+    std::size_t depth = 0;
+
+    ~Registration() {
+      if (record != nullptr) {
+        record->pinned.store(0, std::memory_order_release);
+        record->used.store(false, std::memory_order_release);
+      }
+    }
+  };
+
+  std::atomic<std::uint64_t> current = 1;
+  std::array<Record, max_readers> records;
+  // records below this index might be used
+  std::atomic<std::size_t> registered = 0;
+  std::mutex retiredLock;
+  std::vector<std::pair<std::uint64_t, std::shared_ptr<const Table>>> retired;
+
+  Registration &registration() {
+    thread_local Registration reader;
+    if (reader.record == nullptr) {
+      for (std::size_t idx = 0; idx < max_readers; ++idx) {
+        bool used = false;
+        if (records[idx].used.compare_exchange_strong(used, true)) {
+          reader.record = &records[idx];
+          auto count = registered.load();
+          while (count <= idx &&
+                 !registered.compare_exchange_weak(count, idx + 1)) {
+          }
+          break;
+        }
+      }
+      if (reader.record == nullptr) {
+        throw MetadataException("Too many threads reading metadata");
+      }
+    }
+    return reader;
+  }
+};
+
+// Never destroyed, tables can be released during static destruction
+EpochDomain &epochs() {
+  static EpochDomain *domain = new EpochDomain();
+  return *domain;
+}
+
+} // namespace
+
+std::uint64_t TableStatistics::rows() const {
+  const auto rows = rowEstimate.load(std::memory_order_relaxed);
+  return rows > 0 ? static_cast<std::uint64_t>(rows) : 0;
+}
+
+void TableStatistics::recordSuccess(std::chrono::nanoseconds latency,
+                                    std::int64_t rowsChanged) {
+  rowEstimate.fetch_add(rowsChanged, std::memory_order_relaxed);
+  statements.fetch_add(1, std::memory_order_relaxed);
+  latencySum.fetch_add(
+      std::chrono::duration_cast<std::chrono::microseconds>(latency).count(),
+      std::memory_order_relaxed);
+}
+
+void TableStatistics::recordFailure(std::chrono::nanoseconds latency) {
+  statements.fetch_add(1, std::memory_order_relaxed);
+  failures.fetch_add(1, std::memory_order_relaxed);
+  latencySum.fetch_add(
+      std::chrono::duration_cast<std::chrono::microseconds>(latency).count(),
+      std::memory_order_relaxed);
+}
+
 Metadata::Reservation::Reservation()
     : storage_(nullptr), table_(nullptr), drop_(false), index_(Metadata::npos),
       lock_() {}
@@ -64,7 +199,12 @@ void Metadata::Reservation::complete() {
     // there. It is safe to update and release the lock, but DROP might need to
     // defragment.
     if (!drop_) { // ALTER and other modification DDL statements
-      storage_->data_.tables[index_] = table_;
+      table_->version = ++storage_->data_.lastVersion;
+      const auto previous = storage_->slot(index_).table;
+      storage_->publish(storage_->slot(index_), table_);
+      if (previous->name != table_->name) {
+        storage_->updateNameIndex(previous->name, table_->name, index_);
+      }
       lock_.unlock();
     } else { // DROP
       bool completed = false;
@@ -77,7 +217,7 @@ void Metadata::Reservation::complete() {
           // this right now. This is mitigated by CREATE locking the last
           // record. As we currently hold that, it has to wait. It is safe to
           // just delete and release the lock.
-          storage_->data_.tables[index_] = nullptr;
+          storage_->publish(storage_->slot(index_), nullptr);
           // tableCount is safe to decrease here:
           // * Concurrent DROP will find the new last record and lock it
           // * Concurrent CREATE will find the new last record, and will also
@@ -85,7 +225,8 @@ void Metadata::Reservation::complete() {
           // until we release the lock
           storage_->data_.tableCount--;
           storage_->data_.reservedSize--;
-          storage_->data_.movedToMap[index_] = Metadata::npos;
+          storage_->slot(index_).movedTo = Metadata::npos;
+          storage_->updateNameIndex(table_->name, {}, index_);
           lock_.unlock();
           completed = true;
         } else {
@@ -94,22 +235,26 @@ void Metadata::Reservation::complete() {
 
           const auto lastIndex = storage_->size() - 1;
           std::unique_lock<std::shared_mutex> innerLock(
-              storage_->data_.tableLocks[lastIndex]);
-          if (storage_->data_.tables[lastIndex] != nullptr &&
+              storage_->slot(lastIndex).lock);
+          if (storage_->slot(lastIndex).table != nullptr &&
               lastIndex == storage_->size() - 1) {
             // We locked the last item. No need to lock the after-the-last item,
             // as CREATE TABLE also tries to lock the last item, which is now
             // locked. It is safe to move and empty it, CREATE will handle the
             // conflict.
 
-            storage_->data_.tables[index_] = storage_->data_.tables[lastIndex];
+            storage_->publish(storage_->slot(index_),
+                              storage_->slot(lastIndex).table);
+            // the moved table is now found at the dropped table's index
+            storage_->updateNameIndex(
+                table_->name, storage_->slot(index_).table->name, index_);
             lock_.unlock();
             // Similarly, it is safe to decrease tableCount here, for the same
             // reasoning as above.
             storage_->data_.tableCount--;
             storage_->data_.reservedSize--;
-            storage_->data_.tables[lastIndex] = nullptr;
-            storage_->data_.movedToMap[lastIndex] = index_;
+            storage_->publish(storage_->slot(lastIndex), nullptr);
+            storage_->slot(lastIndex).movedTo = index_;
             innerLock.unlock();
 
             completed = true;
@@ -125,6 +270,8 @@ void Metadata::Reservation::complete() {
     // We do not actually hold a lock, only have an index reservation at this
     // point!
 
+    table_->version = ++storage_->data_.lastVersion;
+
     bool completed = false;
     while (!completed) {
       std::unique_lock<std::shared_mutex> outerLock;
@@ -136,9 +283,9 @@ void Metadata::Reservation::complete() {
         // Try to lock the last item first
         const auto lastIndex = nextIndex - 1;
         outerLock = std::unique_lock<std::shared_mutex>(
-            storage_->data_.tableLocks[lastIndex]);
+            storage_->slot(lastIndex).lock);
 
-        if (storage_->data_.tables[lastIndex] == nullptr ||
+        if (storage_->slot(lastIndex).table == nullptr ||
             nextIndex != storage_->size()) {
           // This is no longer the last item. Either a CREATE or a DELETE
           // succeeded. Try again.
@@ -157,17 +304,22 @@ void Metadata::Reservation::complete() {
 
       // TODO: debug assert about overindexing
 
+      // Usually allocated by createTable already, but the reservation that
+      // increased the reserved size to this index might still be allocating
+      storage_->allocateSlots(nextIndex + 1);
+
       std::scoped_lock<std::shared_mutex> innerLock(
-          storage_->data_.tableLocks[nextIndex]);
+          storage_->slot(nextIndex).lock);
 
       // TODO: debug assert about the field being nullptr in the vector
 
-      storage_->data_.tables[nextIndex] = table_;
+      storage_->publish(storage_->slot(nextIndex), table_);
       // we hold the lock both for the current last item, and the one after it
       // increasing tableCount here is safe.
       // Also since we already inserted the new item, it will be correctly
       // returned by operator[] at this point
       storage_->data_.tableCount++;
+      storage_->updateNameIndex({}, table_->name, nextIndex);
 
       index_ = nextIndex;
 
@@ -195,19 +347,70 @@ bool Metadata::Reservation::open() const {
 Metadata::index_t Metadata::Reservation::index() const { return index_; }
 Metadata::table_t Metadata::Reservation::table() const { return table_; }
 
-Metadata::Metadata() { data_.movedToMap.fill(npos); }
+Metadata::Metadata(index_t maximumTableCount) {
+  data_.maximumTableCount = maximumTableCount;
+  const auto segmentCount =
+      (maximumTableCount + limits::table_segment_size - 1) /
+      limits::table_segment_size;
+  data_.segments = std::make_unique<std::atomic<Segment *>[]>(segmentCount);
+  for (std::size_t idx = 0; idx < segmentCount; ++idx) {
+    data_.segments[idx] = nullptr;
+  }
+}
+
+Metadata::~Metadata() {
+  const auto segmentCount =
+      (data_.maximumTableCount + limits::table_segment_size - 1) /
+      limits::table_segment_size;
+  for (std::size_t idx = 0; idx < segmentCount; ++idx) {
+    delete data_.segments[idx].load();
+  }
+}
+
+Metadata::Slot &Metadata::slot(index_t idx) const {
+  return (*data_.segments[idx / limits::table_segment_size].load(
+      std::memory_order_acquire))[idx % limits::table_segment_size];
+}
+
+Metadata::Slot *Metadata::findSlot(index_t idx) const {
+  if (idx >= data_.maximumTableCount) {
+    return nullptr;
+  }
+  auto *segment = data_.segments[idx / limits::table_segment_size].load(
+      std::memory_order_acquire);
+  return segment == nullptr ? nullptr
+                            : &(*segment)[idx % limits::table_segment_size];
+}
+
+void Metadata::allocateSlots(index_t count) {
+  const auto lastSegment = (count - 1) / limits::table_segment_size;
+  if (data_.segments[lastSegment].load(std::memory_order_acquire) != nullptr) {
+    // segments are allocated in order, everything before is also there
+    return;
+  }
+
+  std::unique_lock<std::mutex> lk(data_.allocationLock);
+  for (std::size_t idx = 0; idx <= lastSegment; ++idx) {
+    if (data_.segments[idx].load(std::memory_order_relaxed) == nullptr) {
+      data_.segments[idx].store(new Segment(), std::memory_order_release);
+    }
+  }
+}
 
 Metadata::Reservation Metadata::createTable() {
 
-  if (data_.reservedSize < limits::maximum_table_count) {
+  if (data_.reservedSize < data_.maximumTableCount) {
 
     auto res = ++data_.reservedSize;
 
-    if (res > limits::maximum_table_count) {
+    if (res > data_.maximumTableCount) {
       --data_.reservedSize;
       return Reservation();
     }
 
+    // complete() can use any slot below the reserved size
+    allocateSlots(res);
+
     return Reservation(this, std::make_shared<Table>(), false, npos, {});
   }
 
@@ -215,9 +418,12 @@ Metadata::Reservation Metadata::createTable() {
 }
 
 Metadata::Reservation Metadata::alterTable(index_t idx) {
-  // assert: idx < limits::maximum_table_count
-  std::unique_lock<std::shared_mutex> mtx(data_.tableLocks[idx]);
-  auto table = data_.tables[idx];
+  auto *found = findSlot(idx);
+  if (found == nullptr) {
+    return Reservation();
+  }
+  std::unique_lock<std::shared_mutex> mtx(found->lock);
+  auto table = found->table;
   if (table == nullptr) {
     return Reservation();
   }
@@ -226,9 +432,12 @@ Metadata::Reservation Metadata::alterTable(index_t idx) {
 }
 
 Metadata::Reservation Metadata::dropTable(index_t idx) {
-  // assert: idx < limits::maximum_table_count
-  std::unique_lock<std::shared_mutex> mtx(data_.tableLocks[idx]);
-  auto table = data_.tables[idx];
+  auto *found = findSlot(idx);
+  if (found == nullptr) {
+    return Reservation();
+  }
+  std::unique_lock<std::shared_mutex> mtx(found->lock);
+  auto table = found->table;
   if (table == nullptr) {
     return Reservation();
   }
@@ -237,10 +446,124 @@ Metadata::Reservation Metadata::dropTable(index_t idx) {
 
 Metadata::index_t Metadata::size() const { return data_.tableCount; }
 
+Metadata::index_t Metadata::maximumTableCount() const {
+  return data_.maximumTableCount;
+}
+
 table_cptr Metadata::operator[](Metadata::index_t idx) const {
-  // assert: idx < limits::maximum_table_count
-  std::shared_lock<std::shared_mutex> mtx(data_.tableLocks[idx]);
-  return data_.tables[idx];
+  ReadGuard guard(*this);
+  return guard.share(guard[idx]);
+}
+
+Metadata::ReadGuard::ReadGuard(Metadata const &meta) : meta_(meta) {
+  epochs().pin();
+}
+
+Metadata::ReadGuard::~ReadGuard() { epochs().unpin(); }
+
+Table const *Metadata::ReadGuard::operator[](Metadata::index_t idx) const {
+  auto *found = meta_.findSlot(idx);
+  if (found == nullptr) {
+    return nullptr;
+  }
+  return found->published.load(std::memory_order_acquire);
+}
+
+table_cptr Metadata::ReadGuard::share(Table const *table) const {
+  // still owned by the slot, or by the retired list while this guard exists
+  return table == nullptr ? nullptr : table->shared_from_this();
+}
+
+TableSet::TableSet(std::uint64_t generation, tables_t tables)
+    : generation_(generation), tables_(std::move(tables)) {}
+
+std::uint64_t Metadata::generation() const {
+  return data_.generation.load(std::memory_order_acquire);
+}
+
+TableSet const &TableSetCache::get(Metadata const &meta) {
+  if (snapshot == nullptr || source != &meta ||
+      snapshot->generation() != meta.generation()) {
+    snapshot = meta.tables();
+    source = &meta;
+  }
+  return *snapshot;
+}
+
+table_set_cptr Metadata::tables() const {
+  auto current = data_.tableSet.load(std::memory_order_acquire);
+  if (current != nullptr && current->generation() == generation()) {
+    return current;
+  }
+
+  // only one thread rebuilds, the others wait for its snapshot
+  std::unique_lock<std::mutex> lk(data_.tableSetLock);
+  current = data_.tableSet.load(std::memory_order_acquire);
+  // read before the tables, see 14. in the design notes
+  const auto built = generation();
+  if (current != nullptr && current->generation() == built) {
+    return current;
+  }
+
+  TableSet::tables_t tables;
+  tables.reserve(size());
+  {
+    ReadGuard guard(*this);
+    for (index_t idx = 0; idx < data_.reservedSize; ++idx) {
+      if (auto const *table = guard[idx]) {
+        tables.push_back(guard.share(table));
+      }
+    }
+  }
+
+  current = std::make_shared<const TableSet>(built, std::move(tables));
+  data_.tableSet.store(current, std::memory_order_release);
+  return current;
+}
+
+void Metadata::publish(Slot &target, table_t table) {
+  target.published.store(table.get(), std::memory_order_release);
+  data_.generation.fetch_add(1, std::memory_order_acq_rel);
+  auto previous = std::exchange(target.table, std::move(table));
+  if (previous != nullptr) {
+    epochs().retire(std::move(previous));
+  }
+}
+
+Metadata::index_t Metadata::findByName(std::string_view name) const {
+  std::shared_lock<std::shared_mutex> lk(data_.namesLock);
+  auto it = data_.names.find(name);
+  return it == data_.names.end() ? npos : it->second;
+}
+
+table_cptr Metadata::tableByName(std::string_view name) const {
+  while (true) {
+    const auto idx = findByName(name);
+    if (idx == npos) {
+      return nullptr;
+    }
+    auto table = (*this)[idx];
+    if (table != nullptr && table->name == name) {
+      return table;
+    }
+    // A DROP or rename is completing, and already updated the array, but not
+    // yet the name index. Retry with its updated state.
+    std::this_thread::yield();
+  }
+}
+
+void Metadata::updateNameIndex(std::string const &removed,
+                               std::string const &added, index_t idx) {
+  std::unique_lock<std::shared_mutex> lk(data_.namesLock);
+  if (!removed.empty()) {
+    auto it = data_.names.find(removed);
+    if (it != data_.names.end() && it->second == idx) {
+      data_.names.erase(it);
+    }
+  }
+  if (!added.empty()) {
+    data_.names.insert_or_assign(added, idx);
+  }
 }
 
 } // namespace metadata
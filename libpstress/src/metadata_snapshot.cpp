@@ -0,0 +1,261 @@
+#include "metadata_snapshot.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+
+namespace metadata {
+
+namespace {
+
+enum ColumnFlags : std::uint8_t {
+  nullable = 1,
+  primaryKey = 2,
+  autoIncrement = 4,
+  compressed = 8,
+};
+
+MetadataException writeError(std::filesystem::path const &path) {
+  return MetadataException(fmt::format("Can't write metadata snapshot '{}': {}",
+                                       path.string(), std::strerror(errno)));
+}
+
+// Writes the file and flushes it to disk, so it is complete before it is
+// renamed
+void writeSynced(std::filesystem::path const &path, std::string_view data) {
+  const int fd =
+      ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw writeError(path);
+  }
+  std::size_t offset = 0;
+  while (offset < data.size()) {
+    const auto res = ::write(fd, data.data() + offset, data.size() - offset);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      const auto error = writeError(path);
+      ::close(fd);
+      throw error;
+    }
+    offset += static_cast<std::size_t>(res);
+  }
+  if (::fsync(fd) != 0) {
+    const auto error = writeError(path);
+    ::close(fd);
+    throw error;
+  }
+  if (::close(fd) != 0) {
+    throw writeError(path);
+  }
+}
+
+// Makes the rename durable
+void syncDirectory(std::filesystem::path const &path) {
+  const auto directory =
+      path.has_parent_path() ? path.parent_path() : std::filesystem::path(".");
+  const int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    throw writeError(directory);
+  }
+  const bool synced = ::fsync(fd) == 0;
+  const auto error = writeError(directory);
+  ::close(fd);
+  if (!synced) {
+    throw error;
+  }
+}
+
+class Writer {
+public:
+  template <typename T> void put(T value) {
+    const auto offset = buffer.size();
+    buffer.resize(offset + sizeof(T));
+    std::memcpy(buffer.data() + offset, &value, sizeof(T));
+  }
+
+  void put(std::string_view value) {
+    put<std::uint32_t>(static_cast<std::uint32_t>(value.size()));
+    buffer.append(value);
+  }
+
+  std::string buffer;
+};
+
+class Reader {
+public:
+  Reader(std::string_view data, std::filesystem::path const &path)
+      : data(data), path(path) {}
+
+  template <typename T> T get() {
+    T value;
+    std::memcpy(&value, take(sizeof(T)).data(), sizeof(T));
+    return value;
+  }
+
+  std::string getString() {
+    const auto size = get<std::uint32_t>();
+    return std::string(take(size));
+  }
+
+  std::string_view take(std::size_t size) {
+    if (size > data.size() - position) {
+      throw MetadataException(
+          fmt::format("Truncated metadata snapshot '{}'", path.string()));
+    }
+    const auto result = data.substr(position, size);
+    position += size;
+    return result;
+  }
+
+  template <typename E> E getEnum(E last) {
+    const auto value = get<std::uint8_t>();
+    if (value > static_cast<std::uint8_t>(last)) {
+      throw MetadataException(
+          fmt::format("Corrupted metadata snapshot '{}'", path.string()));
+    }
+    return static_cast<E>(value);
+  }
+
+private:
+  std::string_view data;
+  std::size_t position = 0;
+  std::filesystem::path const &path;
+};
+
+void writeTable(Writer &out, Table const &table) {
+  out.put(std::string_view(table.name));
+  out.put(std::string_view(table.engine));
+  out.put(std::string_view(table.tablespace));
+  out.put<std::int64_t>(table.statistics->rowEstimate.load());
+
+  out.put<std::uint32_t>(static_cast<std::uint32_t>(table.columns.size()));
+  for (auto const &col : table.columns) {
+    out.put(std::string_view(col.name));
+    out.put<std::uint8_t>(static_cast<std::uint8_t>(col.type));
+    out.put<std::uint64_t>(col.length);
+    out.put(std::string_view(col.default_value));
+    out.put<std::uint8_t>(static_cast<std::uint8_t>(col.generated));
+    out.put<std::uint8_t>((col.nullable ? nullable : 0) |
+                          (col.primary_key ? primaryKey : 0) |
+                          (col.auto_increment ? autoIncrement : 0) |
+                          (col.compressed ? compressed : 0));
+  }
+
+  out.put<std::uint32_t>(static_cast<std::uint32_t>(table.indexes.size()));
+  for (auto const &index : table.indexes) {
+    out.put(std::string_view(index.name));
+    out.put<std::uint32_t>(static_cast<std::uint32_t>(index.fields.size()));
+    for (auto const &field : index.fields) {
+      out.put(std::string_view(field));
+    }
+  }
+}
+
+Table readTable(Reader &in) {
+  Table table;
+  table.name = in.getString();
+  table.engine = in.getString();
+  table.tablespace = in.getString();
+  table.statistics->rowEstimate = in.get<std::int64_t>();
+
+  const auto columns = in.get<std::uint32_t>();
+  for (std::uint32_t idx = 0; idx < columns; ++idx) {
+    Column col;
+    col.name = in.getString();
+    col.type = in.getEnum(ColumnType::TEXT);
+    col.length = static_cast<std::uint32_t>(in.get<std::uint64_t>());
+    col.default_value = in.getString();
+    col.generated = in.getEnum(Generated::virt);
+    const auto flags = in.get<std::uint8_t>();
+    col.nullable = (flags & nullable) != 0;
+    col.primary_key = (flags & primaryKey) != 0;
+    col.auto_increment = (flags & autoIncrement) != 0;
+    col.compressed = (flags & compressed) != 0;
+    table.columns.push_back(std::move(col));
+  }
+
+  const auto indexes = in.get<std::uint32_t>();
+  for (std::uint32_t idx = 0; idx < indexes; ++idx) {
+    Index index;
+    index.name = in.getString();
+    const auto fields = in.get<std::uint32_t>();
+    for (std::uint32_t field = 0; field < fields; ++field) {
+      index.fields.emplace_back(in.getString());
+    }
+    table.indexes.push_back(std::move(index));
+  }
+
+  return table;
+}
+
+} // namespace
+
+void writeSnapshot(Metadata const &meta, std::filesystem::path const &path) {
+  Writer out;
+  out.buffer.append(snapshot_magic.data(), snapshot_magic.size());
+  out.put<std::uint32_t>(snapshot_version);
+  out.put<std::uint32_t>(0); // table count, filled in below
+
+  // The table count can change during the loop, only count what's written
+  std::uint32_t count = 0;
+  for (std::size_t idx = 0; idx < meta.size(); ++idx) {
+    if (auto table = meta[idx]) {
+      writeTable(out, *table);
+      count++;
+    }
+  }
+  std::memcpy(out.buffer.data() + snapshot_magic.size() + 4, &count,
+              sizeof(count));
+
+  auto temporary = path;
+  temporary += ".tmp";
+  writeSynced(temporary, out.buffer);
+
+  std::error_code ec;
+  std::filesystem::rename(temporary, path, ec);
+  if (ec) {
+    throw MetadataException(fmt::format("Can't write metadata snapshot '{}': {}",
+                                        path.string(), ec.message()));
+  }
+  syncDirectory(path);
+}
+
+std::vector<Table> readSnapshot(std::filesystem::path const &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw MetadataException(
+        fmt::format("Can't open metadata snapshot '{}'", path.string()));
+  }
+  const std::string data((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+
+  Reader in(data, path);
+  const auto magic = in.take(snapshot_magic.size());
+  if (!std::equal(magic.begin(), magic.end(), snapshot_magic.begin())) {
+    throw MetadataException(fmt::format(
+        "'{}' is not a pstress metadata snapshot", path.string()));
+  }
+  const auto version = in.get<std::uint32_t>();
+  if (version != snapshot_version) {
+    throw MetadataException(
+        fmt::format("Unsupported metadata snapshot version {} in '{}'",
+                    version, path.string()));
+  }
+
+  const auto count = in.get<std::uint32_t>();
+  std::vector<Table> tables;
+  tables.reserve(count);
+  for (std::uint32_t idx = 0; idx < count; ++idx) {
+    tables.push_back(readTable(in));
+  }
+  return tables;
+}
+
+} // namespace metadata
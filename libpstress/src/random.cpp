@@ -1,43 +1,109 @@
 
 #include "random.hpp"
 
-#include <algorithm>
-#include <functional>
+#include <atomic>
 #include <random>
-#include <vector>
 
 namespace {
-typedef std::vector<char> char_array;
-
-char_array charset() {
-  return char_array({'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A',
-                     'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L',
-                     'M', 'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W',
-                     'X', 'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h',
-                     'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's',
-                     't', 'u', 'v', 'w', 'x', 'y', 'z'});
-};
-
-inline std::string random_str(size_t length,
-                              std::function<char(void)> rand_char) {
-  std::string str(length, 0);
-  std::generate_n(str.begin(), length, rand_char);
-  return str;
+
+// 6 bits per character
+const constexpr std::size_t chars_per_word = 10;
+const constexpr char symbols[] =
+    "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz_-";
+static_assert(sizeof(symbols) == 64 + 1);
+
+std::uint64_t splitmix64(std::uint64_t &state) {
+  std::uint64_t z = (state += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+// FNV-1a, stable across platforms and standard library versions, unlike
+// std::hash
+std::uint64_t stream_hash(std::string_view stream) {
+  std::uint64_t hash = 0xcbf29ce484222325;
+  for (const char ch : stream) {
+    hash ^= static_cast<unsigned char>(ch);
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+std::uint64_t derive(std::uint64_t stream) {
+  std::uint64_t state = ps_random::run_seed() ^ stream;
+  return splitmix64(state);
 }
 
+std::uint64_t random_seed() {
+  std::random_device device;
+  return (static_cast<std::uint64_t>(device()) << 32) | device();
+}
+
+std::atomic<std::uint64_t> &run_seed_storage() {
+  static std::atomic<std::uint64_t> seed = random_seed();
+  return seed;
+}
+
+std::atomic<std::uint64_t> unnamed_streams = 0;
+
 } // namespace
-  //
 
-ps_random::ps_random() : seed(std::random_device{}()), rng(seed) {}
+xoshiro256ss::xoshiro256ss(std::uint64_t seed) {
+  for (auto &word : state) {
+    word = splitmix64(seed);
+  }
+}
+
+ps_random::ps_random()
+    : ps_random(derive(stream_hash("unnamed") + unnamed_streams++),
+                seeded_t{}) {}
+
+ps_random::ps_random(std::string_view stream)
+    : ps_random(derive(stream_hash(stream)), seeded_t{}) {}
+
+ps_random::ps_random(std::uint64_t seed, seeded_t) : seed(seed), rng(seed) {}
+
+ps_random ps_random::from_seed(std::uint64_t seed) {
+  return ps_random(seed, seeded_t{});
+}
+
+std::uint64_t ps_random::run_seed() {
+  return run_seed_storage().load(std::memory_order_relaxed);
+}
+
+void ps_random::set_run_seed(std::uint64_t seed) {
+  run_seed_storage().store(seed, std::memory_order_relaxed);
+  unnamed_streams = 0;
+}
 
 std::string ps_random::random_string(std::size_t min_length,
                                      std::size_t max_length) {
-  const auto ch_set = charset();
-
-  std::uniform_int_distribution<> dist(0, ch_set.size() - 1);
-  auto randchar = [&]() { return ch_set[dist(rng)]; };
+  std::string str;
+  append_string(str, min_length, max_length);
+  return str;
+}
 
-  auto length = random_number(min_length, max_length);
+void ps_random::append_string(std::string &out, std::size_t min_length,
+                              std::size_t max_length) {
+  const auto offset = out.size();
+  const auto length = random_number(min_length, max_length);
+  out.resize(offset + length);
+  fill_string(out.data() + offset, length);
+}
 
-  return random_str(length, randchar);
+void ps_random::fill_string(char *out, std::size_t length) {
+  std::size_t pos = 0;
+  for (; pos + chars_per_word <= length; pos += chars_per_word) {
+    const auto word = rng();
+    for (std::size_t idx = 0; idx < chars_per_word; ++idx) {
+      out[pos + idx] = symbols[(word >> (idx * 6)) & 63];
+    }
+  }
+  if (pos < length) {
+    const auto word = rng();
+    for (std::size_t idx = 0; pos + idx < length; ++idx) {
+      out[pos + idx] = symbols[(word >> (idx * 6)) & 63];
+    }
+  }
 }
@@ -0,0 +1,462 @@
+#include "schema_reconciler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <limits>
+
+#include <boost/algorithm/string/split.hpp>
+#include <spdlog/spdlog.h>
+
+namespace metadata {
+
+namespace {
+
+// numeric columns with more digits before the decimal point than this are
+// considered unlimited, the generated values are much smaller by default
+const constexpr std::uint32_t max_numeric_digits = 9;
+
+// One row per column, ordered by table. Parameters: schema (empty for the
+// current schema), include pattern (empty matches every table), array of
+// names read regardless of the filters
+const constexpr char catalog_query[] = R"(
+WITH tables AS (
+  SELECT c.oid, q.name, am.amname, c.reltuples,
+    (SELECT string_agg(quote_ident(ic.relname) || ':' ||
+         (SELECT string_agg(quote_ident(ia.attname), ' ' ORDER BY k.ord)
+          FROM unnest(x.indkey::int2[]) WITH ORDINALITY AS k(attnum, ord)
+          JOIN pg_attribute ia ON ia.attrelid = c.oid AND ia.attnum = k.attnum),
+         ';' ORDER BY ic.relname)
+     FROM pg_index x JOIN pg_class ic ON ic.oid = x.indexrelid
+     WHERE x.indrelid = c.oid AND NOT x.indisprimary) AS indexes
+  FROM pg_class c
+  JOIN pg_namespace n ON n.oid = c.relnamespace
+  LEFT JOIN pg_am am ON am.oid = c.relam
+  CROSS JOIN LATERAL (
+    SELECT CASE WHEN n.nspname = current_schema() THEN quote_ident(c.relname)
+           ELSE quote_ident(n.nspname) || '.' || quote_ident(c.relname)
+           END AS name) q
+  WHERE c.relkind IN ('r', 'p') AND NOT c.relispartition
+    AND ((n.nspname = COALESCE(NULLIF($1::text, ''), current_schema())
+          AND ($2::text = '' OR c.relname ~ $2::text))
+         OR q.name = ANY ($3::text[])))
+SELECT t.name, t.amname, quote_ident(a.attname),
+  format_type(a.atttypid, a.atttypmod),
+  EXISTS (SELECT 1 FROM pg_index p WHERE p.indrelid = t.oid AND p.indisprimary
+          AND a.attnum = ANY (p.indkey)),
+  a.attidentity <> '' OR
+    COALESCE(pg_get_expr(d.adbin, d.adrelid) LIKE 'nextval(%', false),
+  t.indexes, GREATEST(t.reltuples, 0)::bigint, NOT a.attnotnull,
+  a.atthasdef OR a.attgenerated <> '', a.attgenerated
+FROM tables t
+JOIN pg_attribute a ON a.attrelid = t.oid AND a.attnum > 0
+  AND NOT a.attisdropped
+LEFT JOIN pg_attrdef d ON d.adrelid = t.oid AND d.adnum = a.attnum
+ORDER BY t.name, a.attnum
+)";
+
+// Array literal for the names parameter
+std::string arrayLiteral(std::vector<std::string> const &values) {
+  std::string literal = "{";
+  for (auto const &value : values) {
+    if (literal.size() > 1) {
+      literal += ',';
+    }
+    literal += '"';
+    for (const char c : value) {
+      if (c == '"' || c == '\\') {
+        literal += '\\';
+      }
+      literal += c;
+    }
+    literal += '"';
+  }
+  return literal + '}';
+}
+
+// Largest integer numeric(precision, scale) can store, 0 without a precision
+// or with more than max_numeric_digits digits before the decimal point
+std::uint32_t numericLimit(std::uint32_t precision, std::uint32_t scale) {
+  if (precision == 0 || precision - scale > max_numeric_digits) {
+    return 0;
+  }
+  std::uint32_t limit = 1;
+  for (std::uint32_t digit = scale; digit < precision; ++digit) {
+    limit *= 10;
+  }
+  return limit - 1;
+}
+
+// Parses the output of format_type, e.g. "character varying(32)". Types
+// without an exact match are mapped to the nearest ColumnType pstress can
+// generate values for, numbers keep their range as the length of the column.
+bool parseType(std::string_view name, Column &col) {
+  std::uint32_t length = 0;
+  std::uint32_t scale = 0;
+  const auto paren = name.find('(');
+  if (paren != std::string_view::npos) {
+    const auto *end = name.data() + name.size();
+    const auto *pos =
+        std::from_chars(name.data() + paren + 1, end, length).ptr;
+    if (pos != end && *pos == ',') {
+      std::from_chars(pos + 1, end, scale);
+    }
+    name = name.substr(0, paren);
+  }
+
+  col.length = 0;
+  if (name == "integer" || name == "bigint") {
+    col.type = ColumnType::INT;
+  } else if (name == "smallint") {
+    col.type = ColumnType::INT;
+    col.length = std::numeric_limits<std::int16_t>::max();
+  } else if (name == "real" || name == "double precision") {
+    col.type = ColumnType::REAL;
+  } else if (name == "numeric") {
+    // e.g. numeric(3, 3) can't store 1
+    if (length > 0 && scale >= length) {
+      return false;
+    }
+    col.type = ColumnType::REAL;
+    col.length = numericLimit(length, scale);
+  } else if (name == "boolean") {
+    col.type = ColumnType::BOOL;
+  } else if (name == "bytea") {
+    col.type = ColumnType::BYTEA;
+  } else if (name == "text") {
+    col.type = ColumnType::TEXT;
+  } else if (name == "character varying") {
+    col.type = ColumnType::VARCHAR;
+    col.length = length;
+  } else if (name == "character") {
+    col.type = ColumnType::CHAR;
+    col.length = std::max<std::uint32_t>(length, 1);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// pg_attribute.attgenerated
+Generated parseGenerated(std::string_view value) {
+  if (value == "s") {
+    return Generated::stored;
+  }
+  if (value == "v") {
+    return Generated::virt;
+  }
+  return Generated::notGenerated;
+}
+
+// "name:col1 col2;name2:col3"
+void parseIndexes(std::string_view text, Table &table) {
+  std::vector<std::string> indexes;
+  boost::split(indexes, text, [](char c) { return c == ';'; });
+  for (auto const &def : indexes) {
+    const auto colon = def.find(':');
+    if (colon == std::string::npos) {
+      continue;
+    }
+    Index index;
+    index.name = def.substr(0, colon);
+    std::vector<std::string> fields;
+    boost::split(fields, def.substr(colon + 1),
+                 [](char c) { return c == ' '; });
+    for (auto const &field : fields) {
+      index.fields.emplace_back(field);
+    }
+    table.indexes.push_back(std::move(index));
+  }
+}
+
+// Calls fn for the columns of the catalog definition, the primary key columns
+// first: DELETE and UPDATE use the first column as the key. Otherwise the
+// columns stay in catalog order.
+template <typename fn_t> void forEachKeyFirst(Table const &catalog, fn_t &&fn) {
+  for (const bool key : {true, false}) {
+    for (auto const &col : catalog.columns) {
+      if (col.primary_key == key) {
+        fn(col);
+      }
+    }
+  }
+}
+
+Column const *findColumn(Table const &table, Identifier const &name) {
+  auto it = std::find_if(table.columns.begin(), table.columns.end(),
+                         [&](auto const &col) { return col.name == name; });
+  return it == table.columns.end() ? nullptr : &*it;
+}
+
+bool sameIndex(Index const &a, Index const &b) {
+  return a.name == b.name &&
+         std::equal(a.fields.begin(), a.fields.end(), b.fields.begin(),
+                    b.fields.end());
+}
+
+std::size_t countDifferences(Table const &tracked, Table const &catalog) {
+  std::size_t differences = 0;
+
+  for (auto const &col : catalog.columns) {
+    auto const *trackedCol = findColumn(tracked, col.name);
+    if (trackedCol == nullptr || trackedCol->type != col.type ||
+        trackedCol->length != col.length ||
+        trackedCol->primary_key != col.primary_key ||
+        trackedCol->auto_increment != col.auto_increment ||
+        trackedCol->generated != col.generated) {
+      differences++;
+    }
+  }
+  for (auto const &col : tracked.columns) {
+    if (findColumn(catalog, col.name) == nullptr) {
+      differences++;
+    }
+  }
+
+  // tables are created without an explicit access method
+  if (!tracked.engine.empty() && tracked.engine != catalog.engine) {
+    differences++;
+  }
+
+  for (auto const &index : catalog.indexes) {
+    if (std::none_of(tracked.indexes.begin(), tracked.indexes.end(),
+                     [&](auto const &i) { return sameIndex(i, index); })) {
+      differences++;
+    }
+  }
+  for (auto const &index : tracked.indexes) {
+    if (std::none_of(catalog.indexes.begin(), catalog.indexes.end(),
+                     [&](auto const &i) { return sameIndex(i, index); })) {
+      differences++;
+    }
+  }
+
+  return differences;
+}
+
+// Replaces the definition, keeping the column properties the catalog query
+// doesn't read
+void correct(Table &table, Table const &catalog) {
+  decltype(table.columns) columns;
+  forEachKeyFirst(catalog, [&](Column const &col) {
+    Column corrected = col;
+    if (auto const *trackedCol = findColumn(table, col.name)) {
+      corrected.default_value = trackedCol->default_value;
+      corrected.nullable = trackedCol->nullable;
+      corrected.compressed = trackedCol->compressed;
+    }
+    columns.push_back(std::move(corrected));
+  });
+
+  table.columns = std::move(columns);
+  table.engine = catalog.engine;
+  table.indexes = catalog.indexes;
+}
+
+} // namespace
+
+bool ReconcileReport::drift() const {
+  return correctedTables > 0 || removedTables > 0;
+}
+
+version_map_t trackedVersions(Metadata const &meta) {
+  version_map_t versions;
+  for (std::size_t idx = 0; idx < meta.size(); ++idx) {
+    if (auto table = meta[idx]) {
+      versions.emplace(table->name, table->version);
+    }
+  }
+  return versions;
+}
+
+std::vector<Table> readCatalog(sql_variant::LoggedSQL &connection,
+                               CatalogFilter const &filter) {
+  auto const &statement = connection.prepared(
+      {"catalog"}, 0, [] { return std::string(catalog_query); });
+  const std::array<std::string, 3> params{filter.schema, filter.include,
+                                          arrayLiteral(filter.names)};
+  const auto res = connection.executePrepared(statement, params);
+  res.maybeThrow();
+
+  std::vector<Table> tables;
+  // tables with required columns of unknown types are returned without
+  // columns, they exist but can't be tracked
+  bool supported = true;
+  const auto flagUnsupported = [&tables, &supported] {
+    if (!supported) {
+      tables.back().columns.clear();
+      tables.back().indexes.clear();
+    }
+  };
+  const auto rows = res.data != nullptr ? res.data->numRows() : 0;
+  for (std::size_t idx = 0; idx < rows; ++idx) {
+    const auto row = res.data->nextRow();
+    const auto value = [&row](std::size_t field) {
+      return row.rowData[field].value_or(std::string_view());
+    };
+
+    if (tables.empty() || tables.back().name != value(0)) {
+      if (!tables.empty()) {
+        flagUnsupported();
+      }
+      supported = true;
+
+      Table table;
+      table.name = value(0);
+      table.engine = value(1);
+      parseIndexes(value(6), table);
+      std::int64_t rowEstimate = 0;
+      std::from_chars(value(7).data(), value(7).data() + value(7).size(),
+                      rowEstimate);
+      table.statistics->rowEstimate = rowEstimate;
+      tables.push_back(std::move(table));
+    }
+
+    Column col;
+    col.name = value(2);
+    col.primary_key = value(4) == "t";
+    col.auto_increment = value(5) == "t";
+    col.nullable = value(8) == "t";
+    col.generated = parseGenerated(value(10));
+    if (!parseType(value(3), col)) {
+      const bool optional = col.nullable || value(9) == "t";
+      spdlog::debug("Catalog: column {}.{} has unsupported type {}, {}",
+                    value(0), value(2), value(3),
+                    optional ? "ignoring the column" : "skipping the table");
+      supported = supported && optional;
+      continue;
+    }
+    tables.back().columns.push_back(std::move(col));
+  }
+  if (!tables.empty()) {
+    flagUnsupported();
+  }
+
+  return tables;
+}
+
+ReconcileReport reconcile(Metadata &meta, version_map_t const &versions,
+                          std::vector<Table> const &catalog) {
+  ReconcileReport report;
+
+  std::unordered_map<std::string_view, Table const *> catalogByName;
+  for (auto const &table : catalog) {
+    catalogByName.emplace(table.name, &table);
+    if (!versions.contains(table.name)) {
+      report.untrackedTables++;
+    }
+  }
+
+  // the reservation still has to see the captured definition, otherwise a
+  // concurrent DDL completed since, which the catalog might not reflect
+  const auto unchanged = [](Table const &table, std::string const &name,
+                            std::uint64_t version) {
+    return table.name == name && table.version == version;
+  };
+
+  for (auto const &[name, version] : versions) {
+    const auto idx = meta.findByName(name);
+    if (idx == Metadata::npos) {
+      continue;
+    }
+
+    auto it = catalogByName.find(name);
+    if (it == catalogByName.end()) {
+      meta.dropTable(idx, [&](Metadata::Reservation &res) {
+        if (!res.open()) {
+          return;
+        }
+        if (!unchanged(*res.table(), name, version)) {
+          res.cancel();
+          return;
+        }
+        res.complete();
+        report.removedTables++;
+      });
+      continue;
+    }
+
+    // without columns: exists, but has columns of unsupported types
+    auto const &dbTable = *it->second;
+    auto tracked = meta[idx];
+    if (tracked == nullptr || dbTable.columns.empty() ||
+        countDifferences(*tracked, dbTable) == 0) {
+      continue;
+    }
+
+    meta.alterTable(idx, [&](Metadata::Reservation &res) {
+      if (!res.open()) {
+        return;
+      }
+      if (!unchanged(*res.table(), name, version)) {
+        res.cancel();
+        return;
+      }
+      report.differences += countDifferences(*res.table(), dbTable);
+      correct(*res.table(), dbTable);
+      res.complete();
+      report.correctedTables++;
+    });
+  }
+
+  return report;
+}
+
+ReconcileReport reconcileSchema(Metadata &meta,
+                                sql_variant::LoggedSQL &connection) {
+  const auto versions = trackedVersions(meta);
+
+  CatalogFilter filter;
+  for (auto const &[name, version] : versions) {
+    filter.names.push_back(name);
+  }
+  return reconcile(meta, versions, readCatalog(connection, filter));
+}
+
+std::size_t adopt(Metadata &meta, std::vector<Table> const &catalog) {
+  std::size_t adopted = 0;
+  for (auto const &dbTable : catalog) {
+    if (meta.findByName(dbTable.name) != Metadata::npos) {
+      continue;
+    }
+    if (dbTable.columns.empty()) {
+      continue;
+    }
+    // DELETE and UPDATE select rows by the first column, which has to be the
+    // whole primary key
+    const auto keys =
+        std::count_if(dbTable.columns.begin(), dbTable.columns.end(),
+                      [](auto const &col) { return col.primary_key; });
+    if (keys != 1) {
+      spdlog::debug("Catalog: table {} has {}, skipping the table",
+                    dbTable.name,
+                    keys == 0 ? "no primary key" : "a composite primary key");
+      continue;
+    }
+
+    auto res = meta.createTable();
+    if (!res.open()) {
+      spdlog::warn("Metadata is full, added {} of {} tables",
+                   adopted, catalog.size());
+      break;
+    }
+
+    auto &table = *res.table();
+    table.name = dbTable.name;
+    table.engine = dbTable.engine;
+    forEachKeyFirst(dbTable,
+                    [&](Column const &col) { table.columns.push_back(col); });
+    table.indexes = dbTable.indexes;
+    table.statistics->rowEstimate = dbTable.statistics->rowEstimate.load();
+    res.complete();
+    adopted++;
+  }
+  return adopted;
+}
+
+std::size_t adoptSchema(Metadata &meta, sql_variant::LoggedSQL &connection,
+                        CatalogFilter const &filter) {
+  return adopt(meta, readCatalog(connection, filter));
+}
+
+} // namespace metadata
@@ -1,8 +1,33 @@
 
 #include "sql_variant/generic.hpp"
+#include "sql_variant/sql_builder.hpp"
 
+#include <algorithm>
 #include <fmt/format.h>
-#include <spdlog/sinks/basic_file_sink.h>
+
+namespace {
+
+// SQL equivalent of a prepared statement execution, for the statement log and
+// the trace, which can also be replayed
+void executeStatement(std::string &buffer, std::string const &name,
+                      std::span<std::string const> params) {
+  sql_variant::SqlBuilder sql(buffer);
+  sql << "EXECUTE " << name;
+  if (!params.empty()) {
+    sql << '(';
+    sql.list(params, ", ", [](auto &out, std::string const &param) {
+      if (param == sql_variant::null_parameter) {
+        out << "NULL";
+      } else {
+        out.literal(param);
+      }
+    });
+    sql << ')';
+  }
+  sql << ';';
+}
+
+} // namespace
 
 namespace sql_variant {
 
@@ -12,30 +37,327 @@ GenericSQL::~GenericSQL() {}
 
 ServerInfo GenericSQL::serverInfo() const { return serverInfo_; }
 
+QueryResult GenericSQL::prepare(std::string const &,
+                                std::string const &) const {
+  throw SqlException("Prepared statements are not supported");
+}
+
+QueryResult GenericSQL::executePrepared(std::string const &,
+                                        std::span<std::string const>) const {
+  throw SqlException("Prepared statements are not supported");
+}
+
+QueryResult GenericSQL::copyFrom(std::string const &,
+                                 copy_producer_t const &) const {
+  throw SqlException("COPY is not supported");
+}
+
+bool GenericSQL::pipelineSupported() const { return false; }
+
+void GenericSQL::pipelineSend(std::string const &) {
+  throw SqlException("Pipelined execution is not supported");
+}
+
+void GenericSQL::pipelineSendPrepared(std::string const &,
+                                      std::span<std::string const>) {
+  throw SqlException("Pipelined execution is not supported");
+}
+
+QueryResult GenericSQL::pipelineReceive() {
+  throw SqlException("Pipelined execution is not supported");
+}
+
 LoggedSQL::LoggedSQL(std::unique_ptr<GenericSQL> sql,
-                     std::string const &logName)
-    : sql(std::move(sql)), logger(spdlog::basic_logger_st(
-                               fmt::format("sql-conn-{}", logName),
-                               fmt::format("logs/sql-conn-{}.log", logName))) {
+                     std::string const &logName,
+                     logging::StatementLogPolicy const &logPolicy)
+    : sql(std::move(sql)), log(logName, logPolicy),
+      trace(logPolicy.binaryTrace
+                ? std::make_unique<trace::TraceWriter>(logName)
+                : nullptr) {
   //
 }
 
 ServerInfo LoggedSQL::serverInfo() const { return sql->serverInfo(); }
 
 QueryResult LoggedSQL::executeQuery(std::string const &query) const {
-  //
-  logger->info("Statement: {}", query);
+  flushPipeline();
+
+  const bool logged = log.statement(query);
 
+  const auto start = std::chrono::steady_clock::now();
   auto res = sql->executeQuery(query);
+  accumulatedServerTime += res.executionTime;
+
+  completed(query, logged, start, traceAction, res);
+
+  return res;
+}
+
+void LoggedSQL::executeQueryPipelined(std::string const &query,
+                                      completion_t onComplete) const {
+  if (!pipelined()) {
+    const auto res = executeQuery(query);
+    if (onComplete) {
+      onComplete(res);
+    }
+    res.maybeThrow();
+    return;
+  }
+
+  while (pendingCount >= pipelineDepth) {
+    receivePipelined();
+  }
+
+  auto &slot = nextPending();
+  slot.query = query;
+  const bool logged = log.statement(query);
+  const auto start = std::chrono::steady_clock::now();
+  sql->pipelineSend(query);
+  queuePipelined(slot, logged, start, std::move(onComplete));
+}
+
+std::string const *
+LoggedSQL::findPrepared(std::initializer_list<std::string_view> key,
+                        std::uint64_t version) {
+  preparedKey.clear();
+  for (auto const &part : key) {
+    preparedKey += part;
+    preparedKey += '\0';
+  }
+
+  auto it = preparedStatements.find(preparedKey);
+  if (it == preparedStatements.end()) {
+    return nullptr;
+  }
+  if (it->second.version == version) {
+    it->second.lastUsed = ++preparedUses;
+    return &it->second.name;
+  }
+
+  // The definition changed (e.g. ALTER TABLE), the statement is outdated
+  const auto name = std::move(it->second.name);
+  preparedStatements.erase(it);
+  // errors don't matter, worst case the statement stays allocated
+  std::ignore = executeQuery(fmt::format("DEALLOCATE {};", name));
+  return nullptr;
+}
+
+std::string const &LoggedSQL::prepare(std::uint64_t version,
+                                      std::string const &query) {
+  flushPipeline();
+
+  auto name = fmt::format("pstress_{}", ++preparedCount);
+  SqlBuilder text(logText);
+  text << "PREPARE " << name << " AS " << query;
+  const bool logged = log.statement(logText);
+
+  const auto start = std::chrono::steady_clock::now();
+  const auto res = sql->prepare(name, query);
+  accumulatedServerTime += res.executionTime;
+
+  completed(logText, logged, start, traceAction, res);
+  res.maybeThrow();
+
+  while (preparedStatements.size() >= preparedLimit) {
+    evictPrepared();
+  }
+  auto [it, inserted] = preparedStatements.insert_or_assign(
+      preparedKey,
+      PreparedStatement{std::move(name), version, ++preparedUses});
+  return it->second.name;
+}
+
+// Only scans when the cache is full, which takes more tables than the
+// workload usually has at once
+void LoggedSQL::evictPrepared() {
+  const auto oldest = std::min_element(
+      preparedStatements.begin(), preparedStatements.end(),
+      [](auto const &a, auto const &b) {
+        return a.second.lastUsed < b.second.lastUsed;
+      });
+  const auto name = std::move(oldest->second.name);
+  preparedStatements.erase(oldest);
+  // errors don't matter, worst case the statement stays allocated
+  std::ignore = executeQuery(fmt::format("DEALLOCATE {};", name));
+}
+
+void LoggedSQL::setPreparedLimit(std::size_t limit) {
+  preparedLimit = std::max<std::size_t>(limit, 1);
+  while (preparedStatements.size() > preparedLimit) {
+    evictPrepared();
+  }
+}
+
+bool LoggedSQL::renderPrepared(std::string &text, std::string const &name,
+                               std::span<std::string const> params) const {
+  text.clear();
+  const bool logged = log.selectStatement();
+  if (logged || trace) {
+    executeStatement(text, name, params);
+  }
+  if (logged) {
+    log.logStatement(text);
+  }
+  return logged;
+}
+
+QueryResult
+LoggedSQL::executePrepared(std::string const &name,
+                           std::span<std::string const> params) const {
+  flushPipeline();
+
+  const bool logged = renderPrepared(logText, name, params);
+
+  const auto start = std::chrono::steady_clock::now();
+  auto res = sql->executePrepared(name, params);
+  accumulatedServerTime += res.executionTime;
+
+  if (!res.success() && logText.empty()) {
+    executeStatement(logText, name, params);
+  }
+  completed(logText, logged, start, traceAction, res);
+
+  return res;
+}
+
+void LoggedSQL::executePreparedPipelined(std::string const &name,
+                                         std::span<std::string const> params,
+                                         completion_t onComplete) const {
+  if (!pipelined()) {
+    const auto res = executePrepared(name, params);
+    if (onComplete) {
+      onComplete(res);
+    }
+    res.maybeThrow();
+    return;
+  }
+
+  while (pendingCount >= pipelineDepth) {
+    receivePipelined();
+  }
+
+  auto &slot = nextPending();
+  const bool logged = renderPrepared(slot.query, name, params);
+  if (slot.query.empty()) {
+    // only rendered if it fails, copying the parameters into the reused
+    // slot is cheaper than escaping them
+    slot.name = name;
+    slot.params.assign(params.begin(), params.end());
+  }
+  const auto start = std::chrono::steady_clock::now();
+  sql->pipelineSendPrepared(name, params);
+  queuePipelined(slot, logged, start, std::move(onComplete));
+}
+
+QueryResult LoggedSQL::copyFrom(std::string const &query,
+                                copy_producer_t const &producer) const {
+  flushPipeline();
+
+  const bool logged = log.statement(query);
+
+  auto res = sql->copyFrom(query, producer);
+  accumulatedServerTime += res.executionTime;
 
   if (!res.success()) {
-    logger->error("Error while executing SQL statement: {} {}",
-                  res.errorInfo.errorCode, res.errorInfo.errorMessage);
+    log.error(query, logged, res.errorInfo.errorCode,
+              res.errorInfo.errorMessage);
   }
 
   return res;
 }
 
+bool LoggedSQL::pipelined() const {
+  return pipelineDepth >= 2 && sql->pipelineSupported();
+}
+
+LoggedSQL::PendingQuery &LoggedSQL::nextPending() const {
+  if (pendingCount == pending.size()) {
+    // only grows up to the pipeline depth, the first slot moves to the front
+    std::rotate(pending.begin(), pending.begin() + pendingFirst, pending.end());
+    pendingFirst = 0;
+    pending.emplace_back();
+  }
+  auto &slot = pending[(pendingFirst + pendingCount) % pending.size()];
+  slot.query.clear();
+  slot.name.clear();
+  return slot;
+}
+
+void LoggedSQL::queuePipelined(PendingQuery &slot, bool logged,
+                               std::chrono::steady_clock::time_point start,
+                               completion_t onStatement) const {
+  slot.logged = logged;
+  slot.start = start;
+  slot.traceAction = traceAction;
+  slot.onStatement = std::move(onStatement);
+  slot.onComplete = pipelineCallback;
+  pendingCount++;
+  pipelinedCount++;
+}
+
+void LoggedSQL::receivePipelined() const {
+  auto &current = pending[pendingFirst];
+
+  const auto res = sql->pipelineReceive();
+  if (!res.success() && !current.name.empty()) {
+    executeStatement(current.query, current.name, current.params);
+  }
+  completed(current.query, current.logged, current.start, current.traceAction,
+            res);
+
+  // the callbacks could queue statements into the slot
+  auto onStatement = std::move(current.onStatement);
+  auto onComplete = std::move(current.onComplete);
+  current.onStatement = nullptr;
+  current.onComplete = nullptr;
+  pendingFirst = (pendingFirst + 1) % pending.size();
+  pendingCount--;
+
+  if (onStatement) {
+    onStatement(res);
+  }
+  if (onComplete) {
+    onComplete(res);
+  }
+}
+
+void LoggedSQL::completed(std::string_view query, bool logged,
+                          std::chrono::steady_clock::time_point start,
+                          std::string_view action,
+                          QueryResult const &res) const {
+  if (trace) {
+    trace::Record record;
+    record.timestamp = start - trace::epoch();
+    record.duration = std::chrono::steady_clock::now() - start;
+    record.worker = traceWorker;
+    res.errorInfo.errorCode.copy(record.sqlstate.data(),
+                                 record.sqlstate.size());
+    record.status = static_cast<std::uint8_t>(res.errorInfo.errorStatus);
+    record.action = action;
+    record.statement = query;
+    trace->write(record);
+  }
+
+  if (!res.success()) {
+    log.error(query, logged, res.errorInfo.errorCode,
+              res.errorInfo.errorMessage);
+  }
+}
+
+void LoggedSQL::setPipelineDepth(std::size_t depth) { pipelineDepth = depth; }
+
+void LoggedSQL::setPipelineCallback(completion_t callback) {
+  pipelineCallback = std::move(callback);
+}
+
+void LoggedSQL::flushPipeline() const {
+  while (pendingCount > 0) {
+    receivePipelined();
+  }
+}
+
+std::size_t LoggedSQL::pipelinedStatements() const { return pipelinedCount; }
+
 std::optional<std::string_view>
 LoggedSQL::querySingleValue(const std::string &sql) const {
 
@@ -47,7 +369,7 @@ LoggedSQL::querySingleValue(const std::string &sql) const {
 
   if (res.data == nullptr || res.data->numFields() < 1 ||
       res.data->numRows() < 1) {
-    logger->error("Received no data from the server");
+    log.message(logging::Level::error, "Received no data from the server");
     return std::nullopt;
   }
 
@@ -56,6 +378,29 @@ LoggedSQL::querySingleValue(const std::string &sql) const {
   return row.rowData[0];
 }
 
-void LoggedSQL::reconnect() { sql->reconnect(); }
+void LoggedSQL::reconnect() {
+  flushPipeline();
+  sql->reconnect();
+  // prepared statements are lost with the session
+  preparedStatements.clear();
+}
+
+std::chrono::nanoseconds LoggedSQL::serverTime() const {
+  return accumulatedServerTime;
+}
+
+void LoggedSQL::resetServerTime() {
+  accumulatedServerTime = std::chrono::nanoseconds(0);
+}
+
+std::string &LoggedSQL::sqlBuffer() { return statementBuffer; }
+
+void LoggedSQL::setTraceWorker(std::uint32_t worker) { traceWorker = worker; }
+
+void LoggedSQL::setTraceAction(std::string_view action) {
+  if (trace) {
+    traceAction = action;
+  }
+}
 
 } // namespace sql_variant
@@ -1,6 +1,9 @@
 
 #include "sql_variant/postgresql.hpp"
 
+#include <charconv>
+#include <cstring>
+#include <libpq-fe.h>
 #include <mutex>
 #include <pqxx/pqxx>
 #include <sstream>
@@ -38,6 +41,54 @@ struct PostgreSQLSpecificResult : sql_variant::QuerySpecificResult {
   }
 };
 
+// Result of a statement executed directly through libpq, without pqxx
+struct LibpqResult : sql_variant::QuerySpecificResult {
+
+  std::unique_ptr<PGresult, decltype(&PQclear)> result;
+  mutable int rowIdx;
+
+  LibpqResult(PGresult *result) : result(result, &PQclear), rowIdx(0) {}
+
+  ~LibpqResult() override {}
+
+  std::size_t numFields() const override {
+    return static_cast<std::size_t>(PQnfields(result.get()));
+  }
+
+  std::size_t numRows() const override {
+    return static_cast<std::size_t>(PQntuples(result.get()));
+  }
+
+  sql_variant::RowView nextRow() const override {
+
+    sql_variant::RowView rowResult;
+    rowResult.rowData.resize(numFields());
+
+    for (int colnum = 0; colnum < PQnfields(result.get()); ++colnum) {
+      if (!PQgetisnull(result.get(), rowIdx, colnum))
+        rowResult.rowData[static_cast<std::size_t>(colnum)] =
+            std::string_view(PQgetvalue(result.get(), rowIdx, colnum),
+                             static_cast<std::size_t>(
+                                 PQgetlength(result.get(), rowIdx, colnum)));
+    }
+    rowIdx++;
+
+    return rowResult;
+  }
+};
+
+// Fills the reused buffer, multi row inserts have thousands of parameters
+std::vector<char const *> const &
+paramValues(std::vector<char const *> &values,
+            std::span<std::string const> params) {
+  values.clear();
+  for (auto const &param : params) {
+    values.push_back(param == sql_variant::null_parameter ? nullptr
+                                                          : param.c_str());
+  }
+  return values;
+}
+
 std::string build_connection_string(sql_variant::ServerParams const &params) {
   std::string ret;
 
@@ -74,14 +125,29 @@ std::string build_connection_string(sql_variant::ServerParams const &params) {
 
 namespace sql_variant {
 
-PostgreSQL::PostgreSQL(ServerParams const &params) try
-    : params(params), connection(std::make_unique<pqxx::connection>(
-                          build_connection_string(params))) {
+PostgreSQL::PostgreSQL(ServerParams const &params) try : params(params) {
+  connect();
   serverInfo_ = calculateServerInfo();
 } catch (std::exception &err) {
   throw SqlException(err.what());
 }
 
+void PostgreSQL::connect() {
+  // Connects using libpq, so the raw handle is available for pipeline mode,
+  // which pqxx doesn't support
+  PGconn *conn = PQconnectdb(build_connection_string(params).c_str());
+  if (PQstatus(conn) != CONNECTION_OK) {
+    std::string message = PQerrorMessage(conn);
+    PQfinish(conn);
+    throw SqlException(message);
+  }
+
+  inFlight.clear();
+  raw = conn;
+  connection = std::make_unique<pqxx::connection>(
+      pqxx::connection::seize_raw_connection(conn));
+}
+
 PostgreSQL::~PostgreSQL() {}
 
 void PostgreSQL::logError(std::ostream &) const {
@@ -93,6 +159,8 @@ void PostgreSQL::logError(std::ostream &) const {
 QueryResult PostgreSQL::executeQuery(std::string const &query) const {
   QueryResult result;
 
+  exitPipeline();
+
   try {
     // TODO: explicit transactions!
     pqxx::nontransaction work(*connection);
@@ -138,8 +206,181 @@ std::string PostgreSQL::hostInfo() const {
 }
 
 void PostgreSQL::reconnect() {
-  connection =
-      std::make_unique<pqxx::connection>(build_connection_string(params));
+  connection.reset();
+  raw = nullptr;
+  connect();
+}
+
+QueryResult PostgreSQL::prepare(std::string const &name,
+                                std::string const &query) const {
+  exitPipeline();
+
+  const auto executedAt = std::chrono::high_resolution_clock::now();
+  return makeResult(PQprepare(raw, name.c_str(), query.c_str(), 0, nullptr),
+                    executedAt);
+}
+
+QueryResult
+PostgreSQL::executePrepared(std::string const &name,
+                            std::span<std::string const> params) const {
+  exitPipeline();
+
+  auto const &values = paramValues(paramBuffer, params);
+  const auto executedAt = std::chrono::high_resolution_clock::now();
+  return makeResult(PQexecPrepared(raw, name.c_str(),
+                                   static_cast<int>(values.size()),
+                                   values.data(), nullptr, nullptr, 0),
+                    executedAt);
+}
+
+QueryResult PostgreSQL::copyFrom(std::string const &query,
+                                 copy_producer_t const &producer) const {
+  exitPipeline();
+
+  const auto executedAt = std::chrono::high_resolution_clock::now();
+  PGresult *start = PQexec(raw, query.c_str());
+  if (PQresultStatus(start) != PGRES_COPY_IN) {
+    return makeResult(start, executedAt);
+  }
+  PQclear(start);
+
+  // The producer can fail (e.g. an exception), the COPY has to be ended in
+  // every case, otherwise the connection remains unusable
+  std::string buffer;
+  std::string error;
+  try {
+    bool more = true;
+    while (more) {
+      buffer.clear();
+      more = producer(buffer);
+      if (!buffer.empty() &&
+          PQputCopyData(raw, buffer.data(), static_cast<int>(buffer.size())) !=
+              1) {
+        break;
+      }
+    }
+  } catch (std::exception const &e) {
+    error = e.what();
+  }
+
+  PQputCopyEnd(raw, error.empty() ? nullptr : error.c_str());
+
+  PGresult *last = nullptr;
+  while (PGresult *res = PQgetResult(raw)) {
+    if (last != nullptr) {
+      PQclear(last);
+    }
+    last = res;
+  }
+  return makeResult(last, executedAt);
+}
+
+bool PostgreSQL::pipelineSupported() const {
+  // pipeline mode was added in libpq 14
+  return raw != nullptr && PQlibVersion() >= 140000;
+}
+
+void PostgreSQL::pipelineSend(std::string const &query) {
+  if (PQpipelineStatus(raw) == PQ_PIPELINE_OFF &&
+      PQenterPipelineMode(raw) != 1) {
+    throw SqlException(PQerrorMessage(raw));
+  }
+
+  // A sync after every statement: each runs in its own implicit transaction,
+  // and an error doesn't abort the statements after it
+  if (PQsendQueryParams(raw, query.c_str(), 0, nullptr, nullptr, nullptr,
+                        nullptr, 0) != 1 ||
+      PQpipelineSync(raw) != 1) {
+    throw SqlException(PQerrorMessage(raw));
+  }
+
+  inFlight.push_back(std::chrono::high_resolution_clock::now());
+}
+
+void PostgreSQL::pipelineSendPrepared(std::string const &name,
+                                      std::span<std::string const> params) {
+  if (PQpipelineStatus(raw) == PQ_PIPELINE_OFF &&
+      PQenterPipelineMode(raw) != 1) {
+    throw SqlException(PQerrorMessage(raw));
+  }
+
+  auto const &values = paramValues(paramBuffer, params);
+  if (PQsendQueryPrepared(raw, name.c_str(), static_cast<int>(values.size()),
+                          values.data(), nullptr, nullptr, 0) != 1 ||
+      PQpipelineSync(raw) != 1) {
+    throw SqlException(PQerrorMessage(raw));
+  }
+
+  inFlight.push_back(std::chrono::high_resolution_clock::now());
+}
+
+QueryResult PostgreSQL::pipelineReceive() {
+  const auto executedAt = inFlight.front();
+  inFlight.pop_front();
+
+  // The result of the statement, followed by a null, then the sync
+  PGresult *last = nullptr;
+  while (PGresult *res = PQgetResult(raw)) {
+    if (PQresultStatus(res) == PGRES_PIPELINE_SYNC) {
+      PQclear(res);
+      break;
+    }
+    if (last != nullptr) {
+      PQclear(last);
+    }
+    last = res;
+  }
+  if (last != nullptr) {
+    if (PGresult *sync = PQgetResult(raw)) {
+      PQclear(sync);
+    }
+  }
+
+  return makeResult(last, executedAt);
+}
+
+QueryResult
+PostgreSQL::makeResult(PGresult *res,
+                       std::chrono::high_resolution_clock::time_point
+                           executedAt) const {
+  QueryResult result;
+  result.executedAt = executedAt;
+  result.executionTime =
+      std::chrono::high_resolution_clock::now() - result.executedAt;
+
+  const auto status = res != nullptr ? PQresultStatus(res) : PGRES_FATAL_ERROR;
+  if (status == PGRES_COMMAND_OK || status == PGRES_TUPLES_OK) {
+    result.errorInfo.errorStatus = SqlStatus::success;
+
+    const char *affected = PQcmdTuples(res);
+    std::from_chars(affected, affected + std::strlen(affected),
+                    result.affectedRows);
+    result.data = std::make_unique<LibpqResult>(res);
+    return result;
+  }
+
+  const char *sqlstate =
+      res != nullptr ? PQresultErrorField(res, PG_DIAG_SQLSTATE) : nullptr;
+  result.errorInfo.errorCode = sqlstate != nullptr ? sqlstate : "";
+  result.errorInfo.errorMessage =
+      res != nullptr ? PQresultErrorMessage(res) : PQerrorMessage(raw);
+  result.errorInfo.errorStatus = PQstatus(raw) == CONNECTION_BAD
+                                     ? SqlStatus::serverGone
+                                     : SqlStatus::error;
+  if (res != nullptr) {
+    PQclear(res);
+  }
+
+  return result;
+}
+
+void PostgreSQL::exitPipeline() const {
+  if (raw != nullptr && PQpipelineStatus(raw) != PQ_PIPELINE_OFF) {
+    // only fails with results still pending, LoggedSQL receives them first
+    if (PQexitPipelineMode(raw) != 1) {
+      throw SqlException(PQerrorMessage(raw));
+    }
+  }
 }
 
 } // namespace sql_variant
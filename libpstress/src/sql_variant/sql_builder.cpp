@@ -0,0 +1,21 @@
+
+#include "sql_variant/sql_builder.hpp"
+
+namespace sql_variant {
+
+SqlBuilder &SqlBuilder::literal(std::string_view value) {
+  buffer += '\'';
+  while (true) {
+    const auto quote = value.find('\'');
+    buffer += value.substr(0, quote);
+    if (quote == std::string_view::npos) {
+      break;
+    }
+    buffer += "''";
+    value.remove_prefix(quote + 1);
+  }
+  buffer += '\'';
+  return *this;
+}
+
+} // namespace sql_variant
@@ -0,0 +1,157 @@
+#include "statistics/action_statistics.hpp"
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+namespace statistics {
+
+void ActionStatistics::recordSuccess(std::chrono::nanoseconds action,
+                                     std::chrono::nanoseconds server) {
+  actionTime.record(action);
+  serverTime.record(server);
+  successes.store(successes.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+}
+
+void ActionStatistics::recordFailure(std::string_view errorCode) {
+  failures.store(failures.load(std::memory_order_relaxed) + 1,
+                 std::memory_order_relaxed);
+
+  auto it = errors.find(errorCode);
+  if (it == errors.end()) {
+    std::unique_lock<std::mutex> lk(errorsMutex);
+    it = errors
+             .emplace(std::string(errorCode),
+                      std::make_unique<std::atomic<std::uint64_t>>(0))
+             .first;
+  }
+  it->second->store(it->second->load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+}
+
+void ActionStatistics::recordSkip() {
+  skips.store(skips.load(std::memory_order_relaxed) + 1,
+              std::memory_order_relaxed);
+}
+
+void ActionStatistics::reset() {
+  actionTime.reset();
+  serverTime.reset();
+  successes = 0;
+  failures = 0;
+  skips = 0;
+
+  std::unique_lock<std::mutex> lk(errorsMutex);
+  for (auto &[code, count] : errors) {
+    count->store(0, std::memory_order_relaxed);
+  }
+}
+
+void ActionStatistics::mergeErrorsInto(
+    std::map<std::string, std::uint64_t> &snapshot) const {
+  std::unique_lock<std::mutex> lk(errorsMutex);
+
+  for (auto const &[code, count] : errors) {
+    snapshot[code] += count->load(std::memory_order_relaxed);
+  }
+}
+
+void ActionSnapshot::merge(ActionStatistics const &stats) {
+  actionTime.merge(stats.actionTime);
+  serverTime.merge(stats.serverTime);
+  successes += stats.successes.load(std::memory_order_relaxed);
+  failures += stats.failures.load(std::memory_order_relaxed);
+  skips += stats.skips.load(std::memory_order_relaxed);
+  stats.mergeErrorsInto(errors);
+}
+
+void ActionSnapshot::merge(ActionSnapshot const &other) {
+  actionTime.merge(other.actionTime);
+  serverTime.merge(other.serverTime);
+  successes += other.successes;
+  failures += other.failures;
+  skips += other.skips;
+  for (auto const &[code, count] : other.errors) {
+    errors[code] += count;
+  }
+}
+
+void ActionSnapshot::subtract(ActionSnapshot const &earlier) {
+  actionTime.subtract(earlier.actionTime);
+  serverTime.subtract(earlier.serverTime);
+  successes = successes > earlier.successes ? successes - earlier.successes : 0;
+  failures = failures > earlier.failures ? failures - earlier.failures : 0;
+  skips = skips > earlier.skips ? skips - earlier.skips : 0;
+  for (auto &[code, count] : errors) {
+    auto it = earlier.errors.find(code);
+    if (it != earlier.errors.end()) {
+      count = count > it->second ? count - it->second : 0;
+    }
+  }
+}
+
+ActionStatistics &WorkerStatistics::action(std::string const &name) {
+  auto it = actions.find(name);
+  if (it != actions.end()) {
+    return *it->second;
+  }
+
+  std::unique_lock<std::mutex> lk(mutex);
+  return *actions.emplace(name, std::make_unique<ActionStatistics>())
+              .first->second;
+}
+
+void WorkerStatistics::mergeInto(snapshot_t &snapshot) const {
+  std::unique_lock<std::mutex> lk(mutex);
+
+  for (auto const &[name, stats] : actions) {
+    snapshot[name].merge(*stats);
+  }
+}
+
+void WorkerStatistics::reset() {
+  std::unique_lock<std::mutex> lk(mutex);
+
+  for (auto &[name, stats] : actions) {
+    stats->reset();
+  }
+}
+
+void subtract(snapshot_t &current, snapshot_t const &earlier) {
+  for (auto &[name, stats] : current) {
+    auto it = earlier.find(name);
+    if (it != earlier.end()) {
+      stats.subtract(it->second);
+    }
+  }
+}
+
+namespace {
+std::string formatHistogram(HistogramSnapshot const &histogram) {
+  return fmt::format("p50 {} p90 {} p99 {} p99.9 {} max {}",
+                     histogram.percentile(50), histogram.percentile(90),
+                     histogram.percentile(99), histogram.percentile(99.9),
+                     histogram.max());
+}
+} // namespace
+
+void logReport(std::string const &title, snapshot_t const &snapshot,
+               std::chrono::duration<double> interval) {
+  const auto seconds = interval.count() > 0 ? interval.count() : 1.0;
+
+  spdlog::info("{} ({:.1f}s), latencies in microseconds:", title,
+               interval.count());
+  for (auto const &[name, stats] : snapshot) {
+    if (stats.successes == 0 && stats.failures == 0 && stats.skips == 0) {
+      continue;
+    }
+    spdlog::info("  {}: ok {} ({:.1f}/s) failed {} ({:.1f}/s) skipped {} | "
+                 "action {} | server {}",
+                 name, stats.successes, stats.successes / seconds,
+                 stats.failures, stats.failures / seconds, stats.skips,
+                 formatHistogram(stats.actionTime),
+                 formatHistogram(stats.serverTime));
+  }
+}
+
+} // namespace statistics
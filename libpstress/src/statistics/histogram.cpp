@@ -0,0 +1,149 @@
+#include "statistics/histogram.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace statistics {
+
+namespace {
+const constexpr std::uint64_t sub_bucket_half =
+    std::uint64_t(1) << limits::histogram_sub_bucket_bits;
+const constexpr std::uint64_t linear_limit = sub_bucket_half * 2;
+
+// Single writer increment: no other thread modifies these counters, a load and
+// a store is enough, and a lot cheaper than fetch_add
+inline void increment(std::atomic<std::uint64_t> &counter,
+                      std::uint64_t value) {
+  counter.store(counter.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+}
+} // namespace
+
+Histogram::Histogram() { reset(); }
+
+void Histogram::record(std::uint64_t microseconds) {
+  increment(counts[bucketIndex(microseconds)], 1);
+  increment(totalCount, 1);
+  increment(totalSum, microseconds);
+  if (microseconds > maxValue.load(std::memory_order_relaxed)) {
+    maxValue.store(microseconds, std::memory_order_relaxed);
+  }
+}
+
+void Histogram::reset() {
+  for (auto &c : counts) {
+    c.store(0, std::memory_order_relaxed);
+  }
+  totalCount.store(0, std::memory_order_relaxed);
+  totalSum.store(0, std::memory_order_relaxed);
+  maxValue.store(0, std::memory_order_relaxed);
+}
+
+std::size_t Histogram::bucketIndex(std::uint64_t value) {
+  if (value < linear_limit) {
+    return value;
+  }
+  const unsigned msb = 63 - std::countl_zero(value);
+  if (msb >= limits::histogram_max_value_bits) {
+    return limits::histogram_bucket_count - 1;
+  }
+  const unsigned shift = msb - limits::histogram_sub_bucket_bits;
+  return (shift << limits::histogram_sub_bucket_bits) + (value >> shift);
+}
+
+std::uint64_t Histogram::bucketLowestValue(std::size_t index) {
+  if (index < linear_limit) {
+    return index;
+  }
+  const auto shift = (index >> limits::histogram_sub_bucket_bits) - 1;
+  const auto mantissa = (index & (sub_bucket_half - 1)) + sub_bucket_half;
+  return mantissa << shift;
+}
+
+std::uint64_t Histogram::bucketHighestValue(std::size_t index) {
+  if (index < linear_limit) {
+    return index;
+  }
+  const auto shift = (index >> limits::histogram_sub_bucket_bits) - 1;
+  return bucketLowestValue(index) + (std::uint64_t(1) << shift) - 1;
+}
+
+HistogramSnapshot::HistogramSnapshot()
+    : counts(limits::histogram_bucket_count, 0) {}
+
+void HistogramSnapshot::merge(Histogram const &histogram) {
+  for (std::size_t idx = 0; idx < counts.size(); ++idx) {
+    counts[idx] += histogram.counts[idx].load(std::memory_order_relaxed);
+  }
+  totalCount += histogram.totalCount.load(std::memory_order_relaxed);
+  totalSum += histogram.totalSum.load(std::memory_order_relaxed);
+  maxValue =
+      std::max(maxValue, histogram.maxValue.load(std::memory_order_relaxed));
+}
+
+void HistogramSnapshot::merge(HistogramSnapshot const &other) {
+  for (std::size_t idx = 0; idx < counts.size(); ++idx) {
+    counts[idx] += other.counts[idx];
+  }
+  totalCount += other.totalCount;
+  totalSum += other.totalSum;
+  maxValue = std::max(maxValue, other.maxValue);
+}
+
+void HistogramSnapshot::subtract(HistogramSnapshot const &earlier) {
+  // Counters are read without synchronization, a bucket can be slightly ahead
+  // of the total count or the other way around. Clamp instead of underflowing.
+  auto sub = [](std::uint64_t a, std::uint64_t b) { return a > b ? a - b : 0; };
+
+  std::size_t highest = 0;
+  for (std::size_t idx = 0; idx < counts.size(); ++idx) {
+    counts[idx] = sub(counts[idx], earlier.counts[idx]);
+    if (counts[idx] != 0) {
+      highest = idx;
+    }
+  }
+  totalCount = sub(totalCount, earlier.totalCount);
+  totalSum = sub(totalSum, earlier.totalSum);
+  // The exact maximum of the interval is unknown, the best we can do is the
+  // highest non empty bucket
+  maxValue =
+      totalCount == 0
+          ? 0
+          : std::min(maxValue, Histogram::bucketHighestValue(highest));
+}
+
+std::uint64_t HistogramSnapshot::count() const { return totalCount; }
+
+std::uint64_t HistogramSnapshot::sum() const { return totalSum; }
+
+std::uint64_t HistogramSnapshot::max() const { return maxValue; }
+
+double HistogramSnapshot::mean() const {
+  return totalCount == 0 ? 0.0
+                         : static_cast<double>(totalSum) /
+                               static_cast<double>(totalCount);
+}
+
+std::uint64_t HistogramSnapshot::percentile(double percentile) const {
+  if (totalCount == 0) {
+    return 0;
+  }
+
+  const auto target = std::max<std::uint64_t>(
+      1, static_cast<std::uint64_t>(std::ceil(
+             std::clamp(percentile, 0.0, 100.0) / 100.0 *
+             static_cast<double>(totalCount))));
+
+  std::uint64_t seen = 0;
+  for (std::size_t idx = 0; idx < counts.size(); ++idx) {
+    seen += counts[idx];
+    if (seen >= target) {
+      return std::min(Histogram::bucketHighestValue(idx), maxValue);
+    }
+  }
+
+  return maxValue;
+}
+
+} // namespace statistics
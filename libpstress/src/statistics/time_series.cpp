@@ -0,0 +1,98 @@
+#include "statistics/time_series.hpp"
+
+#include <stdexcept>
+
+#include <fmt/format.h>
+#include <rfl/json.hpp>
+
+namespace statistics {
+
+namespace {
+struct TimeSeriesRecord {
+  std::int64_t timestamp_ms;
+  double elapsed;
+  std::string action;
+  std::uint64_t successes;
+  std::uint64_t failures;
+  std::map<std::string, std::uint64_t> errors;
+  std::uint64_t action_time_sum_us;
+  std::uint64_t server_time_sum_us;
+};
+
+std::string errorCodeName(std::string const &code) {
+  return code.empty() ? "other" : code;
+}
+
+std::string csvField(std::string const &value) {
+  if (value.find_first_of(",\"\n") == std::string::npos) {
+    return value;
+  }
+  std::string quoted = "\"";
+  for (const char c : value) {
+    if (c == '"') {
+      quoted += '"';
+    }
+    quoted += c;
+  }
+  return quoted + '"';
+}
+} // namespace
+
+TimeSeriesWriter::TimeSeriesWriter(std::filesystem::path const &path)
+    : stream(path, std::ios::out | std::ios::trunc),
+      format(path.extension() == ".csv" ? TimeSeriesFormat::csv
+                                        : TimeSeriesFormat::json) {
+  if (!stream) {
+    throw std::runtime_error(
+        fmt::format("Can't open time series file {}", path.string()));
+  }
+  if (format == TimeSeriesFormat::csv) {
+    stream << "timestamp_ms,elapsed,action,successes,failures,errors,"
+              "action_time_sum_us,server_time_sum_us\n";
+    stream.flush();
+  }
+}
+
+void TimeSeriesWriter::write(std::chrono::system_clock::time_point timestamp,
+                             std::chrono::duration<double> elapsed,
+                             snapshot_t const &interval) {
+  const auto timestampMs =
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          timestamp.time_since_epoch())
+          .count();
+
+  for (auto const &[name, stats] : interval) {
+    if (format == TimeSeriesFormat::csv) {
+      // errors as CODE=count pairs separated by semicolons
+      std::string errors;
+      for (auto const &[code, count] : stats.errors) {
+        if (count > 0) {
+          errors += fmt::format("{}{}={}", errors.empty() ? "" : ";",
+                                errorCodeName(code), count);
+        }
+      }
+      stream << fmt::format("{},{:.3f},{},{},{},{},{},{}\n", timestampMs,
+                            elapsed.count(), csvField(name), stats.successes,
+                            stats.failures, errors, stats.actionTime.sum(),
+                            stats.serverTime.sum());
+    } else {
+      TimeSeriesRecord record{timestampMs,
+                              elapsed.count(),
+                              name,
+                              stats.successes,
+                              stats.failures,
+                              {},
+                              stats.actionTime.sum(),
+                              stats.serverTime.sum()};
+      for (auto const &[code, count] : stats.errors) {
+        if (count > 0) {
+          record.errors[errorCodeName(code)] += count;
+        }
+      }
+      stream << rfl::json::write(record) << '\n';
+    }
+  }
+  stream.flush();
+}
+
+} // namespace statistics
@@ -0,0 +1,86 @@
+#include "trace/replay.hpp"
+
+#include <atomic>
+#include <spdlog/spdlog.h>
+#include <thread>
+
+#include "trace/trace.hpp"
+
+namespace trace {
+
+ReplayResult replay(ReplayParams const &params, replay_connect_t connect) {
+  std::vector<std::unique_ptr<TraceReader>> readers;
+  std::optional<std::chrono::nanoseconds> traceStart;
+
+  for (auto const &path : params.traces) {
+    auto reader = std::make_unique<TraceReader>(path);
+    const auto first = reader->firstTimestamp();
+    if (first && (!traceStart || *first < *traceStart)) {
+      traceStart = first;
+    }
+    readers.push_back(std::move(reader));
+  }
+
+  std::atomic<std::size_t> statements = 0;
+  std::atomic<std::size_t> errors = 0;
+  std::atomic<std::size_t> mismatches = 0;
+
+  spdlog::info("Replaying {} traces with speed {}", readers.size(),
+               params.speed > 0 ? fmt::format("{}x", params.speed) : "max");
+
+  const auto replayStart = std::chrono::steady_clock::now();
+  {
+    std::vector<std::jthread> threads;
+    for (auto &reader : readers) {
+      threads.emplace_back([&, reader = reader.get()]() {
+        try {
+          auto conn =
+              connect(fmt::format("replay-{}", reader->connectionName()));
+
+          Record record;
+          std::string statement;
+          while (reader->next(record)) {
+            if (params.speed > 0) {
+              const auto offset = std::chrono::duration_cast<
+                  std::chrono::steady_clock::duration>(
+                  (record.timestamp - *traceStart) / params.speed);
+              std::this_thread::sleep_until(replayStart + offset);
+            }
+
+            conn->setTraceWorker(record.worker);
+            conn->setTraceAction(record.action);
+
+            statement.assign(record.statement);
+            const auto res = conn->executeQuery(statement);
+
+            statements++;
+            if (!res.success()) {
+              errors++;
+            }
+            if (res.errorInfo.errorCode != record.sqlstateView()) {
+              mismatches++;
+              spdlog::debug(
+                  "Replay of {} differs: originally '{}', now '{}' {}",
+                  reader->connectionName(), record.sqlstateView(),
+                  res.errorInfo.errorCode, res.errorInfo.errorMessage);
+            }
+          }
+        } catch (std::exception const &e) {
+          spdlog::error("Replay of {} stopped: {}", reader->connectionName(),
+                        e.what());
+        }
+      });
+    }
+  }
+
+  ReplayResult result{statements, errors, mismatches};
+  spdlog::info("Replay completed in {:.1f}s: {} statements, {} errors, {} "
+               "outcome mismatches",
+               std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                             replayStart)
+                   .count(),
+               result.statements, result.errors, result.mismatches);
+  return result;
+}
+
+} // namespace trace
@@ -0,0 +1,212 @@
+#include "trace/trace.hpp"
+
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace trace {
+
+namespace {
+const constexpr std::size_t trace_buffer_size = 8 * 1024 * 1024;
+
+// size, timestamp, duration, worker, sqlstate, status, action len, stmt len
+const constexpr std::size_t record_header_size = 4 + 8 + 8 + 4 + 5 + 1 + 2 + 4;
+
+template <typename T> char *put(char *out, T value) {
+  std::memcpy(out, &value, sizeof(T));
+  return out + sizeof(T);
+}
+
+template <typename T> char const *get(char const *in, T &value) {
+  std::memcpy(&value, in, sizeof(T));
+  return in + sizeof(T);
+}
+} // namespace
+
+std::chrono::steady_clock::time_point epoch() {
+  static const auto start = std::chrono::steady_clock::now();
+  return start;
+}
+
+std::string_view Record::sqlstateView() const {
+  return std::string_view(sqlstate.data(),
+                          strnlen(sqlstate.data(), sqlstate.size()));
+}
+
+TraceWriter::TraceWriter(std::string const &connectionName)
+    : stream(logging::AsyncWriter::instance().open(
+          fmt::format("trace-conn-{}", connectionName),
+          fmt::format("logs/trace-conn-{}.bin", connectionName),
+          trace_buffer_size, logging::Format::binary)) {
+  // make sure the epoch is initialized before the first statement
+  epoch();
+
+  std::array<char, 16> header;
+  auto out = header.data();
+  std::memcpy(out, trace_magic.data(), trace_magic.size());
+  out += trace_magic.size();
+  out = put<std::uint32_t>(out, trace_version);
+  put<std::uint32_t>(out, static_cast<std::uint32_t>(connectionName.size()));
+
+  stream->log(logging::Level::info,
+              {std::string_view(header.data(), header.size()),
+               connectionName});
+}
+
+void TraceWriter::write(Record const &record) {
+  const auto action = record.action.substr(0, 0xFFFF);
+  // A truncated record would corrupt the entire trace, truncate the statement
+  // instead. This only happens with multi megabyte statements.
+  const auto statement = record.statement.substr(
+      0, stream->maxMessageSize() - record_header_size - action.size());
+
+  std::array<char, record_header_size> header;
+  auto out = header.data();
+  out = put<std::uint32_t>(out, static_cast<std::uint32_t>(
+                                    record_header_size + action.size() +
+                                    statement.size()));
+  out = put<std::int64_t>(out, record.timestamp.count());
+  out = put<std::int64_t>(out, record.duration.count());
+  out = put<std::uint32_t>(out, record.worker);
+  std::memcpy(out, record.sqlstate.data(), record.sqlstate.size());
+  out += record.sqlstate.size();
+  out = put<std::uint8_t>(out, record.status);
+  out = put<std::uint16_t>(out, static_cast<std::uint16_t>(action.size()));
+  put<std::uint32_t>(out, static_cast<std::uint32_t>(statement.size()));
+
+  stream->log(logging::Level::info,
+              {std::string_view(header.data(), header.size()), action,
+               statement});
+}
+
+TraceReader::TraceReader(std::filesystem::path const &path) : path(path) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw TraceException(fmt::format("Can't open trace file '{}': {}",
+                                     path.string(), std::strerror(errno)));
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw TraceException(
+        fmt::format("Can't stat trace file '{}'", path.string()));
+  }
+  size = static_cast<std::size_t>(st.st_size);
+
+  if (size > 0) {
+    void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      ::close(fd);
+      throw TraceException(
+          fmt::format("Can't map trace file '{}'", path.string()));
+    }
+    ::madvise(mapping, size, MADV_SEQUENTIAL);
+    data = static_cast<char const *>(mapping);
+  }
+  ::close(fd);
+
+  std::uint32_t version = 0;
+  std::uint32_t nameLength = 0;
+  if (size < 16 ||
+      std::memcmp(data, trace_magic.data(), trace_magic.size()) != 0) {
+    throw TraceException(
+        fmt::format("'{}' is not a pstress trace file", path.string()));
+  }
+  auto in = get(data + trace_magic.size(), version);
+  in = get(in, nameLength);
+  if (version != trace_version) {
+    throw TraceException(fmt::format("Unsupported trace version {} in '{}'",
+                                     version, path.string()));
+  }
+  if (16 + nameLength > size) {
+    throw TraceException(
+        fmt::format("Truncated trace header in '{}'", path.string()));
+  }
+  connectionName_ = std::string(in, nameLength);
+  firstRecord = position = 16 + nameLength;
+}
+
+TraceReader::~TraceReader() {
+  if (data != nullptr) {
+    ::munmap(const_cast<char *>(data), size);
+  }
+}
+
+std::string const &TraceReader::connectionName() const {
+  return connectionName_;
+}
+
+// A rerun, or another connection with the same name, appends its own header
+// to the same file. Record sizes are limited by the log ring, so a record
+// never starts with the magic.
+std::size_t TraceReader::skipHeaders(std::size_t pos) const {
+  while (pos + 16 <= size &&
+         std::memcmp(data + pos, trace_magic.data(), trace_magic.size()) ==
+             0) {
+    std::uint32_t nameLength = 0;
+    get(data + pos + trace_magic.size() + 4, nameLength);
+    pos += 16 + nameLength;
+  }
+  return pos;
+}
+
+bool TraceReader::next(Record &record) {
+  position = skipHeaders(position);
+  if (position + record_header_size > size) {
+    // a partial record at the end is possible if pstress was killed
+    return false;
+  }
+
+  std::uint32_t recordSize = 0;
+  std::int64_t timestamp = 0;
+  std::int64_t duration = 0;
+  std::uint16_t actionLength = 0;
+  std::uint32_t statementLength = 0;
+
+  auto in = get(data + position, recordSize);
+  if (position + recordSize > size) {
+    return false;
+  }
+  if (recordSize < record_header_size) {
+    throw TraceException(fmt::format("Corrupted record at offset {} in '{}'",
+                                     position, path.string()));
+  }
+
+  in = get(in, timestamp);
+  in = get(in, duration);
+  in = get(in, record.worker);
+  std::memcpy(record.sqlstate.data(), in, record.sqlstate.size());
+  in += record.sqlstate.size();
+  in = get(in, record.status);
+  in = get(in, actionLength);
+  in = get(in, statementLength);
+
+  if (record_header_size + actionLength + statementLength != recordSize) {
+    throw TraceException(fmt::format("Corrupted record at offset {} in '{}'",
+                                     position, path.string()));
+  }
+
+  record.timestamp = std::chrono::nanoseconds(timestamp);
+  record.duration = std::chrono::nanoseconds(duration);
+  record.action = std::string_view(in, actionLength);
+  record.statement = std::string_view(in + actionLength, statementLength);
+
+  position += recordSize;
+  return true;
+}
+
+std::optional<std::chrono::nanoseconds> TraceReader::firstTimestamp() const {
+  const auto first = skipHeaders(firstRecord);
+  if (first + record_header_size > size) {
+    return std::nullopt;
+  }
+  std::int64_t timestamp = 0;
+  get(data + first + 4, timestamp);
+  return std::chrono::nanoseconds(timestamp);
+}
+
+} // namespace trace
@@ -2,41 +2,160 @@
 #include "workload.hpp"
 
 #include <chrono>
+#include <condition_variable>
+#include <optional>
 #include <spdlog/sinks/basic_file_sink.h>
 
 #include "action/action_registry.hpp"
+#include "metadata_snapshot.hpp"
 #include "sql_variant/generic.hpp"
 #include "sql_variant/postgresql.hpp"
 
 Worker::Worker(std::string const &name, logged_sql_ptr sql_conn,
-               action::AllConfig config, metadata_ptr metadata)
+               action::AllConfig config, metadata_ptr metadata,
+               connection_factory_t connection_factory)
     : name(name), sql_conn(std::move(sql_conn)), config(config),
-      metadata(metadata),
-      logger(spdlog::basic_logger_st(fmt::format("worker-{}", name),
-                                     fmt::format("logs/worker-{}.log", name))) {
-}
+      metadata(metadata), rand(name),
+      logger(spdlog::basic_logger_mt(fmt::format("worker-{}", name),
+                                     fmt::format("logs/worker-{}.log", name))),
+      connection_factory(std::move(connection_factory)) {}
 
 Worker::~Worker() {}
 
 void Worker::reconnect() { sql_conn->reconnect(); }
 
-void Worker::create_random_tables(std::size_t count) {
-  for (std::size_t i = 0; i < count; ++i) {
-    action::CreateTable creator(config.ddl, metadata::Table::Type::normal);
-    creator.execute(*metadata.get(), rand, sql_conn.get());
-  }
+void Worker::create_random_tables(std::size_t count, std::size_t threads) {
+  std::atomic<std::size_t> next = 0;
+  parallel(threads, [&](sql_variant::LoggedSQL *conn, ps_random &rand) {
+    while (next++ < count) {
+      action::CreateTable creator(config.ddl, metadata::Table::Type::normal);
+      creator.execute(*metadata.get(), rand, conn);
+    }
+  });
 }
 
-void Worker::generate_initial_data() {
+void Worker::generate_initial_data(InitialDataParams const &params) {
+  struct Chunk {
+    metadata::table_cptr table;
+    std::size_t rows;
+  };
+
+  std::vector<Chunk> chunks;
+  std::size_t totalRows = 0;
+  const auto chunkRows = std::max<std::size_t>(params.chunk_rows, 1);
   for (std::size_t idx = 0; idx < metadata->size(); ++idx) {
     auto table = (*metadata)[idx];
     if (table) {
-      for (std::size_t i = 0; i < 10; ++i) {
-        action::InsertData inserter(config.dml, table, 100);
-        inserter.execute(*metadata.get(), rand, sql_conn.get());
+      const auto rows =
+          params.size > 0
+              ? params.size / action::CopyData::estimatedRowSize(*table)
+              : params.rows;
+      for (std::size_t offset = 0; offset < rows; offset += chunkRows) {
+        chunks.push_back(Chunk{table, std::min(chunkRows, rows - offset)});
       }
+      totalRows += rows;
     }
   }
+
+  spdlog::info("Loading {} rows into {} tables, {} chunks, {} threads",
+               totalRows, metadata->size(), chunks.size(), params.threads);
+
+  std::atomic<std::size_t> nextChunk = 0;
+  std::atomic<std::size_t> loadedRows = 0;
+  std::atomic<std::size_t> failedChunks = 0;
+  const auto start = std::chrono::steady_clock::now();
+
+  std::jthread reporter;
+  if (params.progress_interval_in_seconds > 0) {
+    reporter = std::jthread([&](std::stop_token stop) {
+      std::mutex mutex;
+      std::condition_variable_any cv;
+      std::unique_lock<std::mutex> lk(mutex);
+      while (!cv.wait_for(
+          lk, stop, std::chrono::seconds(params.progress_interval_in_seconds),
+          [] { return false; })) {
+        const std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        const std::size_t loaded = loadedRows;
+        spdlog::info("Initial data: {}/{} rows ({:.1f}%), {:.0f} rows/s",
+                     loaded, totalRows,
+                     totalRows > 0 ? 100.0 * loaded / totalRows : 100.0,
+                     loaded / elapsed.count());
+      }
+    });
+  }
+
+  parallel(params.threads, [&](sql_variant::LoggedSQL *conn, ps_random &rand) {
+    for (auto idx = nextChunk++; idx < chunks.size(); idx = nextChunk++) {
+      auto const &chunk = chunks[idx];
+      const auto chunkStart = std::chrono::steady_clock::now();
+      try {
+        action::CopyData loader(config.dml, chunk.table, chunk.rows);
+        loader.execute(*metadata.get(), rand, conn);
+        loadedRows += chunk.rows;
+
+        const std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - chunkStart;
+        logger->info("Chunk {}/{}: {} rows into {} in {:.2f}s, {:.0f} rows/s",
+                     idx + 1, chunks.size(), chunk.rows, chunk.table->name,
+                     elapsed.count(), chunk.rows / elapsed.count());
+      } catch (std::exception const &e) {
+        failedChunks++;
+        logger->warn("Chunk {}/{} into {} failed: {}", idx + 1, chunks.size(),
+                     chunk.table->name, e.what());
+      }
+    }
+  });
+
+  if (reporter.joinable()) {
+    reporter.request_stop();
+    reporter.join();
+  }
+
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  spdlog::info("Initial data loaded: {} rows in {:.1f}s, {:.0f} rows/s, {} "
+               "failed chunks",
+               loadedRows.load(), elapsed.count(),
+               loadedRows / elapsed.count(), failedChunks.load());
+}
+
+void Worker::parallel(
+    std::size_t threads,
+    std::function<void(sql_variant::LoggedSQL *, ps_random &)> const &job) {
+  if (threads > 1 && !connection_factory) {
+    spdlog::warn("Worker {} can't open additional connections, running on a "
+                 "single connection",
+                 name);
+    threads = 1;
+  }
+
+  // The factory can run Lua callbacks (on_connect), which is only safe on the
+  // calling thread, the helpers only receive their connections
+  std::vector<std::jthread> helpers;
+  for (std::size_t idx = 1; idx < threads; ++idx) {
+    const auto helperName = fmt::format("{}-{}", name, idx);
+    logged_sql_ptr conn;
+    try {
+      conn = connection_factory(helperName);
+    } catch (std::exception const &e) {
+      spdlog::error("Worker {} helper thread {} failed: {}", name, idx,
+                    e.what());
+      continue;
+    }
+    helpers.emplace_back(
+        [this, idx, &job, helperName, conn = std::move(conn)]() {
+          try {
+            ps_random helperRand(helperName);
+            job(conn.get(), helperRand);
+          } catch (std::exception const &e) {
+            spdlog::error("Worker {} helper thread {} failed: {}", name, idx,
+                          e.what());
+          }
+        });
+  }
+
+  job(sql_conn.get(), rand);
 }
 
 sql_variant::LoggedSQL *Worker::sql_connection() const {
@@ -46,8 +165,12 @@ sql_variant::LoggedSQL *Worker::sql_connection() const {
 RandomWorker::RandomWorker(std::string const &name, logged_sql_ptr sql_conn,
                            action::AllConfig const &config,
                            metadata_ptr metadata,
-                           action::ActionRegistry const &actions)
-    : Worker(name, std::move(sql_conn), config, metadata), actions(actions) {}
+                           action::ActionRegistry const &actions,
+                           connection_factory_t connection_factory)
+    : Worker(name, std::move(sql_conn), config, metadata,
+             std::move(connection_factory)),
+      actions(actions),
+      stats(std::make_unique<statistics::WorkerStatistics>()) {}
 
 RandomWorker::~RandomWorker() { join(); }
 
@@ -55,35 +178,141 @@ void RandomWorker::run_thread(std::size_t duration_in_seconds) {
   spdlog::info("Worker {} starting, resetting statistics", name);
   successfulActions = 0;
   failedActions = 0;
+  skippedActions = 0;
   if (thread.joinable()) {
     spdlog::error("Error: thread is already running");
     return;
   }
+  stats->reset();
   thread = std::thread([this, duration_in_seconds]() {
     std::chrono::steady_clock::time_point begin =
         std::chrono::steady_clock::now();
     std::chrono::steady_clock::time_point now =
         std::chrono::steady_clock::now();
-    while (
-        std::chrono::duration_cast<std::chrono::seconds>(now - begin).count() <
-        static_cast<int64_t>(duration_in_seconds)) {
-      const auto w = rand.random_number(std::size_t(0), actions.totalWeight());
-      auto action = actions.lookupByWeightOffset(w).builder(config);
+    // refreshed when the registry changes, e.g. from lua during the run
+    action::selection_cptr selection;
+    std::uint64_t selectionGeneration = 0;
+    // actions are stateless, they are built once per selection snapshot and
+    // executed repeatedly
+    struct PreparedAction {
+      std::unique_ptr<action::Action> action;
+      statistics::ActionStatistics *stats;
+    };
+    std::vector<PreparedAction> prepared;
+    const auto end = begin + std::chrono::seconds(duration_in_seconds);
+    // open loop mode: actions start at scheduled times, independently of how
+    // long the previous ones took
+    std::optional<ArrivalSchedule> schedule;
+    if (targetRate > 0) {
+      schedule.emplace(targetRate, arrival, begin);
+    }
+    std::size_t lateActions = 0;
+
+    while (now < end) {
+      if (selection == nullptr ||
+          actions.generation() != selectionGeneration) {
+        selectionGeneration = actions.generation();
+        selection = actions.snapshot();
+        prepared.clear();
+        for (auto const &factory : selection->factories()) {
+          prepared.push_back(PreparedAction{factory.builder(config),
+                                            &stats->action(factory.name)});
+        }
+      }
+
+      const auto idx = selection->selectIndex(rand);
+      if (idx == action::ActionSelection::npos) {
+        // every weight is 0, wait for a registry change
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        now = std::chrono::steady_clock::now();
+        continue;
+      }
+      auto const &factory = selection->factories()[idx];
+      auto const &action = prepared[idx].action;
+      auto &actionStats = *prepared[idx].stats;
+      sql_conn->setTraceAction(factory.name);
+
+      // latencies are measured from the intended start in open loop mode, so
+      // they include the time spent waiting behind earlier slow actions
+      auto actionStart = std::chrono::steady_clock::now();
+      if (schedule) {
+        const auto intended = schedule->next(rand);
+        if (intended >= end) {
+          break;
+        }
+        if (intended > actionStart) {
+          std::this_thread::sleep_until(intended);
+        } else {
+          lateActions++;
+        }
+        actionStart = intended;
+      }
+
+      sql_conn->resetServerTime();
+      const auto pipelinedBefore = sql_conn->pipelinedStatements();
+      // pipelined actions are timed from the start of the action to the
+      // receipt of their result, the same wall time recorded for actions
+      // completed synchronously
+      sql_conn->setPipelineCallback(
+          [this, &actionStats,
+           actionStart](sql_variant::QueryResult const &res) {
+            recordPipelined(actionStats, res,
+                            std::chrono::steady_clock::now() - actionStart);
+          });
       try {
         action->execute(*metadata, rand, sql_conn.get());
-        successfulActions++;
+        // pipelined actions are accounted for when their result arrives
+        if (sql_conn->pipelinedStatements() == pipelinedBefore) {
+          successfulActions++;
+          actionStats.recordSuccess(std::chrono::steady_clock::now() -
+                                        actionStart,
+                                    sql_conn->serverTime());
+        }
+      } catch (action::ActionSkipped const &) {
+        skippedActions++;
+        actionStats.recordSkip();
+      } catch (sql_variant::SqlException const &e) {
+        failedActions++;
+        actionStats.recordFailure(e.errorCode());
+        logger->warn("Worker {} Action failed: {}", name, e.what());
       } catch (std::exception const &e) {
         failedActions++;
+        actionStats.recordFailure();
         logger->warn("Worker {} Action failed: {}", name, e.what());
       }
 
       now = std::chrono::steady_clock::now();
     }
-    spdlog::info("Worker {} exiting. Success: {}, failure: {}", name,
-                 successfulActions, failedActions);
+    sql_conn->flushPipeline();
+    sql_conn->setPipelineCallback(nullptr);
+    spdlog::info("Worker {} exiting. Success: {}, failure: {}, skipped: {}",
+                 name, successfulActions, failedActions, skippedActions);
+    if (schedule && lateActions > 0) {
+      spdlog::info("Worker {} started {} actions behind schedule", name,
+                   lateActions);
+    }
   });
 }
 
+void RandomWorker::recordPipelined(statistics::ActionStatistics &actionStats,
+                                   sql_variant::QueryResult const &res,
+                                   std::chrono::nanoseconds latency) {
+  if (res.success()) {
+    successfulActions++;
+    actionStats.recordSuccess(latency, res.executionTime);
+  } else {
+    failedActions++;
+    actionStats.recordFailure(res.errorInfo.errorCode);
+    logger->warn("Worker {} Action failed: {} {}", name,
+                 res.errorInfo.errorCode, res.errorInfo.errorMessage);
+  }
+}
+
+void RandomWorker::setTargetRate(double rate, Arrival arrival) {
+  targetRate = rate;
+  this->arrival = arrival;
+}
+
 void RandomWorker::join() {
   if (thread.joinable())
     thread.join();
@@ -92,38 +321,187 @@ void RandomWorker::join() {
 
 action::ActionRegistry &RandomWorker::possibleActions() { return actions; }
 
+statistics::WorkerStatistics const &RandomWorker::actionStatistics() const {
+  return *stats;
+}
+
 Workload::Workload(WorkloadParams const &params, SqlFactory const &sql_factory,
                    action::AllConfig const &default_config,
                    metadata_ptr metadata, action::ActionRegistry const &actions)
     : duration_in_seconds(params.duration_in_seconds),
-      repeat_times(params.repeat_times), actions(actions) {
+      repeat_times(params.repeat_times),
+      report_interval_in_seconds(params.report_interval_in_seconds),
+      actions(actions), metadata(metadata),
+      reconcile_interval_in_seconds(params.reconcile_interval_in_seconds) {
 
   if (repeat_times == 0)
     return;
 
+  if (!params.time_series_file.empty()) {
+    timeSeries = std::make_unique<statistics::TimeSeriesWriter>(
+        params.time_series_file);
+  }
+
+  if (reconcile_interval_in_seconds > 0) {
+    reconciler_conn = sql_factory.connect("Reconciler");
+  }
+
   for (std::size_t idx = 0; idx < params.number_of_workers; ++idx) {
     auto name = fmt::format("Worker {}", idx + 1);
     workers.emplace_back(name, sql_factory.connect(name), default_config,
-                         metadata, actions);
+                         metadata, actions, sql_factory.connectionFactory());
+    workers.back().sql_connection()->setTraceWorker(idx + 1);
+    workers.back().sql_connection()->setPipelineDepth(params.pipeline_depth);
+    workers.back().setTargetRate(params.target_rate / params.number_of_workers,
+                                 params.arrival);
   }
 }
 
 void Workload::run() {
+  runStarted = std::chrono::steady_clock::now();
   for (auto &worker : workers) {
     worker.run_thread(duration_in_seconds);
   }
+
+  if (report_interval_in_seconds > 0 && !reporter.joinable()) {
+    reporter = std::jthread(
+        [this](std::stop_token stop) { report_periodically(stop); });
+  }
+
+  if (timeSeries && !timeSeriesRecorder.joinable()) {
+    timeSeriesRecorder = std::jthread(
+        [this](std::stop_token stop) { record_time_series(stop); });
+  }
+
+  if (reconciler_conn && !reconciler.joinable()) {
+    reconciler = std::jthread(
+        [this](std::stop_token stop) { reconcile_periodically(stop); });
+  }
 }
 
 void Workload::wait_completion() {
   for (auto &worker : workers) {
     worker.join();
   }
+
+  if (reporter.joinable()) {
+    reporter.request_stop();
+    reporter.join();
+  }
+
+  if (timeSeriesRecorder.joinable()) {
+    timeSeriesRecorder.request_stop();
+    timeSeriesRecorder.join();
+  }
+
+  if (reconciler.joinable()) {
+    reconciler.request_stop();
+    reconciler.join();
+  }
+
+  if (workers.empty())
+    return;
+
+  statistics::logReport("Workload statistics, whole run", actionStatistics(),
+                        std::chrono::steady_clock::now() - runStarted);
+}
+
+void Workload::report_periodically(std::stop_token stop) {
+  std::mutex mutex;
+  std::condition_variable_any cv;
+
+  auto previous = actionStatistics();
+  auto previousTime = std::chrono::steady_clock::now();
+
+  std::unique_lock<std::mutex> lk(mutex);
+  while (!cv.wait_for(lk, stop,
+                      std::chrono::seconds(report_interval_in_seconds),
+                      [] { return false; }) &&
+         !stop.stop_requested()) {
+    auto current = actionStatistics();
+    const auto now = std::chrono::steady_clock::now();
+
+    auto interval = current;
+    statistics::subtract(interval, previous);
+    statistics::logReport("Workload statistics, last interval", interval,
+                          now - previousTime);
+
+    previous = std::move(current);
+    previousTime = now;
+  }
+}
+
+void Workload::record_time_series(std::stop_token stop) {
+  std::mutex mutex;
+  std::condition_variable_any cv;
+
+  auto previous = actionStatistics();
+  auto deadline = runStarted;
+
+  std::unique_lock<std::mutex> lk(mutex);
+  bool stopped = false;
+  while (!stopped) {
+    // absolute deadlines, so the buckets don't drift by the time spent writing
+    deadline += std::chrono::seconds(1);
+    stopped = cv.wait_until(lk, stop, deadline, [] { return false; }) ||
+              stop.stop_requested();
+
+    // the last, partial interval is written when the run completes
+    auto current = actionStatistics();
+    const auto now = std::chrono::steady_clock::now();
+
+    auto interval = current;
+    statistics::subtract(interval, previous);
+    timeSeries->write(std::chrono::system_clock::now(), now - runStarted,
+                      interval);
+
+    previous = std::move(current);
+  }
+}
+
+void Workload::reconcile_periodically(std::stop_token stop) {
+  std::mutex mutex;
+  std::condition_variable_any cv;
+
+  std::unique_lock<std::mutex> lk(mutex);
+  while (!cv.wait_for(lk, stop,
+                      std::chrono::seconds(reconcile_interval_in_seconds),
+                      [] { return false; }) &&
+         !stop.stop_requested()) {
+    try {
+      const auto report = metadata::reconcileSchema(*metadata, *reconciler_conn);
+      if (report.drift()) {
+        spdlog::warn("Schema reconciliation: corrected {} tables ({} "
+                     "differences), removed {} tables",
+                     report.correctedTables, report.differences,
+                     report.removedTables);
+      }
+      if (report.untrackedTables > 0) {
+        spdlog::debug("Schema reconciliation: {} untracked tables",
+                      report.untrackedTables);
+      }
+    } catch (std::exception const &e) {
+      // e.g. the server restarts, the next pass tries again
+      spdlog::warn("Schema reconciliation failed: {}", e.what());
+    }
+  }
+}
+
+statistics::snapshot_t Workload::actionStatistics() const {
+  statistics::snapshot_t snapshot;
+  for (auto const &worker : workers) {
+    worker.actionStatistics().mergeInto(snapshot);
+  }
+  return snapshot;
 }
 
 void Workload::reconnect_workers() {
   for (auto &worker : workers) {
     worker.reconnect();
   }
+  if (reconciler_conn) {
+    reconciler_conn->reconnect();
+  }
 }
 
 RandomWorker &Workload::worker(std::size_t idx) {
@@ -137,15 +515,19 @@ RandomWorker &Workload::worker(std::size_t idx) {
 std::size_t Workload::worker_count() const { return workers.size(); }
 
 SqlFactory::SqlFactory(sql_variant::ServerParams const &sql_params,
-                       on_connect_t connection_callback)
-    : sql_params(sql_params), connection_callback(connection_callback) {}
+                       on_connect_t connection_callback,
+                       logging::StatementLogPolicy const &log_policy)
+    : sql_params(sql_params), connection_callback(connection_callback),
+      log_policy(log_policy) {}
 
-Node::Node(SqlFactory const &sql_factory)
-    : sql_factory(sql_factory), metadata(new metadata::Metadata()) {}
+Node::Node(SqlFactory const &sql_factory, std::size_t maximum_table_count)
+    : sql_factory(sql_factory),
+      metadata(new metadata::Metadata(maximum_table_count)) {}
 
 std::unique_ptr<Worker> Node::make_worker(std::string const &name) {
   return std::make_unique<Worker>(name, sql_factory.connect(name),
-                                  default_config, metadata);
+                                  default_config, metadata,
+                                  sql_factory.connectionFactory());
 }
 
 std::shared_ptr<Workload>
@@ -157,7 +539,8 @@ Node::init_random_workload(WorkloadParams const &params) {
 std::unique_ptr<sql_variant::LoggedSQL>
 SqlFactory::connect(std::string const &connection_name) const {
   auto conn = std::make_unique<sql_variant::LoggedSQL>(
-      std::make_unique<sql_variant::PostgreSQL>(sql_params), connection_name);
+      std::make_unique<sql_variant::PostgreSQL>(sql_params), connection_name,
+      log_policy);
 
   if (connection_callback) {
     connection_callback(*conn.get());
@@ -168,6 +551,46 @@ SqlFactory::connect(std::string const &connection_name) const {
 
 action::ActionRegistry &Node::possibleActions() { return actions; }
 
+action::AllConfig &Node::defaultConfig() { return default_config; }
+
+metadata::Metadata const &Node::tables() const { return *metadata; }
+
+std::size_t Node::adopt_schema(metadata::CatalogFilter const &filter) {
+  auto conn = sql_factory.connect("Adopt");
+  const auto adopted = metadata::adoptSchema(*metadata, *conn, filter);
+  spdlog::info("Adopted {} existing tables", adopted);
+  return adopted;
+}
+
+void Node::save_metadata(std::filesystem::path const &path) const {
+  metadata::writeSnapshot(*metadata, path);
+  spdlog::info("Saved {} tables to {}", metadata->size(), path.string());
+}
+
+bool Node::load_metadata(std::filesystem::path const &path) {
+  if (!std::filesystem::exists(path)) {
+    return false;
+  }
+
+  const auto restored = metadata::adopt(*metadata, metadata::readSnapshot(path));
+  spdlog::info("Restored {} tables from {}", restored, path.string());
+
+  auto conn = sql_factory.connect("Restore");
+  const auto report = metadata::reconcileSchema(*metadata, *conn);
+  if (report.drift()) {
+    spdlog::warn("The database differs from the snapshot: corrected {} "
+                 "tables, removed {} tables",
+                 report.correctedTables, report.removedTables);
+  }
+  return true;
+}
+
+connection_factory_t SqlFactory::connectionFactory() const {
+  return [factory = *this](std::string const &connection_name) {
+    return factory.connect(connection_name);
+  };
+}
+
 sql_variant::ServerParams const &SqlFactory::params() const {
   return sql_params;
 }
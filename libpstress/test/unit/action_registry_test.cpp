@@ -0,0 +1,70 @@
+#include "action/action_registry.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <map>
+
+namespace {
+
+action::ActionFactory factory(std::string const &name, std::size_t weight) {
+  return action::ActionFactory{
+      name, [](action::AllConfig const &) { return nullptr; }, weight};
+}
+
+std::map<std::string, std::size_t> sample(action::ActionSelection const &sel,
+                                          std::size_t count) {
+  ps_random rand;
+  std::map<std::string, std::size_t> result;
+  for (std::size_t idx = 0; idx < count; ++idx) {
+    result[sel.select(rand)->name]++;
+  }
+  return result;
+}
+
+} // namespace
+
+TEST_CASE("Actions are selected according to their weights", "[registry]") {
+  action::ActionSelection sel(
+      {factory("a", 100), factory("b", 0), factory("c", 300), factory("d", 1)});
+
+  REQUIRE(sel.totalWeight() == 401);
+
+  const auto counts = sample(sel, 401000);
+  REQUIRE(!counts.contains("b"));
+  REQUIRE(counts.at("a") > 95000);
+  REQUIRE(counts.at("a") < 105000);
+  REQUIRE(counts.at("c") > 295000);
+  REQUIRE(counts.at("c") < 305000);
+  REQUIRE(counts.at("d") > 500);
+  REQUIRE(counts.at("d") < 1500);
+}
+
+TEST_CASE("Empty selections select nothing", "[registry]") {
+  ps_random rand;
+  REQUIRE(action::ActionSelection({}).select(rand) == nullptr);
+  REQUIRE(action::ActionSelection({factory("a", 0)}).select(rand) == nullptr);
+}
+
+TEST_CASE("Registry changes publish new snapshots", "[registry]") {
+  action::ActionRegistry registry;
+  registry.insert(factory("a", 1));
+  registry.insert(factory("b", 1));
+
+  const auto generation = registry.generation();
+  const auto before = registry.snapshot();
+
+  registry.getReference("a").setWeight(0);
+
+  REQUIRE(registry.generation() != generation);
+  REQUIRE(registry.getReference("a").weight() == 0);
+  // existing snapshots are immutable
+  REQUIRE(before->totalWeight() == 2);
+  REQUIRE(registry.snapshot()->totalWeight() == 1);
+  REQUIRE(sample(*registry.snapshot(), 100).at("b") == 100);
+
+  registry.remove("b");
+  ps_random rand;
+  REQUIRE(registry.snapshot()->select(rand) == nullptr);
+
+  REQUIRE_THROWS_AS(registry.getReference("b"), action::ActionException);
+}
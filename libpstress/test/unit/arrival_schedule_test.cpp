@@ -0,0 +1,47 @@
+#include "arrival_schedule.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <stdexcept>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("Uniform arrivals are evenly spaced", "[schedule]") {
+  ps_random rand;
+  const auto start = ArrivalSchedule::clock::now();
+  ArrivalSchedule schedule(1000, Arrival::uniform, start);
+
+  REQUIRE(schedule.next(rand) == start);
+  for (int idx = 1; idx <= 10000; ++idx) {
+    const auto offset = schedule.next(rand) - start;
+    // no drift from accumulated rounding
+    REQUIRE(offset >= std::chrono::milliseconds(idx) - 1us);
+    REQUIRE(offset <= std::chrono::milliseconds(idx) + 1us);
+  }
+}
+
+TEST_CASE("Poisson arrivals keep the mean rate", "[schedule]") {
+  ps_random rand;
+  const auto start = ArrivalSchedule::clock::now();
+  ArrivalSchedule schedule(1000, Arrival::poisson, start);
+
+  auto previous = schedule.next(rand);
+  for (int idx = 0; idx < 100000; ++idx) {
+    const auto current = schedule.next(rand);
+    REQUIRE(current >= previous);
+    previous = current;
+  }
+
+  // 100000 arrivals at 1000/s take 100s, the standard deviation is ~0.3s
+  REQUIRE(previous - start > 98s);
+  REQUIRE(previous - start < 102s);
+}
+
+TEST_CASE("Arrival names are parsed", "[schedule]") {
+  REQUIRE(parse_arrival("uniform") == Arrival::uniform);
+  REQUIRE(parse_arrival("poisson") == Arrival::poisson);
+  REQUIRE_THROWS_AS(parse_arrival("bursty"), std::runtime_error);
+  REQUIRE_THROWS_AS(
+      ArrivalSchedule(0, Arrival::uniform, ArrivalSchedule::clock::now()),
+      std::runtime_error);
+}
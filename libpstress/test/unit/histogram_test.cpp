@@ -0,0 +1,104 @@
+#include "statistics/histogram.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <thread>
+
+using statistics::Histogram;
+using statistics::HistogramSnapshot;
+
+TEST_CASE("Histogram buckets are contiguous", "[histogram]") {
+  for (std::size_t idx = 1; idx < statistics::limits::histogram_bucket_count;
+       ++idx) {
+    REQUIRE(Histogram::bucketLowestValue(idx) ==
+            Histogram::bucketHighestValue(idx - 1) + 1);
+    REQUIRE(Histogram::bucketIndex(Histogram::bucketLowestValue(idx)) == idx);
+    REQUIRE(Histogram::bucketIndex(Histogram::bucketHighestValue(idx)) == idx);
+  }
+}
+
+TEST_CASE("Histogram relative error is bounded", "[histogram]") {
+  for (std::uint64_t value = 1; value < (std::uint64_t(1) << 32);
+       value = value * 3 + 1) {
+    const auto idx = Histogram::bucketIndex(value);
+    const auto high = Histogram::bucketHighestValue(idx);
+    REQUIRE(Histogram::bucketLowestValue(idx) <= value);
+    REQUIRE(high >= value);
+    REQUIRE(static_cast<double>(high - value) / value < 0.016);
+  }
+}
+
+TEST_CASE("Empty histogram is sane", "[histogram]") {
+  Histogram histogram;
+  HistogramSnapshot snapshot;
+  snapshot.merge(histogram);
+
+  REQUIRE(snapshot.count() == 0);
+  REQUIRE(snapshot.max() == 0);
+  REQUIRE(snapshot.percentile(50) == 0);
+}
+
+TEST_CASE("Histogram percentiles", "[histogram]") {
+  Histogram histogram;
+
+  for (std::uint64_t value = 1; value <= 1000; ++value) {
+    histogram.record(value);
+  }
+
+  HistogramSnapshot snapshot;
+  snapshot.merge(histogram);
+
+  REQUIRE(snapshot.count() == 1000);
+  REQUIRE(snapshot.sum() == 500500);
+  REQUIRE(snapshot.max() == 1000);
+  REQUIRE(snapshot.percentile(50) >= 500);
+  REQUIRE(snapshot.percentile(50) <= 508);
+  REQUIRE(snapshot.percentile(99) >= 990);
+  REQUIRE(snapshot.percentile(99) <= 1000);
+  REQUIRE(snapshot.percentile(100) == 1000);
+}
+
+TEST_CASE("Histogram snapshots can be merged and subtracted", "[histogram]") {
+  Histogram first;
+  Histogram second;
+
+  first.record(std::chrono::milliseconds(1));
+  second.record(std::chrono::milliseconds(2));
+
+  HistogramSnapshot merged;
+  merged.merge(first);
+  merged.merge(second);
+
+  REQUIRE(merged.count() == 2);
+  REQUIRE(merged.max() == 2000);
+
+  second.record(std::chrono::microseconds(10));
+
+  HistogramSnapshot later;
+  later.merge(first);
+  later.merge(second);
+  later.subtract(merged);
+
+  REQUIRE(later.count() == 1);
+  REQUIRE(later.sum() == 10);
+  REQUIRE(later.max() == 10);
+}
+
+TEST_CASE("Histogram can be read while recording", "[histogram]") {
+  Histogram histogram;
+  const std::uint64_t total = 100000;
+
+  std::jthread writer([&]() {
+    for (std::uint64_t value = 0; value < total; ++value) {
+      histogram.record(value % 5000);
+    }
+  });
+
+  std::uint64_t lastCount = 0;
+  while (lastCount < total) {
+    HistogramSnapshot snapshot;
+    snapshot.merge(histogram);
+    REQUIRE(snapshot.count() >= lastCount);
+    lastCount = snapshot.count();
+  }
+}
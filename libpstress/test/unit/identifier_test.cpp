@@ -0,0 +1,106 @@
+#include "identifier.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+TEST_CASE("Identifiers are interned", "[metadata]") {
+  const metadata::Identifier first("unit_test_column");
+  const metadata::Identifier second(std::string("unit_test_") + "column");
+  const metadata::Identifier other("unit_test_other_column");
+
+  REQUIRE(first.id() == second.id());
+  REQUIRE(first == second);
+  REQUIRE(first != other);
+  REQUIRE(first == "unit_test_column");
+  REQUIRE(first.view().data() == second.view().data());
+  REQUIRE(fmt::format("{}", other) == "unit_test_other_column");
+
+  const metadata::Identifier empty;
+  REQUIRE(empty.empty());
+  REQUIRE(empty.view().empty());
+  REQUIRE(metadata::Identifier("").id() == 0);
+}
+
+TEST_CASE("Identifiers can be interned in parallel", "[metadata]") {
+  const auto before = metadata::internedIdentifiers();
+
+  // more names than fit into a single pool segment
+  const std::size_t names = 5000;
+  std::vector<std::vector<metadata::Identifier>> results(4);
+  std::vector<std::thread> threads;
+  for (auto &result : results) {
+    threads.emplace_back([&result] {
+      for (std::size_t idx = 0; idx < names; ++idx) {
+        result.emplace_back(fmt::format("unit_test_parallel_{}", idx));
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  REQUIRE(metadata::internedIdentifiers() == before + names);
+  for (std::size_t idx = 0; idx < names; ++idx) {
+    for (auto const &result : results) {
+      REQUIRE(result[idx] == results[0][idx]);
+    }
+    REQUIRE(results[0][idx] == fmt::format("unit_test_parallel_{}", idx));
+  }
+
+  results.clear();
+  REQUIRE(metadata::internedIdentifiers() == before);
+
+  // releasing the last reference races with interning the same name again
+  std::atomic<std::size_t> mismatches = 0;
+  threads.clear();
+  for (int thread = 0; thread < 4; ++thread) {
+    threads.emplace_back([&mismatches] {
+      for (std::size_t idx = 0; idx < 20000; ++idx) {
+        const auto value = fmt::format("unit_test_parallel_{}", idx % 10);
+        const metadata::Identifier name(value);
+        const metadata::Identifier copy = name;
+        mismatches += copy != value;
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  REQUIRE(mismatches == 0);
+  REQUIRE(metadata::internedIdentifiers() == before);
+}
+
+TEST_CASE("Identifiers are released with their last copy", "[metadata]") {
+  const auto before = metadata::internedIdentifiers();
+
+  std::uint32_t id = 0;
+  {
+    auto first = std::make_unique<metadata::Identifier>("unit_test_released");
+    id = first->id();
+    const metadata::Identifier copy = *first;
+    REQUIRE(metadata::internedIdentifiers() == before + 1);
+    first.reset();
+    REQUIRE(metadata::internedIdentifiers() == before + 1);
+    REQUIRE(copy == "unit_test_released");
+  }
+  REQUIRE(metadata::internedIdentifiers() == before);
+
+  // the id is reused
+  const metadata::Identifier other("unit_test_other_released");
+  REQUIRE(other.id() == id);
+  REQUIRE(other == "unit_test_other_released");
+
+  // e.g. random names of ADD COLUMN, freed with the old table definitions
+  for (std::size_t idx = 0; idx < 100000; ++idx) {
+    metadata::Identifier name(fmt::format("unit_test_col{}", idx));
+    name = fmt::format("unit_test_renamed{}", idx);
+    metadata::Identifier moved = std::move(name);
+    REQUIRE(moved == fmt::format("unit_test_renamed{}", idx));
+  }
+  REQUIRE(metadata::internedIdentifiers() == before + 1);
+}
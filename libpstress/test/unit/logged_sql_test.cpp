@@ -0,0 +1,368 @@
+#include "action/custom.hpp"
+#include "action/dml.hpp"
+#include "sql_variant/generic.hpp"
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <catch2/catch_test_macros.hpp>
+
+namespace {
+
+// Fails every statement starting with "ERR", records the order of calls
+class FakeSQL : public sql_variant::GenericSQL {
+public:
+  std::vector<std::string> &calls;
+  mutable std::string copied;
+  mutable std::size_t copyChunks = 0;
+
+  FakeSQL(std::vector<std::string> &calls) : calls(calls) {}
+
+  void logError(std::ostream &) const override {}
+
+  sql_variant::QueryResult
+  executeQuery(std::string const &query) const override {
+    calls.push_back("exec " + query);
+    return result(query);
+  }
+
+  std::string serverInfoString() const override { return ""; }
+
+  std::string hostInfo() const override { return ""; }
+
+  void reconnect() override {}
+
+  sql_variant::QueryResult prepare(std::string const &name,
+                                   std::string const &query) const override {
+    calls.push_back("prepare " + name + " " + query);
+    return result(query);
+  }
+
+  sql_variant::QueryResult
+  executePrepared(std::string const &name,
+                  std::span<std::string const> params) const override {
+    calls.push_back("execute " + name + " " + params[0]);
+    return result(params[0]);
+  }
+
+  sql_variant::QueryResult
+  copyFrom(std::string const &query,
+           sql_variant::copy_producer_t const &producer) const override {
+    calls.push_back("copy " + query);
+    std::string buffer;
+    bool more = true;
+    while (more) {
+      buffer.clear();
+      more = producer(buffer);
+      copied += buffer;
+      copyChunks++;
+    }
+    return result(query);
+  }
+
+  bool pipelineSupported() const override { return true; }
+
+  void pipelineSend(std::string const &query) override {
+    calls.push_back("send " + query);
+    inFlight.push_back(query);
+  }
+
+  void pipelineSendPrepared(std::string const &name,
+                            std::span<std::string const> params) override {
+    calls.push_back("send " + name + " " + params[0]);
+    inFlight.push_back(params[0]);
+  }
+
+  sql_variant::QueryResult pipelineReceive() override {
+    const auto query = inFlight.front();
+    inFlight.erase(inFlight.begin());
+    calls.push_back("receive " + query);
+    return result(query);
+  }
+
+private:
+  std::vector<std::string> inFlight;
+
+  static sql_variant::QueryResult result(std::string const &query) {
+    sql_variant::QueryResult res;
+    res.query = query;
+    if (query.starts_with("ERR")) {
+      res.errorInfo.errorCode = "42P01";
+      res.errorInfo.errorStatus = sql_variant::SqlStatus::error;
+    } else {
+      res.errorInfo.errorStatus = sql_variant::SqlStatus::success;
+    }
+    return res;
+  }
+};
+
+} // namespace
+
+TEST_CASE("Pipelined statements report results in order", "[pipeline]") {
+  std::vector<std::string> calls;
+  sql_variant::LoggedSQL sql(std::make_unique<FakeSQL>(calls),
+                             "unit-test-logged-sql");
+
+  std::vector<std::string> completions;
+  auto callbackFor = [&](std::string action) {
+    return [&completions, action](sql_variant::QueryResult const &res) {
+      completions.push_back(action + (res.success() ? " ok" : " failed"));
+    };
+  };
+
+  SECTION("Without a pipeline depth statements are synchronous") {
+    sql.executeQueryPipelined("A");
+    REQUIRE_THROWS_AS(sql.executeQueryPipelined("ERR"),
+                      sql_variant::SqlException);
+    REQUIRE(calls == std::vector<std::string>{"exec A", "exec ERR"});
+    REQUIRE(sql.pipelinedStatements() == 0);
+  }
+
+  SECTION("The depth limits statements in flight") {
+    sql.setPipelineDepth(2);
+
+    sql.setPipelineCallback(callbackFor("first"));
+    sql.executeQueryPipelined("A");
+    sql.setPipelineCallback(callbackFor("second"));
+    sql.executeQueryPipelined("ERR");
+    REQUIRE(completions.empty());
+
+    sql.setPipelineCallback(callbackFor("third"));
+    sql.executeQueryPipelined("B");
+    REQUIRE(completions == std::vector<std::string>{"first ok"});
+
+    sql.flushPipeline();
+    REQUIRE(completions == std::vector<std::string>{"first ok", "second failed",
+                                                    "third ok"});
+    REQUIRE(sql.pipelinedStatements() == 3);
+  }
+
+  SECTION("Synchronous statements wait for the pipeline") {
+    sql.setPipelineDepth(4);
+    sql.setPipelineCallback(callbackFor("dml"));
+    sql.executeQueryPipelined("A");
+    sql.executeQueryPipelined("B");
+
+    REQUIRE(sql.executeQuery("DDL").success());
+    REQUIRE(calls == std::vector<std::string>{"send A", "send B", "receive A",
+                                              "receive B", "exec DDL"});
+    REQUIRE(completions == std::vector<std::string>{"dml ok", "dml ok"});
+  }
+
+  SECTION("Statement completions run before the pipeline callback") {
+    sql.executeQueryPipelined("A", callbackFor("sync statement"));
+    REQUIRE_THROWS_AS(sql.executeQueryPipelined("ERR", callbackFor("sync err")),
+                      sql_variant::SqlException);
+
+    sql.setPipelineDepth(2);
+    sql.setPipelineCallback(callbackFor("action"));
+    sql.executeQueryPipelined("ERR", callbackFor("statement"));
+    sql.executeQueryPipelined("B");
+    sql.flushPipeline();
+
+    REQUIRE(completions ==
+            std::vector<std::string>{"sync statement ok", "sync err failed",
+                                     "statement failed", "action failed",
+                                     "action ok"});
+  }
+
+  SECTION("Slots of received statements are reused") {
+    sql.setPipelineDepth(3);
+    std::vector<std::string> expected;
+    for (int idx = 0; idx < 10; ++idx) {
+      const auto query = "Q" + std::to_string(idx);
+      sql.executeQueryPipelined(query, callbackFor(query));
+      expected.push_back(query + " ok");
+    }
+    sql.flushPipeline();
+    REQUIRE(completions == expected);
+    REQUIRE(sql.pipelinedStatements() == 10);
+  }
+
+  SECTION("Completions are released after they ran") {
+    sql.setPipelineDepth(2);
+    auto counter = std::make_shared<int>(0);
+    const std::weak_ptr<int> weak = counter;
+    sql.executeQueryPipelined("A",
+                              [counter](auto const &) { ++*counter; });
+    counter.reset();
+
+    REQUIRE(!weak.expired());
+    sql.flushPipeline();
+    REQUIRE(weak.expired());
+  }
+}
+
+TEST_CASE("Prepared statements are cached by key and version", "[prepared]") {
+  std::vector<std::string> calls;
+  sql_variant::LoggedSQL sql(std::make_unique<FakeSQL>(calls),
+                             "unit-test-logged-sql");
+
+  std::size_t builds = 0;
+  auto build = [&builds]() {
+    builds++;
+    return std::string("INSERT INTO foo VALUES ($1);");
+  };
+
+  auto const first = sql.prepared({"insert", "foo"}, 1, build);
+  REQUIRE(sql.prepared({"insert", "foo"}, 1, build) == first);
+  REQUIRE(builds == 1);
+
+  SECTION("Different keys are prepared separately") {
+    auto const other = sql.prepared({"insert", "bar"}, 1, build);
+    REQUIRE(other != first);
+    // key parts are separated, "insertfoo" is not "insert" + "foo"
+    REQUIRE(sql.prepared({"insertfoo", ""}, 1, build) != first);
+    REQUIRE(builds == 3);
+  }
+
+  SECTION("A new version replaces the statement") {
+    auto const second = sql.prepared({"insert", "foo"}, 2, build);
+    REQUIRE(second != first);
+    REQUIRE(builds == 2);
+    REQUIRE(calls[1] == "exec DEALLOCATE " + first + ";");
+  }
+
+  SECTION("Executions are pipelined") {
+    const std::array<std::string, 1> params{"A"};
+    REQUIRE(sql.executePrepared(first, params).success());
+
+    sql.setPipelineDepth(2);
+    sql.executePreparedPipelined(first, params);
+    REQUIRE(calls.back() == "send " + first + " A");
+    sql.flushPipeline();
+    REQUIRE(calls.back() == "receive A");
+  }
+
+  SECTION("The least recently used statement is deallocated") {
+    sql.setPreparedLimit(2);
+    auto const bar = sql.prepared({"insert", "bar"}, 1, build);
+    // foo is used again, bar is the least recently used
+    REQUIRE(sql.prepared({"insert", "foo"}, 1, build) == first);
+    sql.prepared({"insert", "baz"}, 1, build);
+    REQUIRE(calls.back() == "exec DEALLOCATE " + bar + ";");
+    REQUIRE(sql.prepared({"insert", "foo"}, 1, build) == first);
+    REQUIRE(builds == 3);
+    REQUIRE(sql.prepared({"insert", "bar"}, 1, build) != bar);
+    REQUIRE(builds == 4);
+  }
+
+  SECTION("Failed prepares are not cached") {
+    REQUIRE_THROWS_AS(sql.prepared({"insert", "baz"}, 1,
+                                   []() { return std::string("ERR"); }),
+                      sql_variant::SqlException);
+    sql.prepared({"insert", "baz"}, 1, build);
+    REQUIRE(builds == 2);
+  }
+}
+
+TEST_CASE("Prepared executions are only rendered when logged",
+          "[prepared]") {
+  const std::filesystem::path path = "logs/sql-conn-unit-test-lazy.log";
+  std::filesystem::remove(path);
+
+  std::vector<std::string> calls;
+  logging::StatementLogPolicy policy;
+  policy.mode = logging::StatementLogPolicy::Mode::errors;
+  {
+    sql_variant::LoggedSQL sql(std::make_unique<FakeSQL>(calls),
+                               "unit-test-lazy", policy);
+    auto const name = sql.prepared({"insert", "foo"}, 1, [] {
+      return std::string("INSERT INTO foo VALUES ($1, $2);");
+    });
+
+    const std::array<std::string, 2> ok{"A", "it's"};
+    const std::array<std::string, 2> failed{"ERR1", "it's"};
+    REQUIRE(sql.executePrepared(name, ok).success());
+    REQUIRE_FALSE(sql.executePrepared(name, failed).success());
+
+    sql.setPipelineDepth(2);
+    sql.executePreparedPipelined(name, ok);
+    // the parameters are reused by the caller before the result arrives
+    std::array<std::string, 2> reused{"ERR2", "it's"};
+    sql.executePreparedPipelined(name, reused);
+    reused[1] = "changed";
+    sql.flushPipeline();
+  }
+  logging::AsyncWriter::instance().flush();
+
+  std::ifstream file(path);
+  std::stringstream content;
+  content << file.rdbuf();
+  const auto log = content.str();
+  REQUIRE(log.find("EXECUTE pstress_1('A'") == std::string::npos);
+  REQUIRE(log.find("EXECUTE pstress_1('ERR1', 'it''s');") !=
+          std::string::npos);
+  REQUIRE(log.find("EXECUTE pstress_1('ERR2', 'it''s');") !=
+          std::string::npos);
+}
+
+TEST_CASE("Initial data is streamed with COPY", "[copy]") {
+  std::vector<std::string> calls;
+  auto fake = std::make_unique<FakeSQL>(calls);
+  auto &backend = *fake;
+  sql_variant::LoggedSQL sql(std::move(fake), "unit-test-logged-sql");
+
+  auto table = std::make_shared<metadata::Table>();
+  table->name = "foo";
+  auto addColumn = [&](std::string name, metadata::ColumnType type) {
+    metadata::Column col;
+    col.name = name;
+    col.type = type;
+    table->columns.push_back(col);
+  };
+  addColumn("id", metadata::ColumnType::INT);
+  table->columns.modify(0).auto_increment = true;
+  addColumn("a", metadata::ColumnType::INT);
+  addColumn("b", metadata::ColumnType::TEXT);
+
+  metadata::Metadata meta;
+  ps_random rand;
+  action::CopyData loader({}, table, 1000);
+  loader.execute(meta, rand, &sql);
+
+  REQUIRE(calls ==
+          std::vector<std::string>{"copy COPY foo (a, b) FROM STDIN;"});
+  REQUIRE(std::count(backend.copied.begin(), backend.copied.end(), '\n') ==
+          1000);
+  REQUIRE(std::count(backend.copied.begin(), backend.copied.end(), '\t') ==
+          1000);
+  // rows are sent in multiple chunks, not as a single buffer
+  REQUIRE(backend.copyChunks > 1);
+
+  REQUIRE(action::CopyData::estimatedRowSize(*table) > 500);
+}
+
+TEST_CASE("Custom statements get the injected table names", "[custom]") {
+  std::vector<std::string> calls;
+  sql_variant::LoggedSQL sql(std::make_unique<FakeSQL>(calls),
+                             "unit-test-logged-sql");
+
+  metadata::Metadata meta;
+  {
+    auto reservation = meta.createTable();
+    reservation.table()->name = "foo";
+    reservation.complete();
+  }
+
+  ps_random rand;
+  action::CustomSql custom({}, "SELECT {x} FROM {table} JOIN {table} {",
+                           {"table"});
+  custom.execute(meta, rand, &sql);
+  REQUIRE(calls ==
+          std::vector<std::string>{"exec SELECT {x} FROM foo JOIN foo {"});
+
+  action::CustomSql noTable({}, "SELECT 1", {});
+  noTable.execute(meta, rand, &sql);
+  REQUIRE(calls.back() == "exec SELECT 1");
+
+  action::CustomSql named({}, "ANALYZE {table:foo};", {});
+  named.execute(meta, rand, &sql);
+  REQUIRE(calls.back() == "exec ANALYZE foo;");
+
+  action::CustomSql untracked({}, "ANALYZE {table:bar};", {});
+  REQUIRE_THROWS_AS(untracked.execute(meta, rand, &sql), std::runtime_error);
+  REQUIRE(calls.back() == "exec ANALYZE foo;");
+}
@@ -0,0 +1,94 @@
+#include "metadata_snapshot.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_string.hpp>
+
+#include <fstream>
+
+namespace {
+
+void addTable(metadata::Metadata &meta, std::string const &name) {
+  auto res = meta.createTable();
+  res.table()->name = name;
+  res.table()->engine = "heap";
+
+  metadata::Column id;
+  id.name = "id";
+  id.type = metadata::ColumnType::INT;
+  id.primary_key = true;
+  id.auto_increment = true;
+  res.table()->columns.push_back(id);
+
+  metadata::Column value;
+  value.name = "value";
+  value.type = metadata::ColumnType::VARCHAR;
+  value.length = 32;
+  value.nullable = true;
+  value.default_value = "'x'";
+  res.table()->columns.push_back(value);
+
+  metadata::Index index;
+  index.name = name + "_value";
+  index.fields.emplace_back("value");
+  res.table()->indexes.push_back(index);
+
+  res.table()->statistics->rowEstimate = 12345;
+  res.complete();
+}
+
+} // namespace
+
+TEST_CASE("Metadata snapshots can be restored", "[metadata]") {
+  const std::filesystem::path path = "logs/unit-test-metadata.bin";
+  std::filesystem::create_directories(path.parent_path());
+
+  metadata::Metadata meta;
+  addTable(meta, "foo");
+  addTable(meta, "bar");
+  metadata::writeSnapshot(meta, path);
+
+  const auto tables = metadata::readSnapshot(path);
+  REQUIRE(tables.size() == 2);
+  REQUIRE(tables[0].name == "foo");
+  REQUIRE(tables[1].name == "bar");
+
+  auto const &table = tables[1];
+  REQUIRE(table.engine == "heap");
+  REQUIRE(table.statistics->rows() == 12345);
+  REQUIRE(table.columns.size() == 2);
+  REQUIRE(table.columns[0].primary_key);
+  REQUIRE(table.columns[0].auto_increment);
+  REQUIRE_FALSE(table.columns[0].nullable);
+  REQUIRE(table.columns[1].type == metadata::ColumnType::VARCHAR);
+  REQUIRE(table.columns[1].length == 32);
+  REQUIRE(table.columns[1].nullable);
+  REQUIRE(table.columns[1].default_value == "'x'");
+  REQUIRE(table.indexes.size() == 1);
+  REQUIRE(table.indexes[0].name == "bar_value");
+  REQUIRE(table.indexes[0].fields.size() == 1);
+  REQUIRE(table.indexes[0].fields[0] == "value");
+}
+
+TEST_CASE("Invalid metadata snapshots are rejected", "[metadata]") {
+  const std::filesystem::path path = "logs/unit-test-metadata-invalid.bin";
+  std::filesystem::create_directories(path.parent_path());
+
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << "not a snapshot";
+  }
+  REQUIRE_THROWS_WITH(
+      metadata::readSnapshot(path),
+      Catch::Matchers::ContainsSubstring("is not a pstress metadata snapshot"));
+
+  metadata::Metadata meta;
+  addTable(meta, "foo");
+  metadata::writeSnapshot(meta, path);
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 4);
+  REQUIRE_THROWS_WITH(
+      metadata::readSnapshot(path),
+      Catch::Matchers::ContainsSubstring("Truncated metadata snapshot"));
+
+  REQUIRE_THROWS_AS(metadata::readSnapshot("logs/no-such-snapshot.bin"),
+                    metadata::MetadataException);
+}
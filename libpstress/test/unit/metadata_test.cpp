@@ -1,12 +1,15 @@
 
 #include "metadata.hpp"
+#include "random.hpp"
 
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_string.hpp>
 
 #include <atomic>
+#include <fmt/format.h>
 #include <iostream>
 #include <thread>
+#include <vector>
 
 TEST_CASE("Empty metadata is sane", "[metadata]") {
   metadata::Metadata meta;
@@ -142,7 +145,7 @@ TEST_CASE("Tables can be inserted into metadata in parallel", "[metadata]") {
 TEST_CASE("Metadata table insertion fails over limit", "[metadata]") {
   metadata::Metadata meta;
 
-  const auto maxSize = metadata::limits::maximum_table_count;
+  const auto maxSize = meta.maximumTableCount();
 
   const std::size_t reservationCount = 3;
   const auto insertFirstCount = maxSize - reservationCount;
@@ -256,6 +259,24 @@ TEST_CASE("Tables can be altered in metadata", "[metadata]") {
   }
 }
 
+TEST_CASE("Completed table definitions get new versions", "[metadata]") {
+  metadata::Metadata meta;
+
+  meta.createTable([](auto &res) { res.table()->name = "foo"; });
+  meta.createTable([](auto &res) { res.table()->name = "bar"; });
+
+  const auto fooVersion = meta[0]->version;
+  REQUIRE(fooVersion != 0);
+  REQUIRE(meta[1]->version != fooVersion);
+
+  meta.alterTable(0, [](auto &res) { res.table()->name = "foo2"; });
+  REQUIRE(meta[0]->version > meta[1]->version);
+
+  meta.alterTable(0, [](auto &res) { res.cancel(); });
+  REQUIRE(meta[0]->name == "foo2");
+  REQUIRE(meta[0]->version > meta[1]->version);
+}
+
 TEST_CASE("Tables can be deleted in metadata", "[metadata]") {
   metadata::Metadata meta;
 
@@ -503,3 +524,314 @@ TEST_CASE("Interleaved delete and create works", "[metadata]") {
     REQUIRE(meta[3]->name == "foofoo");
   }
 }
+
+TEST_CASE("Tables can be found by name", "[metadata]") {
+  metadata::Metadata meta;
+
+  insert4tables(meta);
+
+  REQUIRE(meta.findByName("moo") == 2);
+  REQUIRE(meta.tableByName("moo")->name == "moo");
+  REQUIRE(meta.findByName("nothere") == metadata::Metadata::npos);
+  REQUIRE(meta.tableByName("nothere") == nullptr);
+
+  SECTION("Renames update the index") {
+    meta.alterTable(1, [](auto &res) { res.table()->name = "barbar"; });
+
+    REQUIRE(meta.findByName("bar") == metadata::Metadata::npos);
+    REQUIRE(meta.findByName("barbar") == 1);
+  }
+
+  SECTION("Cancelled renames don't update the index") {
+    meta.alterTable(1, [](auto &res) {
+      res.table()->name = "barbar";
+      res.cancel();
+    });
+
+    REQUIRE(meta.findByName("bar") == 1);
+    REQUIRE(meta.findByName("barbar") == metadata::Metadata::npos);
+  }
+
+  SECTION("Drops follow the defragmenting move") {
+    meta.dropTable(1);
+
+    REQUIRE(meta.findByName("bar") == metadata::Metadata::npos);
+    // boo got moved as it was last
+    REQUIRE(meta.findByName("boo") == 1);
+    REQUIRE(meta.tableByName("boo") == meta[1]);
+  }
+
+  SECTION("Drops at the end remove the name") {
+    meta.dropTable(3);
+
+    REQUIRE(meta.findByName("boo") == metadata::Metadata::npos);
+    REQUIRE(meta.findByName("moo") == 2);
+  }
+
+  SECTION("Cancelled creates aren't indexed") {
+    auto reservation = meta.createTable();
+    reservation.table()->name = "foofoo";
+    reservation.cancel();
+
+    REQUIRE(meta.findByName("foofoo") == metadata::Metadata::npos);
+  }
+}
+
+TEST_CASE("Metadata capacity is a runtime option", "[metadata]") {
+  const std::size_t maxSize = 5 * metadata::limits::table_segment_size + 3;
+  metadata::Metadata meta(maxSize);
+
+  REQUIRE(meta.maximumTableCount() == maxSize);
+  REQUIRE(meta[maxSize - 1] == nullptr);
+  REQUIRE(meta[maxSize] == nullptr);
+  REQUIRE(!meta.alterTable(maxSize - 1).open());
+
+  for (std::size_t i = 0; i < maxSize; ++i) {
+    meta.createTable([i](auto &res) {
+      REQUIRE(res.open());
+      res.table()->name = "foo" + std::to_string(i);
+    });
+  }
+
+  REQUIRE(meta.size() == maxSize);
+  REQUIRE(!meta.createTable().open());
+  REQUIRE(meta[maxSize - 1]->name == "foo" + std::to_string(maxSize - 1));
+
+  // the last table is moved across segments
+  meta.dropTable(1);
+  REQUIRE(meta.size() == maxSize - 1);
+  REQUIRE(meta[1]->name == "foo" + std::to_string(maxSize - 1));
+  REQUIRE(meta.findByName("foo" + std::to_string(maxSize - 1)) == 1);
+}
+
+TEST_CASE("Table statistics are kept across alters", "[metadata]") {
+  metadata::Metadata meta;
+
+  insert4tables(meta);
+
+  meta[1]->statistics->recordSuccess(std::chrono::milliseconds(2), 100);
+  meta[1]->statistics->recordFailure(std::chrono::milliseconds(1));
+  meta.alterTable(1, [](auto &res) { res.table()->name = "barbar"; });
+
+  auto const &stats = *meta[1]->statistics;
+  REQUIRE(stats.rows() == 100);
+  REQUIRE(stats.statements == 2);
+  REQUIRE(stats.failures == 1);
+  REQUIRE(stats.latencySum == 3000);
+
+  // deletes of rows inserted outside of pstress don't make it negative
+  meta[1]->statistics->recordSuccess(std::chrono::milliseconds(1), -150);
+  REQUIRE(stats.rows() == 0);
+
+  REQUIRE(meta[0]->statistics->rows() == 0);
+  REQUIRE(meta[0]->statistics != meta[1]->statistics);
+}
+
+TEST_CASE("Altered tables share unmodified columns", "[metadata]") {
+  metadata::Metadata meta;
+
+  {
+    auto res = meta.createTable();
+    res.table()->name = "foo";
+    for (auto const *name : {"a", "b", "c"}) {
+      metadata::Column col;
+      col.name = name;
+      col.type = metadata::ColumnType::INT;
+      res.table()->columns.push_back(col);
+    }
+    res.complete();
+  }
+  auto const original = meta[0];
+
+  meta.alterTable(0, [&](auto &res) {
+    // the copy made for the ALTER doesn't copy the columns
+    REQUIRE(res.table()->columns.shareCount() == 2);
+
+    res.table()->columns.modify(1).type = metadata::ColumnType::TEXT;
+    metadata::Column added;
+    added.name = "d";
+    added.type = metadata::ColumnType::BOOL;
+    res.table()->columns.push_back(added);
+    res.complete();
+  });
+
+  REQUIRE(original->columns.size() == 3);
+  REQUIRE(original->columns[1].type == metadata::ColumnType::INT);
+  REQUIRE(meta[0]->columns.size() == 4);
+  REQUIRE(meta[0]->columns[1].type == metadata::ColumnType::TEXT);
+  // unmodified columns are the same objects
+  REQUIRE(&meta[0]->columns[0] == &original->columns[0]);
+  REQUIRE(&meta[0]->columns[1] != &original->columns[1]);
+  REQUIRE(original->columns.shareCount() == 1);
+}
+
+TEST_CASE("Table sets are shared until DDL changes the tables",
+          "[metadata]") {
+  metadata::Metadata meta;
+
+  REQUIRE(meta.tables()->empty());
+
+  insert4tables(meta);
+
+  auto const before = meta.tables();
+  REQUIRE(before->size() == 4);
+  REQUIRE(before->generation() == meta.generation());
+  // no DDL, the same snapshot is returned
+  REQUIRE(meta.tables() == before);
+
+  meta.alterTable(1, [](auto &res) { res.table()->name = "barbar"; });
+  auto const altered = meta.tables();
+  REQUIRE(altered != before);
+  REQUIRE(altered->generation() > before->generation());
+  REQUIRE((*altered)[1]->name == "barbar");
+  // the previous snapshot is immutable
+  REQUIRE((*before)[1]->name != "barbar");
+
+  meta.dropTable(0);
+  auto const dropped = meta.tables();
+  REQUIRE(dropped->size() == 3);
+  for (auto const &table : *dropped) {
+    REQUIRE(table != nullptr);
+  }
+
+  // cancelled DDL doesn't invalidate the snapshot
+  meta.alterTable(0, [](auto &res) { res.cancel(); });
+  REQUIRE(meta.tables() == dropped);
+}
+
+TEST_CASE("Table set caches only reload after DDL", "[metadata]") {
+  metadata::Metadata meta;
+  insert4tables(meta);
+
+  metadata::TableSetCache cache;
+  auto const *first = &cache.get(meta);
+  REQUIRE(first->size() == 4);
+  REQUIRE(&cache.get(meta) == first);
+  // the cache holds its own reference
+  REQUIRE(meta.tables().use_count() == 3);
+
+  meta.dropTable(0);
+  REQUIRE(cache.get(meta).size() == 3);
+  REQUIRE(cache.get(meta).generation() == meta.generation());
+
+  // another metadata at the same generation isn't mixed up with this one
+  metadata::Metadata other;
+  insert4tables(other);
+  other.dropTable(1);
+  REQUIRE(other.generation() == meta.generation());
+  REQUIRE(cache.get(other)[0] == (*other.tables())[0]);
+}
+
+TEST_CASE("Tables can be read during concurrent DDL", "[metadata]") {
+  metadata::Metadata meta(64);
+
+  // every definition has as many columns as the number in its name
+  auto define = [](metadata::Table &table, std::size_t columns) {
+    table.name = fmt::format("t{}", columns);
+    table.columns.clear();
+    for (std::size_t idx = 0; idx < columns; ++idx) {
+      metadata::Column col;
+      col.name = fmt::format("c{}", idx);
+      col.type = metadata::ColumnType::INT;
+      table.columns.push_back(col);
+    }
+  };
+  auto consistent = [](metadata::Table const &table) {
+    return table.name == fmt::format("t{}", table.columns.size());
+  };
+
+  std::atomic<bool> stop = false;
+  std::atomic<std::size_t> inconsistent = 0;
+  std::atomic<std::size_t> reads = 0;
+  std::atomic<std::size_t> started = 0;
+
+  std::vector<std::jthread> readers;
+  for (std::size_t thread = 0; thread < 4; ++thread) {
+    readers.emplace_back([&, thread] {
+      started++;
+      while (!stop) {
+        const auto size = meta.size();
+        if (thread == 3) {
+          // snapshots, rebuilt by whichever reader first sees a new generation
+          for (auto const &table : *meta.tables()) {
+            if (!consistent(*table)) {
+              inconsistent++;
+            }
+          }
+        } else if (thread % 2 == 0) {
+          // owning reads
+          for (std::size_t idx = 0; idx < size; ++idx) {
+            if (auto table = meta[idx]; table && !consistent(*table)) {
+              inconsistent++;
+            }
+          }
+        } else {
+          // guarded reads, sharing some of the tables
+          metadata::Metadata::ReadGuard guard(meta);
+          for (std::size_t idx = 0; idx < size; ++idx) {
+            auto const *table = guard[idx];
+            if (table == nullptr) {
+              continue;
+            }
+            if (!consistent(*table)) {
+              inconsistent++;
+            }
+            if (idx % 8 == 0 && guard.share(table).get() != table) {
+              inconsistent++;
+            }
+          }
+        }
+        reads++;
+      }
+    });
+  }
+
+  while (started < readers.size()) {
+    std::this_thread::yield();
+  }
+
+  std::vector<std::jthread> writers;
+  for (std::size_t thread = 0; thread < 4; ++thread) {
+    writers.emplace_back([&] {
+      ps_random rand;
+      for (std::size_t op = 0; op < 2000; ++op) {
+        const auto size = meta.size();
+        const auto kind = rand.random_number<std::size_t>(0, 2);
+        if (kind == 0 || size == 0) {
+          auto res = meta.createTable();
+          if (res.open()) {
+            define(*res.table(), rand.random_number<std::size_t>(1, 8));
+            res.complete();
+          }
+        } else if (kind == 1) {
+          meta.alterTable(
+              rand.random_number<std::size_t>(0, size - 1), [&](auto &res) {
+                if (res.open()) {
+                  define(*res.table(),
+                         rand.random_number<std::size_t>(1, 8));
+                  res.complete();
+                }
+              });
+        } else {
+          meta.dropTable(rand.random_number<std::size_t>(0, size - 1),
+                         [](auto &res) {
+                           if (res.open()) {
+                             res.complete();
+                           }
+                         });
+        }
+      }
+    });
+  }
+
+  writers.clear();
+  stop = true;
+  readers.clear();
+
+  REQUIRE(reads > 0);
+  REQUIRE(inconsistent == 0);
+  for (std::size_t idx = 0; idx < meta.size(); ++idx) {
+    REQUIRE(meta[idx] != nullptr);
+    REQUIRE(consistent(*meta[idx]));
+  }
+}
@@ -0,0 +1,98 @@
+#include "random.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <limits>
+#include <set>
+
+TEST_CASE("Random streams are derived from the run seed", "[random]") {
+  ps_random::set_run_seed(42);
+  ps_random worker1("Worker 1");
+  ps_random worker2("Worker 2");
+  ps_random::set_run_seed(42);
+  ps_random again("Worker 1");
+
+  REQUIRE(worker1.stream_seed() == again.stream_seed());
+  REQUIRE(worker1.stream_seed() != worker2.stream_seed());
+  for (int idx = 0; idx < 100; ++idx) {
+    REQUIRE(worker1.random_number<std::uint64_t>() ==
+            again.random_number<std::uint64_t>());
+  }
+
+  ps_random::set_run_seed(43);
+  REQUIRE(ps_random("Worker 1").stream_seed() != worker1.stream_seed());
+
+  // unnamed streams are numbered from the seed
+  ps_random::set_run_seed(42);
+  const auto first = ps_random().stream_seed();
+  const auto second = ps_random().stream_seed();
+  REQUIRE(first != second);
+  ps_random::set_run_seed(42);
+  REQUIRE(ps_random().stream_seed() == first);
+}
+
+TEST_CASE("Random numbers stay in range", "[random]") {
+  auto rand = ps_random::from_seed(1);
+
+  std::set<int> seen;
+  for (int idx = 0; idx < 10000; ++idx) {
+    const auto value = rand.random_number(-3, 3);
+    REQUIRE(value >= -3);
+    REQUIRE(value <= 3);
+    seen.insert(value);
+
+    const auto real = rand.random_number(1.0, 2.0);
+    REQUIRE(real >= 1.0);
+    REQUIRE(real < 2.0);
+  }
+  REQUIRE(seen.size() == 7);
+
+  REQUIRE(rand.random_number(5, 5) == 5);
+
+  // ranges wider than an int aren't truncated
+  const std::size_t big = std::size_t(1) << 40;
+  bool above = false;
+  for (int idx = 0; idx < 100; ++idx) {
+    const auto value = rand.random_number<std::size_t>(big, big * 2);
+    REQUIRE(value >= big);
+    REQUIRE(value <= big * 2);
+    above |= value > std::numeric_limits<std::uint32_t>::max() + big;
+  }
+  REQUIRE(above);
+
+  const auto str = rand.random_string(3, 8);
+  REQUIRE(str.size() >= 3);
+  REQUIRE(str.size() <= 8);
+}
+
+TEST_CASE("Random strings are filled in bulk", "[random]") {
+  auto rand = ps_random::from_seed(2);
+
+  std::set<char> symbols;
+  // lengths around the 10 characters generated from every draw
+  for (std::size_t length = 0; length < 40; ++length) {
+    std::string str(length, '\0');
+    rand.fill_string(str.data(), length);
+    for (const char ch : str) {
+      REQUIRE((std::isalnum(static_cast<unsigned char>(ch)) || ch == '_' ||
+               ch == '-'));
+      symbols.insert(ch);
+    }
+  }
+  REQUIRE(symbols.size() == 64);
+
+  std::string out = "prefix";
+  rand.append_string(out, 20, 20);
+  REQUIRE(out.size() == 26);
+  REQUIRE(out.starts_with("prefix"));
+
+  std::array<int, 100> numbers;
+  rand.fill_numbers(numbers.data(), numbers.size(), 10, 20);
+  for (const auto number : numbers) {
+    REQUIRE(number >= 10);
+    REQUIRE(number <= 20);
+  }
+}
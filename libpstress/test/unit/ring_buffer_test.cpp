@@ -0,0 +1,69 @@
+#include "logging/async_writer.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <array>
+#include <thread>
+
+using logging::RingBuffer;
+
+namespace {
+bool write(RingBuffer &ring, std::string_view str) {
+  const std::array<std::string_view, 1> parts{str};
+  return ring.tryWrite(parts);
+}
+} // namespace
+
+TEST_CASE("Ring buffer capacity is a power of two", "[ring_buffer]") {
+  RingBuffer ring(3000);
+  REQUIRE(ring.capacity() == 4096);
+  REQUIRE(ring.empty());
+}
+
+TEST_CASE("Ring buffer refuses writes over capacity", "[ring_buffer]") {
+  RingBuffer ring(1024);
+  std::vector<char> out;
+
+  REQUIRE(write(ring, std::string(1000, 'a')));
+  REQUIRE(!write(ring, std::string(100, 'b')));
+  REQUIRE(ring.readAll(out) == 1000);
+  REQUIRE(ring.empty());
+  REQUIRE(write(ring, std::string(100, 'b')));
+}
+
+TEST_CASE("Ring buffer records wrap around", "[ring_buffer]") {
+  RingBuffer ring(1024);
+  std::vector<char> out;
+
+  REQUIRE(write(ring, std::string(1000, 'a')));
+  ring.readAll(out);
+  out.clear();
+
+  const std::array<std::string_view, 2> parts{"hello ", "world"};
+  REQUIRE(ring.tryWrite(parts));
+  REQUIRE(ring.readAll(out) == 11);
+  REQUIRE(std::string(out.begin(), out.end()) == "hello world");
+}
+
+TEST_CASE("Ring buffer keeps order between threads", "[ring_buffer]") {
+  RingBuffer ring(1024);
+  const std::size_t total = 100000;
+
+  std::jthread producer([&]() {
+    for (std::size_t idx = 0; idx < total; ++idx) {
+      const char ch = static_cast<char>('a' + idx % 26);
+      while (!write(ring, std::string_view(&ch, 1))) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  std::vector<char> out;
+  while (out.size() < total) {
+    ring.readAll(out);
+  }
+
+  for (std::size_t idx = 0; idx < total; ++idx) {
+    REQUIRE(out[idx] == static_cast<char>('a' + idx % 26));
+  }
+}
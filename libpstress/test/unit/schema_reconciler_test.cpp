@@ -0,0 +1,258 @@
+
+#include "schema_reconciler.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace {
+
+metadata::Column makeColumn(std::string const &name, metadata::ColumnType type,
+                            std::size_t length = 0) {
+  metadata::Column col;
+  col.name = name;
+  col.type = type;
+  col.length = length;
+  return col;
+}
+
+void addTable(metadata::Metadata &meta, std::string const &name) {
+  auto res = meta.createTable();
+  res.table()->name = name;
+  metadata::Column id = makeColumn("id", metadata::ColumnType::INT);
+  id.primary_key = true;
+  id.auto_increment = true;
+  res.table()->columns.push_back(id);
+  res.table()->columns.push_back(
+      makeColumn("name", metadata::ColumnType::VARCHAR, 20));
+  res.complete();
+}
+
+metadata::Table catalogTable(metadata::Metadata const &meta,
+                             std::string const &name) {
+  metadata::Table table;
+  auto const tracked = meta.tableByName(name);
+  table.name = tracked->name;
+  table.engine = "heap";
+  table.columns = tracked->columns;
+  table.indexes = tracked->indexes;
+  return table;
+}
+
+} // namespace
+
+TEST_CASE("Reconciling a matching schema changes nothing", "[reconciler]") {
+  metadata::Metadata meta;
+  addTable(meta, "foo");
+  const auto version = meta[0]->version;
+
+  const auto report = metadata::reconcile(meta, metadata::trackedVersions(meta),
+                                          {catalogTable(meta, "foo")});
+
+  REQUIRE_FALSE(report.drift());
+  REQUIRE(report.differences == 0);
+  REQUIRE(meta[0]->version == version);
+}
+
+TEST_CASE("Reconciling corrects drifted tables", "[reconciler]") {
+  metadata::Metadata meta;
+  addTable(meta, "foo");
+  meta.alterTable(0, [](metadata::Metadata::Reservation &res) {
+    // e.g. an ALTER TABLE which failed after modifying the definition
+    res.table()->columns.modify(1).nullable = true;
+    res.table()->columns.push_back(
+        makeColumn("added", metadata::ColumnType::TEXT));
+    res.complete();
+  });
+  const auto versions = metadata::trackedVersions(meta);
+
+  auto catalog = catalogTable(meta, "foo");
+  catalog.columns.pop_back();
+  auto &changed = catalog.columns.modify(1);
+  changed.type = metadata::ColumnType::CHAR;
+  changed.nullable = false;
+
+  const auto report = metadata::reconcile(meta, versions, {catalog});
+
+  REQUIRE(report.drift());
+  REQUIRE(report.correctedTables == 1);
+  REQUIRE(report.differences == 2);
+  REQUIRE(meta.size() == 1);
+  REQUIRE(meta[0]->columns.size() == 2);
+  REQUIRE(meta[0]->columns[1].type == metadata::ColumnType::CHAR);
+  // not read from the catalog, kept from the tracked definition
+  REQUIRE(meta[0]->columns[1].nullable);
+  REQUIRE(meta[0]->version != versions.at("foo"));
+}
+
+TEST_CASE("Reconciling removes missing tables", "[reconciler]") {
+  metadata::Metadata meta;
+  addTable(meta, "foo");
+  addTable(meta, "bar");
+
+  const auto report = metadata::reconcile(meta, metadata::trackedVersions(meta),
+                                          {catalogTable(meta, "bar")});
+
+  REQUIRE(report.removedTables == 1);
+  REQUIRE(meta.size() == 1);
+  REQUIRE(meta[0]->name == "bar");
+  REQUIRE(meta.findByName("foo") == metadata::Metadata::npos);
+}
+
+TEST_CASE("Reconciling keeps tables with unsupported columns",
+          "[reconciler]") {
+  metadata::Metadata meta;
+  addTable(meta, "foo");
+  const auto version = meta[0]->version;
+
+  // returned by readCatalog without columns
+  metadata::Table unsupported;
+  unsupported.name = "foo";
+
+  const auto report = metadata::reconcile(meta, metadata::trackedVersions(meta),
+                                          {unsupported});
+
+  REQUIRE_FALSE(report.drift());
+  REQUIRE(report.removedTables == 0);
+  REQUIRE(meta.size() == 1);
+  REQUIRE(meta[0]->version == version);
+
+  unsupported.name = "bar";
+  REQUIRE(metadata::adopt(meta, {unsupported}) == 0);
+  REQUIRE(meta.size() == 1);
+}
+
+TEST_CASE("Reconciling counts untracked tables", "[reconciler]") {
+  metadata::Metadata meta;
+  addTable(meta, "foo");
+
+  auto other = catalogTable(meta, "foo");
+  other.name = "other";
+
+  const auto report = metadata::reconcile(meta, metadata::trackedVersions(meta),
+                                          {catalogTable(meta, "foo"), other});
+
+  REQUIRE_FALSE(report.drift());
+  REQUIRE(report.untrackedTables == 1);
+  REQUIRE(meta.size() == 1);
+}
+
+TEST_CASE("Reconciling skips tables changed after capturing the versions",
+          "[reconciler]") {
+  metadata::Metadata meta;
+  addTable(meta, "foo");
+  const auto versions = metadata::trackedVersions(meta);
+
+  // concurrent ALTER, completed after the catalog was read
+  meta.alterTable(0, [](metadata::Metadata::Reservation &res) {
+    res.table()->columns.push_back(
+        makeColumn("added", metadata::ColumnType::TEXT));
+    res.complete();
+  });
+
+  auto catalog = catalogTable(meta, "foo");
+  catalog.columns.pop_back();
+
+  const auto report = metadata::reconcile(meta, versions, {catalog});
+
+  REQUIRE_FALSE(report.drift());
+  REQUIRE(meta[0]->columns.size() == 3);
+
+  // dropped tables are also skipped
+  const auto dropReport = metadata::reconcile(meta, versions, {});
+  REQUIRE(dropReport.removedTables == 0);
+  REQUIRE(meta.size() == 1);
+}
+
+TEST_CASE("Adopting adds untracked tables", "[reconciler]") {
+  metadata::Metadata meta;
+  addTable(meta, "foo");
+
+  metadata::Table existing;
+  existing.name = "sales.orders";
+  existing.columns.push_back(
+      makeColumn("note", metadata::ColumnType::TEXT));
+  auto pk = makeColumn("order_id", metadata::ColumnType::INT);
+  pk.primary_key = true;
+  existing.columns.push_back(pk);
+  existing.statistics->rowEstimate = 1000000;
+
+  const auto adopted =
+      metadata::adopt(meta, {catalogTable(meta, "foo"), existing});
+
+  REQUIRE(adopted == 1);
+  REQUIRE(meta.size() == 2);
+  auto const table = meta.tableByName("sales.orders");
+  REQUIRE(table != nullptr);
+  // the key is moved to the front, DELETE and UPDATE use the first column
+  REQUIRE(table->columns[0].name == "order_id");
+  REQUIRE(table->statistics->rows() == 1000000);
+}
+
+TEST_CASE("Correcting adopted tables keeps the key first", "[reconciler]") {
+  metadata::Metadata meta;
+
+  metadata::Table existing;
+  existing.name = "orders";
+  existing.engine = "heap";
+  existing.columns.push_back(makeColumn("note", metadata::ColumnType::TEXT));
+  auto pk = makeColumn("order_id", metadata::ColumnType::INT);
+  pk.primary_key = true;
+  existing.columns.push_back(pk);
+  REQUIRE(metadata::adopt(meta, {existing}) == 1);
+  const auto versions = metadata::trackedVersions(meta);
+
+  // catalog order, the key isn't the first attribute
+  existing.columns.push_back(
+      makeColumn("added", metadata::ColumnType::VARCHAR, 10));
+
+  const auto report = metadata::reconcile(meta, versions, {existing});
+
+  REQUIRE(report.correctedTables == 1);
+  auto const table = meta.tableByName("orders");
+  REQUIRE(table->columns.size() == 3);
+  REQUIRE(table->columns[0].name == "order_id");
+  REQUIRE(table->columns[1].name == "note");
+  REQUIRE(table->columns[2].name == "added");
+
+  // the reordered definition matches the catalog
+  REQUIRE_FALSE(metadata::reconcile(meta, metadata::trackedVersions(meta),
+                                    {existing})
+                    .drift());
+}
+
+TEST_CASE("Adopting skips tables without a single column key",
+          "[reconciler]") {
+  metadata::Metadata meta;
+
+  std::vector<metadata::Table> catalog(3);
+  catalog[0].name = "no_key";
+  catalog[1].name = "composite";
+  catalog[2].name = "keyed";
+  for (auto &table : catalog) {
+    table.columns.push_back(makeColumn("a", metadata::ColumnType::INT));
+    table.columns.push_back(makeColumn("b", metadata::ColumnType::INT));
+  }
+  catalog[1].columns.modify(0).primary_key = true;
+  catalog[1].columns.modify(1).primary_key = true;
+  catalog[2].columns.modify(1).primary_key = true;
+
+  REQUIRE(metadata::adopt(meta, catalog) == 1);
+  REQUIRE(meta.size() == 1);
+  REQUIRE(meta[0]->name == "keyed");
+  REQUIRE(meta[0]->columns[0].name == "b");
+}
+
+TEST_CASE("Adopting stops when the metadata is full", "[reconciler]") {
+  metadata::Metadata meta(1);
+
+  std::vector<metadata::Table> catalog(2);
+  catalog[0].name = "foo";
+  catalog[1].name = "bar";
+  for (auto &table : catalog) {
+    auto id = makeColumn("id", metadata::ColumnType::INT);
+    id.primary_key = true;
+    table.columns.push_back(id);
+  }
+
+  REQUIRE(metadata::adopt(meta, catalog) == 1);
+  REQUIRE(meta.size() == 1);
+}
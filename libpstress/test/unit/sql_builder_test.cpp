@@ -0,0 +1,50 @@
+#include "sql_variant/sql_builder.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <array>
+#include <cstdint>
+
+TEST_CASE("Statements are appended to the buffer", "[sql_builder]") {
+  std::string buffer = "previous statement";
+  sql_variant::SqlBuilder sql(buffer);
+  REQUIRE(buffer.empty());
+
+  const std::array<std::string_view, 3> columns{"a", "b", "\"C\""};
+  sql << "INSERT INTO ";
+  sql.identifier("foo") << " (";
+  sql.list(columns, ", ", [](auto &out, std::string_view column) {
+    out.identifier(column);
+  });
+  sql << ") VALUES (";
+  sql.parameter(1) << ", " << std::int64_t(-42) << ", ";
+  sql.literal("it's") << ");";
+
+  REQUIRE(sql.str() ==
+          "INSERT INTO foo (a, b, \"C\") VALUES ($1, -42, 'it''s');");
+  REQUIRE(&sql.str() == &buffer);
+}
+
+TEST_CASE("Literals double every quote", "[sql_builder]") {
+  std::string buffer;
+  sql_variant::SqlBuilder sql(buffer);
+  sql.literal("");
+  sql << ' ';
+  sql.literal("''a'");
+  REQUIRE(sql.view() == "'' '''''a'''");
+}
+
+TEST_CASE("Building reuses the capacity of the buffer", "[sql_builder]") {
+  std::string buffer;
+  buffer.reserve(1024);
+  const auto *data = buffer.data();
+
+  for (int idx = 0; idx < 10; ++idx) {
+    sql_variant::SqlBuilder sql(buffer);
+    sql << "SELECT ";
+    sql.list(std::array{1, 2, 3}, ", ",
+             [](auto &out, int value) { out << value; });
+    REQUIRE(sql.view() == "SELECT 1, 2, 3");
+  }
+  REQUIRE(buffer.data() == data);
+}
@@ -0,0 +1,78 @@
+#include "statistics/time_series.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <fstream>
+#include <sstream>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("Failures are counted by error code", "[statistics]") {
+  statistics::WorkerStatistics worker;
+  auto &stats = worker.action("insert");
+  stats.recordFailure("40P01");
+  stats.recordFailure("40P01");
+  stats.recordFailure();
+
+  statistics::snapshot_t earlier;
+  worker.mergeInto(earlier);
+  REQUIRE(earlier["insert"].failures == 3);
+  REQUIRE(earlier["insert"].errors["40P01"] == 2);
+  REQUIRE(earlier["insert"].errors[""] == 1);
+
+  stats.recordFailure("40P01");
+  statistics::snapshot_t current;
+  worker.mergeInto(current);
+  statistics::subtract(current, earlier);
+  REQUIRE(current["insert"].failures == 1);
+  REQUIRE(current["insert"].errors["40P01"] == 1);
+  REQUIRE(current["insert"].errors[""] == 0);
+}
+
+TEST_CASE("Skipped actions are neither successes nor failures",
+          "[statistics]") {
+  statistics::WorkerStatistics worker;
+  auto &stats = worker.action("delete");
+  stats.recordSkip();
+  stats.recordSkip();
+
+  statistics::snapshot_t earlier;
+  worker.mergeInto(earlier);
+  REQUIRE(earlier["delete"].skips == 2);
+  REQUIRE(earlier["delete"].successes == 0);
+  REQUIRE(earlier["delete"].failures == 0);
+  REQUIRE(earlier["delete"].actionTime.count() == 0);
+
+  stats.recordSkip();
+  statistics::snapshot_t current;
+  worker.mergeInto(current);
+  statistics::subtract(current, earlier);
+  REQUIRE(current["delete"].skips == 1);
+}
+
+TEST_CASE("Time series is written as CSV", "[statistics]") {
+  const std::filesystem::path path = "logs/unit-test-time-series.csv";
+  std::filesystem::create_directories(path.parent_path());
+
+  statistics::WorkerStatistics worker;
+  worker.action("insert").recordSuccess(1500us, 1000us);
+  worker.action("insert").recordFailure("23505");
+  worker.action("insert").recordFailure();
+
+  statistics::snapshot_t snapshot;
+  worker.mergeInto(snapshot);
+  {
+    statistics::TimeSeriesWriter writer(path);
+    writer.write(std::chrono::system_clock::time_point(1234ms), 1s, snapshot);
+  }
+
+  std::ifstream stream(path);
+  std::stringstream content;
+  content << stream.rdbuf();
+  REQUIRE(content.str() ==
+          "timestamp_ms,elapsed,action,successes,failures,errors,"
+          "action_time_sum_us,server_time_sum_us\n"
+          "1234,1.000,insert,1,2,other=1;23505=1,1500,1000\n");
+
+  std::filesystem::remove(path);
+}
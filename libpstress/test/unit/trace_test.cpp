@@ -0,0 +1,89 @@
+#include "trace/trace.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Traces can be written and read back", "[trace]") {
+  const std::string name = "unit-test-trace";
+  const std::filesystem::path path = "logs/trace-conn-unit-test-trace.bin";
+  std::filesystem::remove(path);
+
+  {
+    trace::TraceWriter writer(name);
+
+    trace::Record record;
+    record.timestamp = std::chrono::nanoseconds(1000);
+    record.duration = std::chrono::nanoseconds(50);
+    record.worker = 3;
+    record.action = "insert_some_data";
+    record.statement = "INSERT INTO foo VALUES (1);";
+    writer.write(record);
+
+    record.timestamp = std::chrono::nanoseconds(2000);
+    record.sqlstate = {'4', '2', 'P', '0', '1'};
+    record.status = 1;
+    record.action = "";
+    const std::string large(100000, 'x');
+    record.statement = large;
+    writer.write(record);
+  }
+  logging::AsyncWriter::instance().flush();
+
+  trace::TraceReader reader(path);
+  REQUIRE(reader.connectionName() == name);
+  REQUIRE(reader.firstTimestamp() == std::chrono::nanoseconds(1000));
+
+  trace::Record record;
+  REQUIRE(reader.next(record));
+  REQUIRE(record.timestamp == std::chrono::nanoseconds(1000));
+  REQUIRE(record.duration == std::chrono::nanoseconds(50));
+  REQUIRE(record.worker == 3);
+  REQUIRE(record.sqlstateView().empty());
+  REQUIRE(record.action == "insert_some_data");
+  REQUIRE(record.statement == "INSERT INTO foo VALUES (1);");
+
+  REQUIRE(reader.next(record));
+  REQUIRE(record.timestamp == std::chrono::nanoseconds(2000));
+  REQUIRE(record.sqlstateView() == "42P01");
+  REQUIRE(record.status == 1);
+  REQUIRE(record.action.empty());
+  REQUIRE(record.statement.size() == 100000);
+
+  REQUIRE(!reader.next(record));
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Appended traces are read as one trace", "[trace]") {
+  const std::string name = "unit-test-trace-appended";
+  const std::filesystem::path path =
+      "logs/trace-conn-unit-test-trace-appended.bin";
+  std::filesystem::remove(path);
+
+  // e.g. a rerun in the same logs directory
+  for (const std::int64_t timestamp : {1000, 2000}) {
+    trace::TraceWriter writer(name);
+    trace::Record record;
+    record.timestamp = std::chrono::nanoseconds(timestamp);
+    record.statement = "SELECT 1;";
+    writer.write(record);
+    logging::AsyncWriter::instance().flush();
+  }
+
+  trace::TraceReader reader(path);
+  REQUIRE(reader.connectionName() == name);
+
+  trace::Record record;
+  REQUIRE(reader.next(record));
+  REQUIRE(record.timestamp == std::chrono::nanoseconds(1000));
+  REQUIRE(reader.next(record));
+  REQUIRE(record.timestamp == std::chrono::nanoseconds(2000));
+  REQUIRE(record.statement == "SELECT 1;");
+  REQUIRE(!reader.next(record));
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Invalid traces are rejected", "[trace]") {
+  REQUIRE_THROWS_AS(trace::TraceReader("logs/no-such-trace.bin"),
+                    trace::TraceException);
+}
@@ -0,0 +1,270 @@
+#include "action/value_generator.hpp"
+#include "sql_variant/generic.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <set>
+#include <stdexcept>
+
+namespace {
+
+metadata::Table make_table() {
+  metadata::Table table;
+  table.name = "foo";
+  table.version = 1;
+  auto addColumn = [&](std::string_view name, metadata::ColumnType type) {
+    metadata::Column col;
+    col.name = name;
+    col.type = type;
+    col.length = 20;
+    table.columns.push_back(col);
+  };
+  addColumn("id", metadata::ColumnType::INT);
+  table.columns.modify(0).auto_increment = true;
+  addColumn("a", metadata::ColumnType::INT);
+  addColumn("b", metadata::ColumnType::VARCHAR);
+  return table;
+}
+
+std::string next(action::ColumnGenerator &generator, ps_random &rand) {
+  std::string value;
+  generator.append(value, rand);
+  return value;
+}
+
+} // namespace
+
+TEST_CASE("Distributions are parsed", "[values]") {
+  REQUIRE(action::parse_distribution("zipfian") ==
+          action::Distribution::zipfian);
+  REQUIRE(action::parse_distribution("sequential") ==
+          action::Distribution::sequential);
+  REQUIRE_THROWS_AS(action::parse_distribution("gaussian"),
+                    std::runtime_error);
+}
+
+TEST_CASE("Column specs override type specs", "[values]") {
+  const auto table = make_table();
+  action::ValueConfig config;
+  config.type("INT").max = 10;
+  config.columns["a"].max = 20;
+  config.columns["foo.a"].max = 30;
+
+  REQUIRE(config.spec(table, table.columns[0]).max == 10);
+  REQUIRE(config.spec(table, table.columns[1]).max == 30);
+  config.columns.erase("foo.a");
+  REQUIRE(config.spec(table, table.columns[1]).max == 20);
+  REQUIRE_THROWS_AS(config.type("jsonb"), std::runtime_error);
+}
+
+TEST_CASE("Values follow their distribution", "[values]") {
+  const auto table = make_table();
+  auto const &column = table.columns[1];
+  auto rand = ps_random::from_seed(1);
+
+  action::ValueSpec spec;
+  spec.min = 1;
+  spec.max = 100;
+
+  SECTION("sequential") {
+    spec.distribution = action::Distribution::sequential;
+    action::ColumnGenerator generator(table, column, spec);
+    for (int idx = 0; idx < 250; ++idx) {
+      REQUIRE(next(generator, rand) == std::to_string(idx % 100 + 1));
+    }
+  }
+
+  SECTION("zipfian") {
+    spec.distribution = action::Distribution::zipfian;
+    action::ColumnGenerator generator(table, column, spec);
+    std::map<int, int> counts;
+    for (int idx = 0; idx < 10000; ++idx) {
+      const auto value = std::stoi(next(generator, rand));
+      REQUIRE(value >= 1);
+      REQUIRE(value <= 100);
+      counts[value]++;
+    }
+    // with skew 0.99, 1 is ~19% of the values, 2 is ~10%
+    REQUIRE(counts[1] > 1500);
+    REQUIRE(counts[1] > counts[2]);
+    REQUIRE(counts[2] > counts[10]);
+  }
+
+  SECTION("normal") {
+    spec.distribution = action::Distribution::normal;
+    action::ColumnGenerator generator(table, column, spec);
+    double sum = 0;
+    int center = 0;
+    for (int idx = 0; idx < 10000; ++idx) {
+      const auto value = std::stoi(next(generator, rand));
+      REQUIRE(value >= 1);
+      REQUIRE(value <= 100);
+      sum += value;
+      center += value > 33 && value <= 67;
+    }
+    REQUIRE(sum / 10000 > 48);
+    REQUIRE(sum / 10000 < 53);
+    // +-1 standard deviation
+    REQUIRE(center > 6000);
+  }
+}
+
+TEST_CASE("Boolean columns get both values by default", "[values]") {
+  auto table = make_table();
+  table.columns.modify(1).type = metadata::ColumnType::BOOL;
+  auto rand = ps_random::from_seed(1);
+
+  action::ColumnGenerator generator(table, table.columns[1],
+                                    action::ValueSpec{});
+  std::map<std::string, int> counts;
+  for (int idx = 0; idx < 1000; ++idx) {
+    counts[next(generator, rand)]++;
+  }
+  REQUIRE(counts.size() == 2);
+  REQUIRE(counts["true"] > 400);
+  REQUIRE(counts["false"] > 400);
+}
+
+TEST_CASE("Default ranges fit narrow columns", "[values]") {
+  auto table = make_table();
+  // adopted smallint and numeric(5, 2) columns
+  table.columns.modify(1).length = 32767;
+  auto &numeric = table.columns.modify(0);
+  numeric.type = metadata::ColumnType::REAL;
+  numeric.auto_increment = false;
+  numeric.length = 999;
+  auto rand = ps_random::from_seed(1);
+
+  action::ColumnGenerator smallint(table, table.columns[1], {});
+  action::ColumnGenerator real(table, table.columns[0], {});
+  for (int idx = 0; idx < 1000; ++idx) {
+    REQUIRE(std::stoi(next(smallint, rand)) <= 32767);
+    REQUIRE(std::stod(next(real, rand)) <= 999);
+  }
+}
+
+TEST_CASE("Lengths are limited to the column", "[values]") {
+  const auto table = make_table();
+  auto rand = ps_random::from_seed(1);
+
+  // e.g. set_type_values("varchar", {min_length = 50, max_length = 100})
+  action::ValueSpec spec;
+  spec.min_length = 50;
+  spec.max_length = 100;
+  action::ColumnGenerator generator(table, table.columns[2], spec);
+  for (int idx = 0; idx < 100; ++idx) {
+    REQUIRE(next(generator, rand).size() == 20);
+  }
+}
+
+TEST_CASE("Values can have a limited cardinality", "[values]") {
+  const auto table = make_table();
+  auto const &column = table.columns[2];
+
+  action::ValueSpec spec;
+  spec.cardinality = 5;
+  spec.min_length = 5;
+  spec.max_length = 20;
+
+  action::ColumnGenerator first(table, column, spec);
+  action::ColumnGenerator second(table, column, spec);
+  auto rand1 = ps_random::from_seed(1);
+  auto rand2 = ps_random::from_seed(2);
+
+  std::set<std::string> values1;
+  std::set<std::string> values2;
+  for (int idx = 0; idx < 1000; ++idx) {
+    const auto value = next(first, rand1);
+    REQUIRE(value.size() >= 5);
+    REQUIRE(value.size() <= 20);
+    values1.insert(value);
+    values2.insert(next(second, rand2));
+  }
+  REQUIRE(values1.size() == 5);
+  // workers generate the same distinct values
+  REQUIRE(values1 == values2);
+}
+
+TEST_CASE("Nullable columns get NULL values", "[values]") {
+  auto table = make_table();
+  auto rand = ps_random::from_seed(1);
+
+  action::ValueSpec spec;
+  spec.null_fraction = 0.25;
+
+  action::ColumnGenerator notNull(table, table.columns[1], spec);
+  table.columns.modify(1).nullable = true;
+  action::ColumnGenerator nullable(table, table.columns[1], spec);
+
+  int nulls = 0;
+  for (int idx = 0; idx < 10000; ++idx) {
+    REQUIRE(next(notNull, rand) != sql_variant::null_parameter);
+    nulls += next(nullable, rand) == sql_variant::null_parameter;
+  }
+  REQUIRE(nulls > 2200);
+  REQUIRE(nulls < 2800);
+}
+
+TEST_CASE("Invalid ranges are rejected", "[values]") {
+  const auto table = make_table();
+  action::ValueSpec spec;
+  spec.min = 10;
+  spec.max = 5;
+  REQUIRE_THROWS_AS(action::ColumnGenerator(table, table.columns[1], spec),
+                    std::runtime_error);
+}
+
+TEST_CASE("Row generators are cached per table definition", "[values]") {
+  auto table = make_table();
+  action::ValueConfig config;
+  auto rand = ps_random::from_seed(1);
+
+  action::RowGeneratorCache cache;
+  auto &generator = cache.get(table, config);
+  // auto increment columns are skipped
+  REQUIRE(generator.parameters(3, rand).size() == 6);
+  REQUIRE(&cache.get(table, config) == &generator);
+
+  std::string row;
+  generator.appendCopyRow(row, rand);
+  REQUIRE(std::count(row.begin(), row.end(), '\t') == 1);
+
+  table.version = 2;
+  metadata::Column added;
+  added.name = "c";
+  added.type = metadata::ColumnType::BOOL;
+  table.columns.push_back(added);
+  auto &altered = cache.get(table, config);
+  REQUIRE(altered.version() == 2);
+  REQUIRE(altered.parameters(2, rand).size() == 6);
+}
+
+TEST_CASE("Generated columns aren't written", "[values]") {
+  auto table = make_table();
+  table.columns.modify(2).generated = metadata::Generated::stored;
+  auto rand = ps_random::from_seed(1);
+
+  action::RowGenerator generator(table, action::ValueConfig{});
+  const auto values = generator.parameters(2, rand);
+  REQUIRE(values.size() == 2);
+  for (auto const &value : values) {
+    // the INT column
+    REQUIRE(std::all_of(value.begin(), value.end(),
+                        [](char c) { return std::isdigit(c) != 0; }));
+  }
+}
+
+TEST_CASE("Updated rows leave the key unchanged", "[values]") {
+  auto table = make_table();
+  // e.g. an adopted table with a non serial key
+  table.columns.modify(1).primary_key = true;
+  auto rand = ps_random::from_seed(1);
+
+  action::RowGeneratorCache inserted;
+  action::RowGeneratorCache updated(action::RowColumns::nonKey);
+  REQUIRE(inserted.get(table, {}).parameters(1, rand).size() == 2);
+  REQUIRE(updated.get(table, {}).parameters(1, rand).size() == 1);
+}
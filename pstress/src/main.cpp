@@ -1,9 +1,11 @@
 
+#include <CLI/CLI.hpp>
 #include <sol/sol.hpp>
 #include <spdlog/spdlog.h>
 
 #include "action/action_registry.hpp"
 #include "process/postgres.hpp"
+#include "trace/replay.hpp"
 #include "workload.hpp"
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/dll/runtime_symbol_info.hpp>
@@ -15,6 +17,18 @@ inline std::unique_ptr<Node> setup_node_pg(sol::table const &table) {
   const std::string password = table.get_or("password", std::string(""));
   const std::string database = table.get_or("database", std::string("pstress"));
   auto on_connect_lua = table.get<sol::protected_function>("on_connect");
+  const std::size_t max_tables = static_cast<std::size_t>(table.get_or(
+      "max_tables",
+      static_cast<double>(metadata::limits::default_maximum_table_count)));
+
+  logging::StatementLogPolicy log_policy;
+  log_policy.mode = logging::StatementLogPolicy::parseMode(
+      table.get_or("statement_log", std::string("full")));
+  log_policy.truncateLength = table.get_or(
+      "statement_log_length", log_policy.truncateLength);
+  log_policy.sampleRate =
+      table.get_or("statement_log_sample", log_policy.sampleRate);
+  log_policy.binaryTrace = table.get_or("trace", false);
 
   spdlog::info("Setting up PG node on host: '{}', port: {}", host, port);
 
@@ -30,7 +44,9 @@ inline std::unique_ptr<Node> setup_node_pg(sol::table const &table) {
         } else {
           spdlog::debug("No on connect callback defined");
         }
-      }));
+      },
+      log_policy),
+      max_tables);
 }
 
 inline void node_init(Node &self, sol::protected_function init_callback) {
@@ -45,13 +61,159 @@ inline void node_init(Node &self, sol::protected_function init_callback) {
   }
 }
 
+inline void create_random_tables(Worker &self, std::size_t count,
+                                 sol::optional<std::size_t> threads) {
+  self.create_random_tables(count, threads.value_or(1));
+}
+
+inline void generate_initial_data(Worker &self,
+                                  sol::optional<sol::table> const &table) {
+  InitialDataParams params;
+  if (table) {
+    params.rows = static_cast<std::size_t>(
+        table->get_or("rows", static_cast<double>(params.rows)));
+    params.size = static_cast<std::size_t>(
+        table->get_or("size", static_cast<double>(params.size)));
+    params.threads = table->get_or("threads", params.threads);
+    params.chunk_rows = static_cast<std::size_t>(
+        table->get_or("chunk_rows", static_cast<double>(params.chunk_rows)));
+    params.progress_interval_in_seconds =
+        table->get_or("progress_interval", params.progress_interval_in_seconds);
+  }
+  self.generate_initial_data(params);
+}
+
 inline auto init_random_workload(Node &self, sol::table const &table) {
   const std::uint16_t repeat_times = table.get_or("repeat_times", 1);
   const std::uint16_t run_seconds = table.get_or("run_seconds", 10);
   const std::uint16_t worker_count = table.get_or("worker_count", 5);
+  const std::uint16_t report_interval = table.get_or("report_interval", 0);
+  const std::uint16_t pipeline_depth = table.get_or("pipeline_depth", 0);
+  const double target_rate = table.get_or("target_rate", 0.0);
+  const std::string arrival = table.get_or("arrival", std::string("uniform"));
+  const std::string time_series =
+      table.get_or("time_series", std::string(""));
+  const std::uint16_t reconcile_interval =
+      table.get_or("reconcile_interval", 0);
+
+  return self.init_random_workload(WorkloadParams{
+      run_seconds, repeat_times, worker_count, report_interval, pipeline_depth,
+      target_rate, parse_arrival(arrival), time_series, reconcile_interval});
+}
+
+inline action::ValueSpec value_spec(sol::table const &table) {
+  action::ValueSpec spec;
+  spec.distribution = action::parse_distribution(
+      table.get_or("distribution", std::string("uniform")));
+  spec.min = table.get<std::optional<double>>("min");
+  spec.max = table.get<std::optional<double>>("max");
+  spec.skew = table.get_or("skew", spec.skew);
+  spec.deviation = table.get_or("deviation", spec.deviation);
+  spec.length_distribution = action::parse_distribution(
+      table.get_or("length_distribution", std::string("uniform")));
+  spec.min_length = table.get<std::optional<std::size_t>>("min_length");
+  spec.max_length = table.get<std::optional<std::size_t>>("max_length");
+  spec.cardinality = table.get_or("cardinality", spec.cardinality);
+  spec.null_fraction = table.get_or("null_fraction", spec.null_fraction);
+  return spec;
+}
+
+inline std::size_t adopt_schema(Node &self, sol::table const &table) {
+  metadata::CatalogFilter filter;
+  filter.schema = table.get_or("schema", std::string(""));
+  filter.include = table.get_or("include", std::string(""));
+  return self.adopt_schema(filter);
+}
 
-  return self.init_random_workload(
-      WorkloadParams{run_seconds, repeat_times, worker_count});
+// {name, rows, statements, failures, latency_us} table, rows are estimates
+// based on the DML executed by pstress
+inline sol::table table_info(sol::state_view &lua,
+                             metadata::Table const &table) {
+  auto const &stats = *table.statistics;
+  return lua.create_table_with(
+      "name", table.name, "rows", stats.rows(), "statements",
+      stats.statements.load(), "failures", stats.failures.load(),
+      "latency_us", stats.latencySum.load());
+}
+
+// Array of table_info tables
+inline sol::table table_statistics(Node &self, sol::this_state state) {
+  sol::state_view lua(state);
+  sol::table result = lua.create_table();
+
+  auto const &tables = self.tables();
+  for (std::size_t idx = 0; idx < tables.size(); ++idx) {
+    auto table = tables[idx];
+    if (table == nullptr) {
+      continue;
+    }
+    result.add(table_info(lua, *table));
+  }
+
+  return result;
+}
+
+// table_info of the tracked table, nil if there is none with this name
+inline sol::object table_by_name(Node &self, std::string const &name,
+                                 sol::this_state state) {
+  sol::state_view lua(state);
+  auto table = self.tables().tableByName(name);
+  if (table == nullptr) {
+    return sol::make_object(lua, sol::lua_nil);
+  }
+  return sol::make_object(lua, table_info(lua, *table));
+}
+
+inline int run_replay(int argc, char **argv) {
+  CLI::App app{"Replays binary statement traces (logs/trace-conn-*.bin)"};
+
+  std::vector<std::string> traces;
+  std::string host = "localhost";
+  std::uint16_t port = 5432;
+  std::string user = "postgres";
+  std::string password;
+  std::string database = "pstress";
+  std::string speed = "1";
+
+  app.add_option("traces", traces, "Trace files, one per connection")
+      ->required();
+  app.add_option("--host", host, "Server host");
+  app.add_option("--port", port, "Server port");
+  app.add_option("--user", user, "User name");
+  app.add_option("--password", password, "Password");
+  app.add_option("--database", database, "Database name");
+  app.add_option("--speed", speed,
+                 "Replay speed: 1 is the original timing, N is N times "
+                 "faster, max ignores timing");
+
+  CLI11_PARSE(app, argc, argv);
+
+  trace::ReplayParams params;
+  params.traces.assign(traces.begin(), traces.end());
+  try {
+    params.speed = speed == "max" ? 0.0 : std::stod(speed);
+  } catch (std::exception const &) {
+    spdlog::error("Invalid replay speed: '{}'", speed);
+    return 1;
+  }
+  if (params.speed < 0) {
+    spdlog::error("Invalid replay speed: '{}'", speed);
+    return 1;
+  }
+
+  SqlFactory factory(
+      sql_variant::ServerParams{database, host, "", user, password, 0, port},
+      nullptr);
+
+  try {
+    trace::replay(params, [&factory](std::string const &name) {
+      return factory.connect(name);
+    });
+    return 0;
+  } catch (std::exception const &e) {
+    spdlog::error("Replay failed: {}", e.what());
+    return 1;
+  }
 }
 
 extern "C" {
@@ -67,10 +229,29 @@ int main(int argc, char **argv) {
   spdlog::info("Starting pstress");
 
   if (argc < 2) {
-    spdlog::error("Not enough arguments! Usage: pstress <scenario_name>");
+    spdlog::error("Not enough arguments! Usage: pstress <scenario_name> "
+                  "[--seed N] or pstress replay [options] <trace files>");
     return 1;
   }
 
+  if (std::string_view(argv[1]) == "replay") {
+    return run_replay(argc - 1, argv + 1);
+  }
+
+  CLI::App app{"Runs a pstress scenario"};
+  std::string scenario;
+  std::uint64_t seed = 0;
+  app.add_option("scenario", scenario, "Scenario script")->required();
+  auto *seed_option = app.add_option(
+      "--seed", seed, "Random seed of the run, to repeat a previous run");
+  app.allow_extras();
+  CLI11_PARSE(app, argc, argv);
+
+  if (*seed_option) {
+    ps_random::set_run_seed(seed);
+  }
+  spdlog::info("Random seed: {}", ps_random::run_seed());
+
   sol::state lua;
   lua.open_libraries();
   lua.require("toml", luaopen_toml);
@@ -96,17 +277,53 @@ int main(int argc, char **argv) {
   node_usertype["init"] = &node_init;
   node_usertype["initRandomWorkload"] = &init_random_workload;
   node_usertype["possibleActions"] = &Node::possibleActions;
+  node_usertype["dmlConfig"] = [](Node &self) {
+    return &self.defaultConfig().dml;
+  };
+  node_usertype["tableStatistics"] = &table_statistics;
+  node_usertype["table_by_name"] = &table_by_name;
+  node_usertype["adopt_schema"] = &adopt_schema;
+  node_usertype["save_metadata"] = [](Node &self, std::string const &path) {
+    self.save_metadata(path);
+  };
+  node_usertype["load_metadata"] = [](Node &self, std::string const &path) {
+    return self.load_metadata(path);
+  };
+
+  lua.new_usertype<action::DmlConfig>(
+      "DmlConfig", sol::no_constructor, "delete_min",
+      &action::DmlConfig::deleteMin, "delete_max",
+      &action::DmlConfig::deleteMax, "table_candidates",
+      &action::DmlConfig::tableCandidates, "delete_min_table_rows",
+      &action::DmlConfig::deleteMinTableRows, "insert_max_table_rows",
+      &action::DmlConfig::insertMaxTableRows, "set_type_values",
+      [](action::DmlConfig &self, std::string const &type,
+         sol::table const &table) {
+        self.values.type(type) = value_spec(table);
+      },
+      "set_column_values",
+      [](action::DmlConfig &self, std::string const &column,
+         sol::table const &table) {
+        self.values.columns[column] = value_spec(table);
+      });
 
   auto worker_usertype =
       lua.new_usertype<Worker>("Worker", sol::no_constructor);
-  worker_usertype["create_random_tables"] = &Worker::create_random_tables;
-  worker_usertype["generate_initial_data"] = &Worker::generate_initial_data;
+  worker_usertype["create_random_tables"] = &create_random_tables;
+  worker_usertype["generate_initial_data"] = &generate_initial_data;
   worker_usertype["sql_connection"] = &Worker::sql_connection;
 
   lua.new_usertype<RandomWorker>(
       "Worker", sol::no_constructor, "create_random_tables",
-      &RandomWorker::create_random_tables, "generate_initial_data",
-      &RandomWorker::generate_initial_data, "possibleActions",
+      [](RandomWorker &self, std::size_t count,
+         sol::optional<std::size_t> threads) {
+        create_random_tables(self, count, threads);
+      },
+      "generate_initial_data",
+      [](RandomWorker &self, sol::optional<sol::table> const &table) {
+        generate_initial_data(self, table);
+      },
+      "possibleActions",
       &RandomWorker::possibleActions);
 
   auto workload_usertype =
@@ -117,11 +334,11 @@ int main(int argc, char **argv) {
   workload_usertype["worker_count"] = &Workload::worker_count;
   workload_usertype["reconnect_workers"] = &Workload::reconnect_workers;
 
-  auto action_factory_usertype = lua.new_usertype<action::ActionFactory>(
+  auto action_factory_usertype = lua.new_usertype<action::ActionReference>(
       "ActionFactory", sol::no_constructor);
-  action_factory_usertype["weight"] = sol::property(
-      [](action::ActionFactory &self) { return self.weight; },
-      [](action::ActionFactory &self, std::size_t v) { self.weight = v; });
+  action_factory_usertype["weight"] =
+      sol::property(&action::ActionReference::weight,
+                    &action::ActionReference::setWeight);
 
   auto action_registry_usertype = lua.new_usertype<action::ActionRegistry>(
       "ActionRegistry", sol::no_constructor);
@@ -179,6 +396,12 @@ int main(int argc, char **argv) {
 
   lua["setup_node_pg"] = setup_node_pg;
 
+  lua["random_seed"] = []() { return ps_random::run_seed(); };
+  lua["set_random_seed"] = [](std::uint64_t seed) {
+    spdlog::info("Random seed: {}", seed);
+    ps_random::set_run_seed(seed);
+  };
+
   auto fs_usertype =
       lua.new_usertype<Fs>("fs", sol::no_constructor);
   fs_usertype["is_directory"] = [](std::string const &path) {
@@ -193,7 +416,7 @@ int main(int argc, char **argv) {
     return std::filesystem::remove_all(dir);
   };
 
-  auto script = lua.load_file(argv[1]);
+  auto script = lua.load_file(scenario);
 
   if (!script.valid()) {
     sol::error err = script;
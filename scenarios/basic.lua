@@ -18,8 +18,13 @@ function db_setup(worker)
 	-- for example configuring pg_tde for it
 	init_pg_tde_only_for_db(worker:sql_connection())
 	-- or creating tables and loading some data
+	-- the optional second parameter creates the tables using multiple connections
 	worker:create_random_tables(5)
-	worker:generate_initial_data() -- TODO: this method needs some parameters...
+	-- loads 1000 rows into every table by default, using COPY
+	-- rows = N changes the row count, size = N loads approximately N bytes per table
+	-- threads = N loads chunks of chunk_rows rows using N connections in parallel,
+	-- reporting the progress every progress_interval seconds
+	worker:generate_initial_data({ rows = 1000, threads = 4 })
 end
 
 -- another callback function, called after establishing any database connection
@@ -30,6 +35,10 @@ end
 
 -- main function executed directly by pstress
 function main()
+	-- the random seed of the run is logged at startup, and can be set with pstress --seed N, or here,
+	-- before creating nodes and workloads: workers with the same name generate the same random
+	-- actions with the same seed (but concurrent workers still interleave differently)
+	-- set_random_seed(12345)
 	datadir = getenv("PG_DATADIR", "datadir")
 	installdir = getenv("PG_INST", "/home/dutow/work/pg17inst/")
 
@@ -68,6 +77,16 @@ function main()
 		password = "",
 		database = "pstress",
 		on_connect = conn_settings,
+		-- statement logging of the connections (logs/sql-conn-*.log), written asynchronously
+		-- one of "full" (default), "truncated" (statement_log_length bytes), "errors" (only failed
+		-- statements) or "sampled" (every statement_log_sample-th statement, and all failed ones)
+		statement_log = "full",
+		-- binary statement traces (logs/trace-conn-*.bin), which can be replayed later with
+		-- bin/pstress replay --port 5432 --speed 1 logs/trace-conn-*.bin
+		trace = false,
+		-- maximum number of tables tracked by the node (200 by default), slots are allocated as
+		-- tables are created, so large values are cheap
+		max_tables = 200,
 	})
 
 	-- Modifies the default registry again, but the node already copied the default registry above
@@ -77,14 +96,59 @@ function main()
 	-- initializes the node, this calls the db_setup callback above
 	n1:init(db_setup)
 
+	-- tables which already exist in the database can be used instead of (or in addition to) creating
+	-- and loading new ones: adopt_schema reads the definitions from the catalog and adds the tables
+	-- to the node, row counts are estimated from the table statistics of the server
+	-- schema is the current schema by default, include is a regular expression for the table names
+	-- n1:adopt_schema({ schema = "public", include = "^orders" })
+
+	-- the tables tracked by the node can be saved, and restored when the same database is used again,
+	-- e.g. to continue a soak run with registerPostgresDatadir without running db_setup again:
+	-- if not n1:load_metadata(datadir .. ".metadata") then n1:init(db_setup) end
+	-- ...
+	-- n1:save_metadata(datadir .. ".metadata")
+
 	-- we can also modify the registry of the node directly
 	-- this doesn't affect the default registry
 	n1:possibleActions():makeCustomTableSqlAction("reindex", "REINDEX TABLE {table};", 1)
+	-- {table:name} addresses a tracked table by name, the action fails if it isn't tracked
+	-- n1:possibleActions():makeCustomSqlAction("analyze_orders", "ANALYZE {table:orders};", 1)
+
+	-- DML table targeting, based on the estimated row counts of the tables:
+	-- table_candidates = N uses the largest of N random tables, deletes skip tables
+	-- with less than delete_min_table_rows rows, inserts skip tables with at least
+	-- insert_max_table_rows rows (0 disables these limits)
+	-- n1:tableStatistics() returns the estimated rows, statement, failure counts
+	-- and total latency of every table, n1:table_by_name("orders") the same for a single
+	-- table (nil if it isn't tracked)
+	n1:dmlConfig().delete_min_table_rows = 100
+
+	-- distributions of the generated values, per column type ("int", "real", "bool", "char", "varchar",
+	-- "text", "bytea") or for specific columns ("table.column" or "column")
+	-- distribution and length_distribution: "uniform" (default), "zipfian" (with skew), "sequential"
+	-- or "normal" (with deviation, relative to the range)
+	-- min/max: range of numbers, min_length/max_length: range of string lengths
+	-- cardinality = N: only N distinct values, null_fraction: fraction of NULLs in nullable columns
+	n1:dmlConfig():set_type_values("text", { length_distribution = "zipfian", min_length = 10, max_length = 5000 })
+	-- n1:dmlConfig():set_column_values("orders.status", { distribution = "zipfian", cardinality = 5 })
 
 	-- creates a workload
 	-- similarly this copies the registry from the node to the workers,
 	-- later modifications to the node won't be effective
-	t1 = n1:initRandomWorkload({ run_seconds = 10, worker_count = 5 })
+	-- report_interval logs per action latency percentiles every N seconds, the
+	-- same report is also logged for the whole run by wait_completion
+	-- pipeline_depth = N lets every worker keep up to N DML statements in flight
+	-- (libpq pipeline mode), instead of waiting for each round trip
+	-- target_rate = N runs the workers open loop: the workload starts N actions
+	-- per second ("uniform" or "poisson" arrival), and latencies are measured
+	-- from the scheduled start, including the time spent behind schedule
+	-- time_series = "logs/timeseries.csv" writes per second successes, failures
+	-- by SQLSTATE and latency sums of every action during the run (JSON lines
+	-- unless the file name ends in .csv)
+	-- reconcile_interval = N compares the tables tracked by pstress with the
+	-- database catalog every N seconds, and corrects the tracked definitions
+	-- if a DDL statement failed halfway
+	t1 = n1:initRandomWorkload({ run_seconds = 10, worker_count = 5, report_interval = 5 })
 
 	-- this modifies the second worker to use the latest version of the default registry
 	-- effect: worker 2 will run truncate, but not reindex